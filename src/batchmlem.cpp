@@ -0,0 +1,499 @@
+// batchmlem.cpp
+
+#include "batchmlem.h"
+#include <TFile.h>
+#include <TGraph.h>
+#include "utilities.h"
+
+// ##### BATCHED ML-EM KERNEL #####
+BatchMLEM::BatchMLEM(const SystemMatrix* systemMatrixData,
+                     const std::vector<std::vector<Double_t> >& N_dcbOfJobs) :
+    numberOfJobs(N_dcbOfJobs.size()),
+    numberOfVoxels(systemMatrixData->numberOfVoxels),
+    numberOfSubsets(1),
+    accelerators(N_dcbOfJobs.size(), 1.0),
+    isJobActive(N_dcbOfJobs.size(), kTRUE),
+    isProjectionValid(kFALSE),
+    systemMatrixData(systemMatrixData){
+    // compact the measurements and calculate the sensitivities of each job
+
+    Int_t K = numberOfJobs;
+    positionOfElement.assign(systemMatrixData->numberOfElements, -1);
+    for (Int_t i = 0; i < systemMatrixData->numberOfElements; ++i){
+        for (Int_t k = 0; k < K; ++k){
+            if (N_dcbOfJobs[k][i] > 0){
+                positionOfElement[i] = measuredElements.size();
+                measuredElements.push_back(i);
+                break;
+            }
+        }
+    }
+
+    Int_t M = measuredElements.size();
+    N.assign(M * K, 0.0);
+    for (Int_t m = 0; m < M; ++m){
+        for (Int_t k = 0; k < K; ++k){
+            N[m * K + k] = N_dcbOfJobs[k][measuredElements[m]];
+        }
+    }
+
+    setNumberOfSubsets(1);
+
+    projections.assign(M * K, 0.0);
+    ratios.assign(M * K, 0.0);
+    A_v.assign(size_t(numberOfVoxels) * K, 1.0);
+}
+
+void BatchMLEM::setNumberOfSubsets(const Int_t numberOfSubsets){
+    // split the measured elements into ordered subsets (OS-EM) by detector pair
+    // and calculate the sensitivities of each subset
+
+    this->numberOfSubsets = numberOfSubsets;
+
+    Int_t K = numberOfJobs;
+    Int_t M = measuredElements.size();
+
+    subsetElements.assign(numberOfSubsets, std::vector<Int_t>());
+    for (Int_t m = 0; m < M; ++m){
+        Int_t pair = measuredElements[m] / systemMatrixData->numberOfBins;
+        subsetElements[pair % numberOfSubsets].push_back(m);
+    }
+
+    // only elements measured in job k contribute to its sensitivities (as in ReconstructionMLEM)
+    sensitivities.assign(size_t(numberOfSubsets) * numberOfVoxels * K, 0.0);
+    for (Int_t subset = 0; subset < numberOfSubsets; ++subset){
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            const Float_t* p_dcb = systemMatrixData->getP_dcb(v);
+            Double_t* s_v = &sensitivities[(size_t(subset) * numberOfVoxels + v) * K];
+
+            for (UInt_t j = 0; j < subsetElements[subset].size(); ++j){
+                Int_t m = subsetElements[subset][j];
+                Double_t p_dcbv = p_dcb[measuredElements[m]];
+                if (p_dcbv != 0){
+                    for (Int_t k = 0; k < K; ++k){
+                        if (N[m * K + k] > 0){
+                            s_v[k] += p_dcbv;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void BatchMLEM::addCounts(const Int_t job, const std::vector<UInt_t>& elements, const std::vector<Double_t>& counts){
+    // add newly measured counts to the elements of one job, e.g. while a measurement is running;
+    // only the affected elements, their projections and the sensitivities they contribute to are updated,
+    // the current images stay as they are (warm start)
+
+    Int_t K = numberOfJobs;
+    Int_t numberOfBins = systemMatrixData->numberOfBins;
+
+    std::vector<Int_t> newPositions;      // elements not measured in any job so far
+    std::vector<Int_t> newlyMeasured;     // elements not measured in this job so far
+    for (UInt_t i = 0; i < elements.size(); ++i){
+        if (counts[i] <= 0){
+            continue;  // counts only accumulate
+        }
+
+        Int_t m = positionOfElement[elements[i]];
+        if (m < 0){
+            m = measuredElements.size();
+            positionOfElement[elements[i]] = m;
+            measuredElements.push_back(elements[i]);
+
+            N.resize(N.size() + K, 0.0);
+            projections.resize(projections.size() + K, 0.0);
+            ratios.resize(ratios.size() + K, 0.0);
+
+            Int_t pair = elements[i] / numberOfBins;
+            subsetElements[pair % numberOfSubsets].push_back(m);
+            newPositions.push_back(m);
+        }
+
+        if (N[m * K + job] == 0){
+            newlyMeasured.push_back(m);
+        }
+        N[m * K + job] += counts[i];
+    }
+
+    if (newPositions.empty() && newlyMeasured.empty()){
+        return;
+    }
+
+    // voxels nobody saw so far were set to 0 by ML-EM, they restart from the mean activity
+    Double_t meanActivity = 0.0;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        meanActivity += A_v[size_t(v) * K + job] / numberOfVoxels;
+    }
+    if (meanActivity <= 0){
+        meanActivity = 1.0;
+    }
+
+    Bool_t isImageChanged = kFALSE;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_dcb = systemMatrixData->getP_dcb(v);
+
+        // sensitivities of the subsets the newly measured elements belong to
+        Double_t addedSensitivity = 0.0;
+        for (UInt_t j = 0; j < newlyMeasured.size(); ++j){
+            Int_t m = newlyMeasured[j];
+            Int_t subset = (measuredElements[m] / numberOfBins) % numberOfSubsets;
+            sensitivities[(size_t(subset) * numberOfVoxels + v) * K + job] += p_dcb[measuredElements[m]];
+            addedSensitivity += p_dcb[measuredElements[m]];
+        }
+
+        if ((addedSensitivity > 0) && (A_v[size_t(v) * K + job] == 0)){
+            A_v[size_t(v) * K + job] = meanActivity;
+            isImageChanged = kTRUE;
+        }
+
+        // projections of the current images onto the new elements
+        if (isProjectionValid){
+            const Double_t* activityInVoxel = &A_v[size_t(v) * K];
+            for (UInt_t j = 0; j < newPositions.size(); ++j){
+                Int_t m = newPositions[j];
+                Double_t p_dcbv = p_dcb[measuredElements[m]];
+                if (p_dcbv != 0){
+                    for (Int_t k = 0; k < K; ++k){
+                        projections[m * K + k] += p_dcbv * activityInVoxel[k];
+                    }
+                }
+            }
+        }
+    }
+
+    if (isImageChanged){
+        isProjectionValid = kFALSE;
+    }
+}
+
+void BatchMLEM::setCounts(const Int_t job, const std::vector<Double_t>& N_dcb){
+    // replace the counts of one job (e.g. by the next time frame) and keep its image
+
+    Int_t K = numberOfJobs;
+    for (UInt_t m = 0; m < measuredElements.size(); ++m){
+        N[m * K + job] = 0.0;
+    }
+    for (UInt_t i = job; i < sensitivities.size(); i += K){
+        sensitivities[i] = 0.0;
+    }
+
+    std::vector<UInt_t> elements;
+    std::vector<Double_t> counts;
+    for (UInt_t i = 0; i < N_dcb.size(); ++i){
+        if (N_dcb[i] > 0){
+            elements.push_back(i);
+            counts.push_back(N_dcb[i]);
+        }
+    }
+
+    addCounts(job, elements, counts);
+}
+
+void BatchMLEM::iterate(){
+    // one ML-EM iteration (one sub-iteration per subset) for all jobs
+
+    if (!isProjectionValid){
+        projection();
+    }
+
+    for (Int_t subset = 0; subset < numberOfSubsets; ++subset){
+        projectAndBackproject(subset);
+    }
+}
+
+void BatchMLEM::projection(){
+    // calculates the forward projections of all images
+
+    Int_t K = numberOfJobs;
+    Int_t M = measuredElements.size();
+
+    std::fill(projections.begin(), projections.end(), 0.0);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_dcb = systemMatrixData->getP_dcb(v);
+        const Double_t* activityInVoxel = &A_v[size_t(v) * K];
+
+        for (Int_t m = 0; m < M; ++m){
+            Double_t p_dcbv = p_dcb[measuredElements[m]];
+            if (p_dcbv != 0){
+                Double_t* projection = &projections[m * K];
+                for (Int_t k = 0; k < K; ++k){
+                    projection[k] += p_dcbv * activityInVoxel[k];
+                }
+            }
+        }
+    }
+
+    isProjectionValid = kTRUE;
+}
+
+void BatchMLEM::projectAndBackproject(const Int_t subset){
+    // backprojection of the current (sub-)iteration fused with the projection of the next one,
+    // so each row p_dcb of the system matrix is read once per (sub-)iteration
+
+    Int_t K = numberOfJobs;
+    const std::vector<Int_t>& elementsOfSubset = subsetElements[subset];
+
+    for (UInt_t j = 0; j < elementsOfSubset.size(); ++j){
+        for (Int_t i = elementsOfSubset[j] * K; i < (elementsOfSubset[j] + 1) * K; ++i){
+            ratios[i] = ((N[i] > 0) && (projections[i] > 0)) ? N[i] / projections[i] : 0.0;
+        }
+    }
+
+    std::fill(projections.begin(), projections.end(), 0.0);
+
+    Int_t M = measuredElements.size();
+    std::vector<Double_t> correctionFactors(K);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_dcb = systemMatrixData->getP_dcb(v);
+        Double_t* activityInVoxel = &A_v[size_t(v) * K];
+        const Double_t* s_v = &sensitivities[(size_t(subset) * numberOfVoxels + v) * K];
+
+        // backprojection
+        std::fill(correctionFactors.begin(), correctionFactors.end(), 0.0);
+        for (UInt_t j = 0; j < elementsOfSubset.size(); ++j){
+            Int_t m = elementsOfSubset[j];
+            Double_t p_dcbv = p_dcb[measuredElements[m]];
+            if (p_dcbv != 0){
+                const Double_t* ratio = &ratios[m * K];
+                for (Int_t k = 0; k < K; ++k){
+                    correctionFactors[k] += p_dcbv * ratio[k];
+                }
+            }
+        }
+
+        for (Int_t k = 0; k < K; ++k){
+            if (!isJobActive[k]){
+                continue;
+            }
+
+            // with subsets, voxels not seen by this subset keep their activity
+            Double_t correctionFactor = (s_v[k] > 0) ? correctionFactors[k] / s_v[k] : ((numberOfSubsets > 1) ? 1.0 : 0.0);
+            if (accelerators[k] != 1){
+                correctionFactor = std::pow(correctionFactor, accelerators[k]);
+            }
+
+            activityInVoxel[k] *= correctionFactor;
+        }
+
+        // projection of the updated voxel
+        for (Int_t m = 0; m < M; ++m){
+            Double_t p_dcbv = p_dcb[measuredElements[m]];
+            if (p_dcbv != 0){
+                Double_t* projection = &projections[m * K];
+                for (Int_t k = 0; k < K; ++k){
+                    projection[k] += p_dcbv * activityInVoxel[k];
+                }
+            }
+        }
+    }
+}
+
+std::vector<Double_t> BatchMLEM::calculateChiSquare() const{
+    // Calculate the Chi Square Statistics of the current images
+
+    Int_t K = numberOfJobs;
+    Int_t M = measuredElements.size();
+
+    std::vector<Double_t> ChiSquareTestVariable(K, 0.0);
+    for (Int_t m = 0; m < M; ++m){
+        for (Int_t k = 0; k < K; ++k){
+            Double_t projectionBinContent = projections[m * K + k];
+            Double_t N_dcbBinContent = N[m * K + k];
+
+            if ((projectionBinContent != 0) && (N_dcbBinContent != 0)){
+                ChiSquareTestVariable[k] += std::pow(N_dcbBinContent - projectionBinContent, 2) / projectionBinContent;
+            }
+        }
+    }
+
+    return ChiSquareTestVariable;
+}
+
+std::vector<Double_t> BatchMLEM::calculateLogLike() const{
+    // Calculate the Log-Likelihood-Function of the current images
+
+    Int_t K = numberOfJobs;
+    Int_t M = measuredElements.size();
+
+    std::vector<Double_t> LogLike(K, 0.0);
+    for (Int_t m = 0; m < M; ++m){
+        for (Int_t k = 0; k < K; ++k){
+            Double_t projectionBinContent = projections[m * K + k];
+            Double_t N_dcbBinContent = N[m * K + k];
+
+            if ((projectionBinContent != 0) && (N_dcbBinContent != 0)){
+                LogLike[k] += projectionBinContent - N_dcbBinContent * std::log(projectionBinContent);
+            }
+        }
+    }
+
+    return LogLike;
+}
+
+void BatchMLEM::getImage(const Int_t job, std::vector<Double_t>& image) const{
+    // copy the image of one job
+
+    image.resize(numberOfVoxels);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        image[v] = A_v[size_t(v) * numberOfJobs + job];
+    }
+}
+
+void BatchMLEM::setImage(const Int_t job, const std::vector<Double_t>& image){
+    // replace the image of one job, e.g. for a warm start
+
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        A_v[size_t(v) * numberOfJobs + job] = image[v];
+    }
+
+    isProjectionValid = kFALSE;
+}
+
+// ##### BATCHED RECONSTRUCTION #####
+ReconstructionBatchMLEM::ReconstructionBatchMLEM(const std::vector<TString> pathsToMeasurements,
+                                                 const TString pathToProjections,
+                                                 const std::vector<Double_t> volume,
+                                                 const Selection& selection,
+                                                 const RegionOfInterest& regionOfInterest) :
+    isCalculationValid(kTRUE),
+    accelerator(1),
+    pathsToMeasurements(pathsToMeasurements){
+    // prepare data for the batched reconstruction using ML-EM
+
+    TBenchmark b;
+
+    // prepare the measurement data
+    b.Start("N_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+    Int_t numberOfDetectors = 0;
+    std::vector<std::vector<Double_t> > N_dcbOfJobs;
+    for (UInt_t k = 0; k < pathsToMeasurements.size(); ++k){
+        Measurements measurementData(pathsToMeasurements[k], selection);
+        measurementData.createN_dcb();
+        measurementData.fillN_dcb(kFALSE);
+
+        if (k == 0){
+            numberOfDetectors = measurementData.numberOfDetectors;
+        }
+
+        if (measurementData.numberOfDetectors != numberOfDetectors){
+            std::cout << "Number of detectors is not consistent: " << pathsToMeasurements[k] << "\n";
+            isCalculationValid = kFALSE;
+        }
+
+        isCalculationValid = isCalculationValid
+                             && Utilities::checkForSameNumberOfBins(measurementData.numberOfBins,
+                                                                    systemMatrixData->numberOfBins);
+
+        N_dcbOfJobs.push_back(measurementData.getN_dcbArray());
+    }
+    b.Stop("N_dcb");
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    isCalculationValid = isCalculationValid && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(numberOfDetectors);
+        batch = new BatchMLEM(systemMatrixData, N_dcbOfJobs);
+    }
+    b.Stop("p_dcb");
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionBatchMLEM::~ReconstructionBatchMLEM(){
+    delete batch;
+    delete image;
+    delete systemMatrixData;
+}
+
+void ReconstructionBatchMLEM::start(const Int_t maxNumberOfIterations){
+    // execute the calculation for all measurements at once
+
+    if (!isCalculationValid){
+        return;
+    }
+
+    TBenchmark b;
+
+    batch->setAccelerator(accelerator);
+    logLikeOfJobs.assign(batch->numberOfJobs, std::vector<Double_t>());
+
+    b.Start("stats");
+    for (Int_t n = 0; n < maxNumberOfIterations; ++n){
+        batch->iterate();
+
+        std::vector<Double_t> logLike = batch->calculateLogLike();
+        for (Int_t k = 0; k < batch->numberOfJobs; ++k){
+            logLikeOfJobs[k].push_back(logLike[k]);
+        }
+    }
+    b.Stop("stats");
+
+    // Inform user
+    std::cout << "\nImage reconstruction done. Steps: " << maxNumberOfIterations
+              << ", Measurements: " << batch->numberOfJobs << "\n";
+    std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
+
+    std::vector<Double_t> chiSquare = batch->calculateChiSquare();
+    for (Int_t k = 0; k < batch->numberOfJobs; ++k){
+        std::cout << k << "\t" << pathsToMeasurements[k]
+                  << "\t-log L = " << (logLikeOfJobs[k].empty() ? 0.0 : logLikeOfJobs[k].back())
+                  << "\tchi^2 = " << chiSquare[k] << "\n";
+    }
+
+    saveResults("MLEM_Batch.root");
+}
+
+void ReconstructionBatchMLEM::saveResults(const TString pathToResults){
+    // write the normalized image and the log-likelihood of every job
+
+    TFile* file = new TFile(pathToResults, "RECREATE");
+    file->cd();
+
+    std::vector<Double_t> activities;
+    for (Int_t k = 0; k < batch->numberOfJobs; ++k){
+        batch->getImage(k, activities);
+
+        image->A_v->Reset();
+        for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+            std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+            image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], activities[v]);
+        }
+
+        if (image->A_v->Integral() > 0){
+            image->A_v->Scale(1.0 / image->A_v->Integral());
+        }
+
+        TString name;
+        name.Form("A_v_%i", k);
+        image->A_v->SetTitle(pathsToMeasurements[k]);
+        image->A_v->Write(name);
+
+        Int_t n = logLikeOfJobs[k].size();
+        if (n != 0){
+            std::vector<Double_t> iterations;
+            for (Int_t i = 0; i < n; ++i){
+                iterations.push_back(i + 1);
+            }
+
+            TGraph logLike(n, &iterations[0], &logLikeOfJobs[k][0]);
+            name.Form("logLike_%i", k);
+            logLike.Write(name);
+        }
+    }
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nImages written to " << pathToResults << "\n";
+}
@@ -0,0 +1,92 @@
+// batchmlem.h
+// ML-EM for K measurements at once, sharing one loaded system matrix
+//
+// Projection and backprojection are matrix-matrix products with a K-wide right-hand side,
+// so every system matrix element is read once per iteration for all K images.
+
+#pragma once
+#include <vector>
+#include <TH3.h>
+#include <TBenchmark.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+// ##### BATCHED ML-EM KERNEL #####
+class BatchMLEM{
+public:
+    BatchMLEM(const SystemMatrix* systemMatrixData,
+              const std::vector<std::vector<Double_t> >& N_dcbOfJobs);
+    ~BatchMLEM(){}
+
+    void iterate();
+    void setAccelerator(const Double_t a){accelerators.assign(numberOfJobs, a);}
+    void setAccelerator(const Int_t job, const Double_t a){accelerators[job] = a;}
+    void setActive(const Int_t job, const Bool_t a){isJobActive[job] = a;}
+    void setNumberOfSubsets(const Int_t numberOfSubsets);
+    void addCounts(const Int_t job, const std::vector<UInt_t>& elements, const std::vector<Double_t>& counts);
+    void setCounts(const Int_t job, const std::vector<Double_t>& N_dcb);
+
+    std::vector<Double_t> calculateChiSquare() const;
+    std::vector<Double_t> calculateLogLike() const;
+
+    void getImage(const Int_t job, std::vector<Double_t>& image) const;
+    void setImage(const Int_t job, const std::vector<Double_t>& image);
+
+    Int_t numberOfJobs;
+    Int_t numberOfVoxels;
+    Int_t numberOfSubsets;
+
+private:
+    void projection();
+    void projectAndBackproject(const Int_t subset);
+
+    std::vector<Double_t> accelerators;    // exponent of the correction factor of each job
+    std::vector<Bool_t> isJobActive;       // images of inactive jobs are not updated anymore
+    Bool_t isProjectionValid;              // projections belong to the current images
+
+    const SystemMatrix* systemMatrixData;
+
+    // measurement elements with counts in at least one job
+    std::vector<UInt_t> measuredElements;
+    std::vector<Int_t> positionOfElement;  // position in measuredElements, -1 = not measured
+
+    // ordered subsets: positions in measuredElements, grouped by detector pair (d, c)
+    std::vector<std::vector<Int_t> > subsetElements;
+
+    // element/voxel after element/voxel, K jobs each
+    std::vector<Double_t> N;               // measured counts, compacted to measuredElements
+    std::vector<Double_t> projections;     // forward projection of the current images
+    std::vector<Double_t> ratios;          // N / projection
+    std::vector<Double_t> A_v;             // images
+    std::vector<Double_t> sensitivities;   // sum of p_dcbv over the elements of a subset measured in a job
+};
+
+// ##### BATCHED RECONSTRUCTION #####
+class ReconstructionBatchMLEM{
+public:
+    ReconstructionBatchMLEM(const std::vector<TString> pathsToMeasurements,
+                            const TString pathToProjections,
+                            const std::vector<Double_t> volume,
+                            const Selection& selection = Selection(),
+                            const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionBatchMLEM();
+
+    void start(const Int_t maxNumberOfIterations);
+    void setAccelerator(const Double_t a){accelerator = a;}
+
+private:
+    void saveResults(const TString pathToResults);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Double_t accelerator;
+
+    std::vector<TString> pathsToMeasurements;
+    std::vector<std::vector<Double_t> > logLikeOfJobs;
+
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+    BatchMLEM* batch = nullptr;
+};
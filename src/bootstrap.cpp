@@ -0,0 +1,314 @@
+// bootstrap.cpp
+
+#include "bootstrap.h"
+#include <random>
+#include <algorithm>
+#include <TFile.h>
+#include <TBenchmark.h>
+
+#include "batchmlem.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+// ##### STREAMING QUANTILE #####
+P2Quantile::P2Quantile(const Double_t p) : p(p), count(0){
+    // prepare the desired marker positions for the quantile p
+
+    n = {{ 0, 1, 2, 3, 4 }};
+    np = {{ 0, 2 * p, 4 * p, 2 + 2 * p, 4 }};
+    dn = {{ 0, p / 2, p, (1 + p) / 2, 1 }};
+}
+
+void P2Quantile::add(const Double_t x){
+    // update the markers with a new observation
+
+    if (count < 5){
+        // the first five observations are the initial markers
+        q[count] = x;
+        ++count;
+
+        if (count == 5){
+            std::sort(q.begin(), q.end());
+        }
+
+        return;
+    }
+    ++count;
+
+    // find the cell k of the observation, adjust the extreme markers
+    Int_t k;
+    if (x < q[0]){
+        q[0] = x;
+        k = 0;
+    } else if (x < q[1]){
+        k = 0;
+    } else if (x < q[2]){
+        k = 1;
+    } else if (x < q[3]){
+        k = 2;
+    } else if (x <= q[4]){
+        k = 3;
+    } else{
+        q[4] = x;
+        k = 3;
+    }
+
+    for (Int_t i = k + 1; i < 5; ++i){
+        n[i] += 1;
+    }
+    for (Int_t i = 0; i < 5; ++i){
+        np[i] += dn[i];
+    }
+
+    // move the middle markers towards their desired positions
+    for (Int_t i = 1; i < 4; ++i){
+        Double_t d = np[i] - n[i];
+
+        if (((d >= 1) && (n[i + 1] - n[i] > 1)) || ((d <= -1) && (n[i - 1] - n[i] < -1))){
+            Int_t sign = (d > 0) ? 1 : -1;
+
+            Double_t candidate = parabolic(i, sign);
+            if ((q[i - 1] < candidate) && (candidate < q[i + 1])){
+                q[i] = candidate;
+            } else{
+                q[i] = linear(i, sign);
+            }
+
+            n[i] += sign;
+        }
+    }
+}
+
+Double_t P2Quantile::get() const{
+    // current estimate of the quantile
+
+    if (count == 0){
+        return 0.0;
+    }
+
+    if (count < 5){
+        // exact quantile of the few observations
+        std::vector<Double_t> values(q.begin(), q.begin() + count);
+        std::sort(values.begin(), values.end());
+        return values[Int_t(p * (count - 1) + 0.5)];
+    }
+
+    return q[2];
+}
+
+Double_t P2Quantile::parabolic(const Int_t i, const Double_t d) const{
+    // piecewise-parabolic prediction of the marker height
+
+    return q[i] + d / (n[i + 1] - n[i - 1])
+                  * ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i])
+                     + (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+Double_t P2Quantile::linear(const Int_t i, const Int_t d) const{
+    // linear prediction of the marker height
+
+    return q[i] + d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+}
+
+// ##### VOXEL STATISTICS #####
+VoxelStatistics::VoxelStatistics(const Int_t numberOfVoxels, const std::vector<Double_t> percentiles) :
+    percentiles(percentiles),
+    numberOfImages(0),
+    mean(numberOfVoxels, 0.0),
+    M2(numberOfVoxels, 0.0){
+    // one set of accumulators per voxel
+
+    std::vector<P2Quantile> quantilesOfVoxel;
+    for (UInt_t i = 0; i < percentiles.size(); ++i){
+        quantilesOfVoxel.push_back(P2Quantile(percentiles[i] / 100.0));
+    }
+    quantiles.assign(numberOfVoxels, quantilesOfVoxel);
+}
+
+void VoxelStatistics::add(const UInt_t index, const std::vector<Double_t>& image){
+    // stream one image into the accumulators, may be called from several threads
+    // images arriving early wait for the lower indices, so the P-square markers see the same order every run
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    pendingImages[index] = image;
+    while (!pendingImages.empty() && (pendingImages.begin()->first == numberOfImages)){
+        accumulate(pendingImages.begin()->second);
+        pendingImages.erase(pendingImages.begin());
+    }
+}
+
+void VoxelStatistics::accumulate(const std::vector<Double_t>& image){
+    ++numberOfImages;
+    for (UInt_t v = 0; v < mean.size(); ++v){
+        Double_t delta = image[v] - mean[v];
+        mean[v] += delta / numberOfImages;
+        M2[v] += delta * (image[v] - mean[v]);
+
+        for (UInt_t i = 0; i < quantiles[v].size(); ++i){
+            quantiles[v][i].add(image[v]);
+        }
+    }
+}
+
+// ##### BOOTSTRAP RECONSTRUCTION #####
+ReconstructionBootstrapMLEM::ReconstructionBootstrapMLEM(const TString pathToMeasurements,
+                                                         const TString pathToProjections,
+                                                         const std::vector<Double_t> volume,
+                                                         const Selection& selection,
+                                                         const RegionOfInterest& regionOfInterest) :
+    accelerator(1){
+    // prepare data for the bootstrap using ML-EM
+
+    TBenchmark b;
+
+    // prepare the measurement data
+    b.Start("N_dcb");
+    Measurements* measurementData = new Measurements(pathToMeasurements, selection);
+    measurementData->createN_dcb();
+    measurementData->fillN_dcb(kFALSE);
+    N_dcb = measurementData->getN_dcbArray();
+    b.Stop("N_dcb");
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+    isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
+                                                             systemMatrixData->numberOfBins)
+                         && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(measurementData->numberOfDetectors);
+    }
+    b.Stop("p_dcb");
+    delete measurementData;
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionBootstrapMLEM::~ReconstructionBootstrapMLEM(){
+    delete statistics;
+    delete image;
+    delete systemMatrixData;
+}
+
+void ReconstructionBootstrapMLEM::start(const Int_t numberOfReplicas, const Int_t maxNumberOfIterations){
+    // reconstruct the replicas in parallel, one batch per thread
+
+    if (!isCalculationValid || (numberOfReplicas <= 0)){
+        return;
+    }
+
+    TBenchmark b;
+
+    delete statistics;
+    statistics = new VoxelStatistics(image->numberOfVoxels, { 5, 16, 50, 84, 95 });
+
+    // generate random seed
+    std::random_device randomDevice;
+    ULong64_t seed = ULong64_t(randomDevice()) << 32 | ULong64_t(randomDevice());
+
+    b.Start("stats");
+    {
+        ThreadPool pool;
+
+        Int_t numberOfBatches = std::min<Int_t>(numberOfReplicas, pool.getNumberOfThreads());
+        Int_t firstReplica = 0;
+        for (Int_t t = 0; t < numberOfBatches; ++t){
+            Int_t replicasInBatch = numberOfReplicas / numberOfBatches + ((t < numberOfReplicas % numberOfBatches) ? 1 : 0);
+
+            pool.enqueue(std::bind(&ReconstructionBootstrapMLEM::reconstructReplicas, this,
+                                   firstReplica, replicasInBatch, maxNumberOfIterations, seed));
+            firstReplica += replicasInBatch;
+        }
+
+        pool.wait();
+    }
+    b.Stop("stats");
+
+    // Inform user
+    std::cout << "\nBootstrap done. Replicas: " << statistics->getNumberOfImages()
+              << ", Steps: " << maxNumberOfIterations << "\n";
+    std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
+
+    saveResults("MLEM_Bootstrap.root");
+}
+
+void ReconstructionBootstrapMLEM::reconstructReplicas(const Int_t firstReplica, const Int_t numberOfReplicas,
+                                                      const Int_t maxNumberOfIterations, const ULong64_t seed){
+    // (WORKER THREAD) resample N_dcb and reconstruct the replicas as one batch
+
+    std::vector<std::vector<Double_t> > N_dcbOfReplicas;
+    for (Int_t r = firstReplica; r < firstReplica + numberOfReplicas; ++r){
+        // every replica has its own random stream, independent of the number of threads
+        std::seed_seq seedSequence = { UInt_t(seed), UInt_t(seed >> 32), UInt_t(r) };
+        std::mt19937_64 generate(seedSequence);
+
+        std::vector<Double_t> N(N_dcb.size(), 0.0);
+        for (UInt_t i = 0; i < N_dcb.size(); ++i){
+            if (N_dcb[i] > 0){
+                std::poisson_distribution<Int_t> poisson(N_dcb[i]);
+                N[i] = poisson(generate);
+            }
+        }
+
+        N_dcbOfReplicas.push_back(N);
+    }
+
+    BatchMLEM batch(systemMatrixData, N_dcbOfReplicas);
+    batch.setAccelerator(accelerator);
+    for (Int_t n = 0; n < maxNumberOfIterations; ++n){
+        batch.iterate();
+    }
+
+    std::vector<Double_t> activities;
+    for (Int_t k = 0; k < batch.numberOfJobs; ++k){
+        batch.getImage(k, activities);
+        statistics->add(firstReplica + k, activities);
+    }
+}
+
+void ReconstructionBootstrapMLEM::saveResults(const TString pathToResults){
+    // write mean, standard deviation and percentiles of the activity in each voxel
+
+    TFile* file = new TFile(pathToResults, "RECREATE");
+    file->cd();
+
+    std::vector<TString> names = { "A_v_mean", "A_v_std" };
+    for (UInt_t i = 0; i < statistics->percentiles.size(); ++i){
+        TString name;
+        name.Form("A_v_p%02i", Int_t(statistics->percentiles[i]));
+        names.push_back(name);
+    }
+
+    for (UInt_t h = 0; h < names.size(); ++h){
+        image->A_v->Reset();
+        for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+            Double_t value;
+            if (h == 0){
+                value = statistics->getMean(v);
+            } else if (h == 1){
+                value = std::sqrt(statistics->getVariance(v));
+            } else{
+                value = statistics->getPercentile(v, h - 2);
+            }
+
+            std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+            image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], value);
+        }
+
+        image->A_v->Write(names[h]);
+    }
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nVoxel statistics written to " << pathToResults << "\n";
+}
@@ -0,0 +1,94 @@
+// bootstrap.h
+// voxel-wise uncertainty of ML-EM images from Poisson-resampled measurements
+//
+// B copies of N_dcb are drawn from Poisson distributions with the measured counts as means.
+// They are reconstructed in batches (see batchmlem.h) on a thread pool with the shared system matrix,
+// and each finished image is streamed into per-voxel accumulators in the order of the replicas, since the
+// percentile estimates depend on the order (the same seed gives the same result with any number of threads).
+
+#pragma once
+#include <array>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <TH3.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+// ##### STREAMING QUANTILE #####
+// P-square algorithm (Jain & Chlamtac, 1985): estimates a quantile with five markers, without storing the values
+class P2Quantile{
+public:
+    P2Quantile(const Double_t p = 0.5);
+
+    void add(const Double_t x);
+    Double_t get() const;
+
+private:
+    Double_t parabolic(const Int_t i, const Double_t d) const;
+    Double_t linear(const Int_t i, const Int_t d) const;
+
+    Double_t p;
+    UInt_t count;
+    std::array<Double_t, 5> q;     // marker heights
+    std::array<Double_t, 5> n;     // marker positions
+    std::array<Double_t, 5> np;    // desired marker positions
+    std::array<Double_t, 5> dn;    // increments of the desired positions
+};
+
+// ##### VOXEL STATISTICS #####
+class VoxelStatistics{
+public:
+    VoxelStatistics(const Int_t numberOfVoxels, const std::vector<Double_t> percentiles);
+
+    void add(const UInt_t index, const std::vector<Double_t>& image);  // images are accumulated in the order of the index
+
+    Double_t getMean(const Int_t v) const { return mean[v]; }
+    Double_t getVariance(const Int_t v) const { return (numberOfImages > 1) ? M2[v] / (numberOfImages - 1) : 0.0; }
+    Double_t getPercentile(const Int_t v, const Int_t i) const { return quantiles[v][i].get(); }
+    UInt_t getNumberOfImages() const { return numberOfImages; }
+
+    std::vector<Double_t> percentiles;
+
+private:
+    void accumulate(const std::vector<Double_t>& image);
+
+    UInt_t numberOfImages;          // also the index of the next image to accumulate
+    std::map<UInt_t, std::vector<Double_t> > pendingImages;  // finished before an image of a lower index
+    std::vector<Double_t> mean;     // Welford's algorithm
+    std::vector<Double_t> M2;
+    std::vector<std::vector<P2Quantile> > quantiles;
+
+    std::mutex mutex;
+};
+
+// ##### BOOTSTRAP RECONSTRUCTION #####
+class ReconstructionBootstrapMLEM{
+public:
+    ReconstructionBootstrapMLEM(const TString pathToMeasurements,
+                                const TString pathToProjections,
+                                const std::vector<Double_t> volume,
+                                const Selection& selection = Selection(),
+                                const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionBootstrapMLEM();
+
+    void start(const Int_t numberOfReplicas, const Int_t maxNumberOfIterations);
+    void setAccelerator(const Double_t a){accelerator = a;}
+
+private:
+    void reconstructReplicas(const Int_t firstReplica, const Int_t numberOfReplicas,
+                             const Int_t maxNumberOfIterations, const ULong64_t seed);
+    void saveResults(const TString pathToResults);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Double_t accelerator;
+
+    std::vector<Double_t> N_dcb;
+
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+    VoxelStatistics* statistics = nullptr;
+};
@@ -0,0 +1,256 @@
+// coincidence.cpp
+
+#include "coincidence.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <TBenchmark.h>
+
+#include "listmode.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+// ##### COINCIDENCE SORTER #####
+CoincidenceSorter::CoincidenceSorter(const TString pathToHits) :
+    numberOfDetectors(0),
+    numberOfHits(0),
+    numberOfDroppedHits(0),
+    numberOfPairs(0),
+    numberOfRejectedClusters(0),
+    coincidenceWindow(0),
+    hitThreshold(0),
+    minimumSumEnergy(0),
+    maximumSumEnergy(0),
+    numberOfBins(0),
+    minimumEnergy(0),
+    maximumEnergy(0),
+    nextEntry(0),
+    timeOfLastHit(0),
+    die(0),
+    energy(0),
+    time(0),
+    detectorD(0),
+    detectorC(0),
+    energyOfPair(0),
+    timeOfPair(0){
+    // open the *.root file of the raw hits
+
+    hitsFile = new TFile(pathToHits, "READ");
+    hits = hitsFile->IsOpen() ? (TTree*)hitsFile->Get("hits") : nullptr;
+    if (!hits){
+        std::cout << "No hits found in " << pathToHits << "\n";
+        return;
+    }
+
+    hits->SetBranchAddress("die", &die);
+    hits->SetBranchAddress("energy", &energy);
+    hits->SetBranchAddress("time", &time);
+
+    numberOfDetectors = Int_t(hits->GetMaximum("die")) + 1;
+}
+
+CoincidenceSorter::~CoincidenceSorter(){
+    delete hits;
+    delete hitsFile;
+}
+
+void CoincidenceSorter::setEnergyThresholds(const Double_t hit, const Double_t minimumSum, const Double_t maximumSum){
+    // thresholds of the single hits and range of the sum energy of a pair
+
+    hitThreshold = hit;
+    minimumSumEnergy = minimumSum;
+    maximumSumEnergy = maximumSum;
+}
+
+void CoincidenceSorter::setEnergyAxis(const Int_t nBins, const Double_t minimumEnergy, const Double_t maximumEnergy){
+    // binning of the sum energy, same as in the spectra of the system matrix
+
+    numberOfBins = nBins;
+    this->minimumEnergy = minimumEnergy;
+    this->maximumEnergy = maximumEnergy;
+}
+
+void CoincidenceSorter::start(){
+    // sort all hits, blocks are read while the previous ones are sorted
+
+    if (!hits){
+        return;
+    }
+
+    TBenchmark b;
+    b.Start("sort");
+
+    numberOfHits = 0;
+    numberOfDroppedHits = 0;
+    numberOfPairs = 0;
+    numberOfRejectedClusters = 0;
+    nextEntry = 0;
+    timeOfLastHit = -std::numeric_limits<Double_t>::max();
+    N_dcb.assign((numberOfBins > 0) ? numberOfDetectors * numberOfDetectors * numberOfBins : 0, 0.0);
+
+    if (pathToListMode.Length() != 0){
+        listModeFile = new TFile(pathToListMode, "RECREATE");
+        events = new TTree("events", "list-mode events");
+        events->Branch("d", &detectorD, "d/I");
+        events->Branch("c", &detectorC, "c/I");
+        events->Branch("energy", &energyOfPair, "energy/D");
+        events->Branch("time", &timeOfPair, "time/D");
+    }
+
+    {
+        ThreadPool pool;
+
+        std::vector<Hit> carry;
+        Bool_t isHitLeft = kTRUE;
+        while (isHitLeft){
+            std::vector<Block> blocks(pool.getNumberOfThreads());
+
+            UInt_t numberOfBlocks = 0;
+            while ((numberOfBlocks < blocks.size()) && (isHitLeft = readBlock(carry, blocks[numberOfBlocks]))){
+                pool.enqueue(std::bind(&CoincidenceSorter::sortBlock, this, &blocks[numberOfBlocks]));
+                ++numberOfBlocks;
+            }
+
+            pool.wait();
+
+            // in time order
+            for (UInt_t i = 0; i < numberOfBlocks; ++i){
+                emit(blocks[i]);
+            }
+        }
+    }
+
+    if (listModeFile){
+        listModeFile->cd();
+        events->Write();
+        listModeFile->Close();
+        delete listModeFile;
+        listModeFile = nullptr;
+        events = nullptr;
+    }
+    b.Stop("sort");
+
+    // Inform user
+    std::cout << "\nCoincidence sorting done. Hits: " << numberOfHits << ", dropped: " << numberOfDroppedHits
+              << ", Pairs: " << numberOfPairs << ", rejected clusters: " << numberOfRejectedClusters << "\n";
+    std::cout << "\nSorting Time:\t\t" << b.GetRealTime("sort") << " seconds\n";
+    if (pathToListMode.Length() != 0){
+        std::cout << "\nPairs written to " << pathToListMode << "\n";
+    }
+}
+
+Bool_t CoincidenceSorter::readBlock(std::vector<Hit>& carry, Block& block){
+    // read the next block of hits, ending between two clusters; returns kFALSE if no hits are left
+
+    block.hits.swap(carry);
+    carry.clear();
+    block.pairs.clear();
+    block.numberOfRejectedClusters = 0;
+
+    Long64_t numberOfEntries = hits->GetEntries();
+    Long64_t lastEntry = std::min(nextEntry + listModeChunkSize, numberOfEntries);
+    for (; nextEntry < lastEntry; ++nextEntry){
+        hits->GetEntry(nextEntry);
+        ++numberOfHits;
+
+        // the stream cannot be sorted afterwards, hits out of order are lost
+        if ((energy < hitThreshold) || (die < 0) || (time < timeOfLastHit)){
+            ++numberOfDroppedHits;
+            continue;
+        }
+        timeOfLastHit = time;
+
+        Hit hit = { die, energy, time };
+        block.hits.push_back(hit);
+    }
+
+    // the last cluster may continue in the next block
+    if ((nextEntry < numberOfEntries) && !block.hits.empty()){
+        UInt_t firstHitOfLastCluster = block.hits.size() - 1;
+        while ((firstHitOfLastCluster > 0)
+               && (block.hits[firstHitOfLastCluster].time - block.hits[firstHitOfLastCluster - 1].time <= coincidenceWindow)){
+            --firstHitOfLastCluster;
+        }
+
+        carry.assign(block.hits.begin() + firstHitOfLastCluster, block.hits.end());
+        block.hits.resize(firstHitOfLastCluster);
+    }
+
+    return !block.hits.empty() || !carry.empty() || (nextEntry < numberOfEntries);
+}
+
+void CoincidenceSorter::sortBlock(Block* block) const{
+    // (WORKER THREAD) find the pairs in a block of hits
+
+    const std::vector<Hit>& hitsOfBlock = block->hits;
+
+    UInt_t firstHit = 0;
+    while (firstHit < hitsOfBlock.size()){
+        UInt_t endOfCluster = firstHit + 1;
+        while ((endOfCluster < hitsOfBlock.size())
+               && (hitsOfBlock[endOfCluster].time - hitsOfBlock[endOfCluster - 1].time <= coincidenceWindow)){
+            ++endOfCluster;
+        }
+
+        Bool_t isPair = (endOfCluster - firstHit == 2) && (hitsOfBlock[firstHit].die != hitsOfBlock[firstHit + 1].die);
+        Double_t sumEnergy = isPair ? hitsOfBlock[firstHit].energy + hitsOfBlock[firstHit + 1].energy : 0.0;
+        if (isPair && (sumEnergy >= minimumSumEnergy)
+            && ((maximumSumEnergy <= minimumSumEnergy) || (sumEnergy < maximumSumEnergy))){
+
+            Pair pair = { hitsOfBlock[firstHit].die, hitsOfBlock[firstHit + 1].die, sumEnergy, hitsOfBlock[firstHit].time };
+            block->pairs.push_back(pair);
+        } else{
+            ++block->numberOfRejectedClusters;
+        }
+
+        firstHit = endOfCluster;
+    }
+}
+
+void CoincidenceSorter::emit(const Block& block){
+    // write the pairs of a block and bin them
+
+    numberOfPairs += block.pairs.size();
+    numberOfRejectedClusters += block.numberOfRejectedClusters;
+
+    if (events){
+        for (UInt_t i = 0; i < block.pairs.size(); ++i){
+            detectorD = block.pairs[i].d;
+            detectorC = block.pairs[i].c;
+            energyOfPair = block.pairs[i].energy;
+            timeOfPair = block.pairs[i].time;
+            events->Fill();
+        }
+    }
+
+    if (numberOfBins == 0){
+        return;
+    }
+
+    Double_t binWidth = (maximumEnergy - minimumEnergy) / numberOfBins;
+    std::vector<UInt_t> elementsOfPairs;
+    for (UInt_t i = 0; i < block.pairs.size(); ++i){
+        Int_t b = Int_t(std::floor((block.pairs[i].energy - minimumEnergy) / binWidth));
+        if ((b >= 0) && (b < numberOfBins) && selection.isPairSelected(block.pairs[i].d, block.pairs[i].c)){
+            elementsOfPairs.push_back(Utilities::getElementIndex(block.pairs[i].d, block.pairs[i].c, b,
+                                                                 numberOfDetectors, numberOfBins));
+        }
+    }
+
+    // pairs of the same element are counted together
+    std::sort(elementsOfPairs.begin(), elementsOfPairs.end());
+    std::vector<UInt_t> elements;
+    std::vector<Double_t> counts;
+    for (UInt_t i = 0; i < elementsOfPairs.size(); ++i){
+        if (elements.empty() || (elements.back() != elementsOfPairs[i])){
+            elements.push_back(elementsOfPairs[i]);
+            counts.push_back(0);
+        }
+        counts.back() += 1;
+        N_dcb[elementsOfPairs[i]] += 1;
+    }
+
+    if (receiver && !elements.empty()){
+        receiver(elements, counts);
+    }
+}
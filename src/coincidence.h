@@ -0,0 +1,101 @@
+// coincidence.h
+// coincidence sorting of raw single-die hits into pairs (d, c)
+//
+// The hits are stored time-sorted in a TTree "hits" with the branches
+//   die     (Int_t)     index of the die, starting at 0
+//   energy  (Double_t)  deposited energy, in the units of the spectra
+//   time    (Double_t)  in s
+// Hits below the hit threshold are dropped. Hits closer than the coincidence window to their predecessor
+// form one cluster; clusters of exactly two hits on different dies are pairs, d being the earlier hit and
+// the energy the sum of both. The stream is read in blocks cut between clusters, so the blocks are sorted
+// in parallel on a thread pool. Pairs are written as list-mode events (see listmode.h) and/or binned
+// into measurement elements and handed to a receiver, e.g. ReconstructionOnlineMLEM::addCounts.
+
+#pragma once
+#include <vector>
+#include <functional>
+#include <TFile.h>
+#include <TTree.h>
+
+#include "selection.h"
+
+// ##### COINCIDENCE SORTER #####
+class CoincidenceSorter{
+public:
+    CoincidenceSorter(const TString pathToHits);
+    ~CoincidenceSorter();
+
+    void setCoincidenceWindow(const Double_t seconds){coincidenceWindow = seconds;}
+    void setEnergyThresholds(const Double_t hit, const Double_t minimumSum, const Double_t maximumSum);
+    void setEnergyAxis(const Int_t nBins, const Double_t minimumEnergy, const Double_t maximumEnergy);
+    void setSelection(const Selection& s){selection = s;}  // pairs binned for the receiver, the list-mode output keeps all
+    void setListModeOutput(const TString path){pathToListMode = path;}
+    void setCountsReceiver(const std::function<void(const std::vector<UInt_t>&, const std::vector<Double_t>&)> r){receiver = r;}
+
+    void start();
+
+    Int_t numberOfDetectors;
+    std::vector<Double_t> N_dcb;       // binned pairs, see Utilities::getElementIndex, empty without energy axis
+
+    // statistics of the last run
+    Long64_t numberOfHits;
+    Long64_t numberOfDroppedHits;      // below the hit threshold or not in time order
+    Long64_t numberOfPairs;
+    Long64_t numberOfRejectedClusters; // single hits, more than two hits, same die or sum energy out of range
+
+private:
+    struct Hit{
+        Int_t die;
+        Double_t energy;
+        Double_t time;
+    };
+
+    struct Pair{
+        Int_t d;
+        Int_t c;
+        Double_t energy;
+        Double_t time;
+    };
+
+    struct Block{
+        std::vector<Hit> hits;
+        std::vector<Pair> pairs;
+        Long64_t numberOfRejectedClusters;
+    };
+
+    Bool_t readBlock(std::vector<Hit>& carry, Block& block);
+    void sortBlock(Block* block) const;
+    void emit(const Block& block);
+
+    // ##### MEMBERS #####
+    Double_t coincidenceWindow;        // in s
+    Double_t hitThreshold;
+    Double_t minimumSumEnergy;
+    Double_t maximumSumEnergy;         // <= minimumSumEnergy: no upper limit
+
+    Int_t numberOfBins;                // energy axis of the binned pairs, 0 = no binning
+    Double_t minimumEnergy;
+    Double_t maximumEnergy;
+    Selection selection;
+
+    TString pathToListMode;            // empty: no list-mode output
+    std::function<void(const std::vector<UInt_t>&, const std::vector<Double_t>&)> receiver;
+
+    TFile* hitsFile = nullptr;
+    TTree* hits = nullptr;
+    Long64_t nextEntry;
+    Double_t timeOfLastHit;
+
+    // branches
+    Int_t die;
+    Double_t energy;
+    Double_t time;
+
+    // list-mode output
+    TFile* listModeFile = nullptr;
+    TTree* events = nullptr;
+    Int_t detectorD;
+    Int_t detectorC;
+    Double_t energyOfPair;
+    Double_t timeOfPair;
+};
@@ -0,0 +1,359 @@
+// compactmatrix.cpp
+
+#include "compactmatrix.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+    UShort_t floatToHalf(const Float_t value){
+        // IEEE half precision, round to nearest even
+
+        UInt_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        UInt_t sign = (bits >> 16) & 0x8000;
+        Int_t exponent = Int_t((bits >> 23) & 0xFF) - 127 + 15;
+        UInt_t mantissa = bits & 0x7FFFFF;
+
+        if (exponent >= 31){
+            return UShort_t(sign | 0x7C00);
+        }
+
+        UInt_t shift = 13;
+        if (exponent <= 0){
+            // subnormal
+            if (exponent < -10){
+                return UShort_t(sign);
+            }
+            mantissa |= 0x800000;
+            shift = 14 - exponent;
+            exponent = 0;
+        }
+
+        UInt_t half = (UInt_t(exponent) << 10) | (mantissa >> shift);
+        UInt_t remainder = mantissa & ((1u << shift) - 1);
+        UInt_t halfway = 1u << (shift - 1);
+        if ((remainder > halfway) || ((remainder == halfway) && (half & 1))){
+            ++half;  // a carry into the exponent is still the right rounding
+        }
+
+        return UShort_t(sign | half);
+    }
+
+    Float_t halfToFloat(const UShort_t half){
+        UInt_t sign = UInt_t(half & 0x8000) << 16;
+        Int_t exponent = (half >> 10) & 0x1F;
+        UInt_t mantissa = half & 0x3FF;
+
+        UInt_t bits;
+        if (exponent == 31){
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        } else if (exponent == 0){
+            if (mantissa == 0){
+                bits = sign;
+            } else{
+                // subnormal, normalized for float32
+                exponent = 1;
+                while (!(mantissa & 0x400)){
+                    mantissa <<= 1;
+                    --exponent;
+                }
+                bits = sign | (UInt_t(exponent + 127 - 15) << 23) | ((mantissa & 0x3FF) << 13);
+            }
+        } else{
+            bits = sign | (UInt_t(exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+
+        Float_t value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    const std::vector<Float_t>& getHalfTable(){
+        // all 65536 half values, decoding is a lookup
+        // built once by the initializer, which C++11 runs thread-safely
+
+        static const std::vector<Float_t> table = [](){
+            std::vector<Float_t> values(65536);
+            for (UInt_t half = 0; half < 65536; ++half){
+                values[half] = halfToFloat(UShort_t(half));
+            }
+            return values;
+        }();
+
+        return table;
+    }
+
+    UShort_t floatToBfloat(const Float_t value){
+        // upper 16 bits of float32, round to nearest even
+
+        UInt_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits += 0x7FFF + ((bits >> 16) & 1);
+        return UShort_t(bits >> 16);
+    }
+
+    Float_t bfloatToFloat(const UShort_t bfloat){
+        UInt_t bits = UInt_t(bfloat) << 16;
+        Float_t value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+// ##### COMPACT SYSTEM MATRIX #####
+CompactSystemMatrix::CompactSystemMatrix() : precision(float32), scaling(perVoxel), storedPrecision(float32), storedScaling(perVoxel), numberOfVoxels(0), numberOfElements(0){
+}
+
+TString CompactSystemMatrix::getDescription() const{
+    const char* names[5] = { "float32", "float16", "bfloat16", "16-bit quantized", "8-bit quantized" };
+
+    TString description = names[storedPrecision];
+    if (storedPrecision != float32){
+        description += (storedScaling == perVoxel) ? ", scaled per voxel" : ", scaled per detector pair";
+    }
+
+    return description;
+}
+
+void CompactSystemMatrix::store(LargeFloatArray& p_vm, const std::vector<UInt_t>& elements, const Int_t numberOfBins){
+    // encode the rows in the chosen precision, float32 rows are taken over without a copy
+
+    if (precision == float32){
+        storedPrecision = precision;
+        storedScaling = scaling;
+        numberOfElements = elements.size();
+        numberOfVoxels = (numberOfElements > 0) ? p_vm.size() / numberOfElements : 0;
+        row.assign(numberOfElements, 0);
+
+        LargeFloatArray().swap(floats);
+        LargeShortArray().swap(shorts);
+        LargeByteArray().swap(bytes);
+        voxelScales.clear();
+        elementScales.clear();
+
+        floats.swap(p_vm);
+        return;
+    }
+
+    size_t numberOfSourceElements = elements.size();
+    Int_t numberOfSourceVoxels = (numberOfSourceElements > 0) ? p_vm.size() / numberOfSourceElements : 0;
+    encode([&](const Int_t v){ return &p_vm[size_t(v) * numberOfSourceElements]; }, numberOfSourceVoxels, elements, numberOfBins);
+
+    LargeFloatArray().swap(p_vm);
+}
+
+void CompactSystemMatrix::store(const CompactSystemMatrix& source, const std::vector<UInt_t>& elements, const Int_t numberOfBins){
+    // encode the rows of another matrix in the chosen precision, one decoded row at a time
+
+    encode([&](const Int_t v){ return source.getRow(v); }, source.getNumberOfVoxels(), elements, numberOfBins);
+}
+
+void CompactSystemMatrix::encode(const std::function<const Float_t*(const Int_t)> getSourceRow, const Int_t numberOfSourceVoxels,
+                                 const std::vector<UInt_t>& elements, const Int_t numberOfBins){
+    // the rows of the source are read twice: for the scales and for the codes
+
+    storedPrecision = precision;
+    storedScaling = scaling;
+    numberOfElements = elements.size();
+    numberOfVoxels = numberOfSourceVoxels;
+    row.assign(numberOfElements, 0);
+
+    LargeFloatArray().swap(floats);
+    LargeShortArray().swap(shorts);
+    LargeByteArray().swap(bytes);
+    voxelScales.clear();
+    elementScales.clear();
+
+    size_t numberOfValues = size_t(numberOfVoxels) * numberOfElements;
+    if (precision == float32){
+        floats.resize(numberOfValues);
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            const Float_t* p_m = getSourceRow(v);
+            std::copy(p_m, p_m + numberOfElements, &floats[size_t(v) * numberOfElements]);
+        }
+        return;
+    }
+
+    // the largest probability of the voxel (pair) is encoded as largestCode
+    Double_t largestCode = 1.0;
+    if (precision == quantized16){
+        largestCode = 65535;
+    } else if (precision == quantized8){
+        largestCode = 255;
+    }
+
+    if (scaling == perVoxel){
+        voxelScales.assign(numberOfVoxels, 0);
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            const Float_t* p_m = getSourceRow(v);
+            voxelScales[v] = (numberOfElements > 0) ? *std::max_element(p_m, p_m + numberOfElements) / largestCode : 0;
+        }
+    } else{
+        // indexed by the pair
+        UInt_t numberOfPairs = (numberOfElements > 0) ? *std::max_element(elements.begin(), elements.end()) / numberOfBins + 1 : 0;
+        std::vector<Float_t> largestOfPair(numberOfPairs, 0);
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            const Float_t* p_m = getSourceRow(v);
+            for (size_t m = 0; m < numberOfElements; ++m){
+                Float_t& largest = largestOfPair[elements[m] / numberOfBins];
+                largest = std::max(largest, p_m[m]);
+            }
+        }
+
+        elementScales.assign(numberOfElements, 0);
+        for (size_t m = 0; m < numberOfElements; ++m){
+            elementScales[m] = largestOfPair[elements[m] / numberOfBins] / largestCode;
+        }
+    }
+
+    if (precision == quantized8){
+        bytes.assign(numberOfValues, 0);
+    } else{
+        shorts.assign(numberOfValues, 0);
+    }
+
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_m = getSourceRow(v);
+        size_t offset = size_t(v) * numberOfElements;
+        for (size_t m = 0; m < numberOfElements; ++m){
+            Double_t scale = (scaling == perVoxel) ? voxelScales[v] : elementScales[m];
+            Double_t value = (scale > 0) ? p_m[m] / scale : 0.0;
+
+            switch (precision){
+                case float16:
+                    shorts[offset + m] = floatToHalf(Float_t(value));
+                    break;
+
+                case bfloat16:
+                    shorts[offset + m] = floatToBfloat(Float_t(value));
+                    break;
+
+                case quantized16:
+                    shorts[offset + m] = UShort_t(std::min(value + 0.5, largestCode));
+                    break;
+
+                case quantized8:
+                    bytes[offset + m] = UChar_t(std::min(value + 0.5, largestCode));
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void CompactSystemMatrix::decode(LargeFloatArray& p_vm) const{
+    // all rows in float32
+
+    p_vm.resize(size_t(numberOfVoxels) * numberOfElements);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_m = getRow(v);
+        std::copy(p_m, p_m + numberOfElements, &p_vm[size_t(v) * numberOfElements]);
+    }
+}
+
+void CompactSystemMatrix::release(LargeFloatArray& p_vm){
+    // hand all rows over in float32, the matrix is empty afterwards
+
+    if (storedPrecision == float32){
+        p_vm.swap(floats);
+        LargeFloatArray().swap(floats);
+    } else{
+        decode(p_vm);
+        LargeShortArray().swap(shorts);
+        LargeByteArray().swap(bytes);
+    }
+
+    voxelScales.clear();
+    elementScales.clear();
+    numberOfVoxels = 0;
+}
+
+std::vector<Double_t> CompactSystemMatrix::getSensitivities() const{
+    // the sensitivity of a voxel has to match its stored probabilities, otherwise the fixed point of ML-EM shifts
+
+    std::vector<Double_t> sensitivities(numberOfVoxels, 0.0);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_m = getRow(v);
+        for (size_t m = 0; m < numberOfElements; ++m){
+            sensitivities[v] += p_m[m];
+        }
+    }
+
+    return sensitivities;
+}
+
+const Float_t* CompactSystemMatrix::getRow(const Int_t v, std::vector<Float_t>& buffer) const{
+    // decode row v into the buffer, float32 rows are returned in place
+
+    size_t offset = size_t(v) * numberOfElements;
+    if (storedPrecision == float32){
+        return &floats[offset];
+    }
+
+    if (buffer.size() < numberOfElements){
+        buffer.resize(numberOfElements);
+    }
+
+    switch (storedPrecision){
+        case float16:{
+            const std::vector<Float_t>& halfTable = getHalfTable();
+            for (size_t m = 0; m < numberOfElements; ++m){
+                buffer[m] = halfTable[shorts[offset + m]];
+            }
+            break;
+        }
+
+        case bfloat16:
+            for (size_t m = 0; m < numberOfElements; ++m){
+                buffer[m] = bfloatToFloat(shorts[offset + m]);
+            }
+            break;
+
+        case quantized16:
+            for (size_t m = 0; m < numberOfElements; ++m){
+                buffer[m] = shorts[offset + m];
+            }
+            break;
+
+        case quantized8:
+            for (size_t m = 0; m < numberOfElements; ++m){
+                buffer[m] = bytes[offset + m];
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (storedScaling == perVoxel){
+        Float_t scale = voxelScales[v];
+        for (size_t m = 0; m < numberOfElements; ++m){
+            buffer[m] *= scale;
+        }
+    } else{
+        for (size_t m = 0; m < numberOfElements; ++m){
+            buffer[m] *= elementScales[m];
+        }
+    }
+
+    return buffer.data();
+}
+
+size_t CompactSystemMatrix::getNumberOfBytes() const{
+    return floats.size() * sizeof(Float_t) + shorts.size() * sizeof(UShort_t) + bytes.size() * sizeof(UChar_t)
+           + (voxelScales.size() + elementScales.size()) * sizeof(Float_t);
+}
+
+const void* CompactSystemMatrix::getData() const{
+    if (!shorts.empty()){
+        return shorts.data();
+    }
+    if (!bytes.empty()){
+        return bytes.data();
+    }
+
+    return floats.data();
+}
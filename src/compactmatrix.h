@@ -0,0 +1,73 @@
+// compactmatrix.h
+// compact ML-EM system matrix (voxel after voxel, measured elements only) in a selectable precision
+//
+// The probabilities are Monte Carlo estimates (counts divided by 5e6 emissions) and carry only a few
+// significant digits, so they can be stored in less than 32 bits. The kernels decode one row at a time
+// into a Float_t buffer and accumulate in Double_t as before; less memory is read per iteration.
+//   float32:      as loaded
+//   float16:      IEEE half precision, 11 significant bits
+//   bfloat16:     upper half of float32, 8 significant bits
+//   quantized16:  16-bit integers
+//   quantized8:   8-bit integers
+// All reduced precisions are scaled per voxel (the largest probability of the voxel maps to the largest
+// code) or per detector pair (the largest probability of the pair over all voxels); probabilities below
+// half a step of their scale become zero.
+
+#pragma once
+#include <vector>
+#include <functional>
+#include <TROOT.h>
+
+#include "largearray.h"
+
+// ##### COMPACT SYSTEM MATRIX #####
+class CompactSystemMatrix{
+public:
+    enum Precision { float32, float16, bfloat16, quantized16, quantized8 };
+    enum Scaling { perVoxel, perPair };
+
+    CompactSystemMatrix();
+
+    // applies to the next store()
+    void setPrecision(const Precision precision, const Scaling scaling){this->precision = precision; this->scaling = scaling;}
+    Precision getPrecision() const {return precision;}
+    Scaling getScaling() const {return scaling;}
+    TString getDescription() const;
+
+    // p_vm: voxel after voxel, elements: measured elements (see Utilities::getElementIndex), p_vm is emptied
+    void store(LargeFloatArray& p_vm, const std::vector<UInt_t>& elements, const Int_t numberOfBins);
+    void store(const CompactSystemMatrix& source, const std::vector<UInt_t>& elements, const Int_t numberOfBins);  // source is kept
+    void decode(LargeFloatArray& p_vm) const;
+    void release(LargeFloatArray& p_vm);  // all rows in float32, moved out without a copy if stored in float32; empty afterwards
+
+    std::vector<Double_t> getSensitivities() const;  // sums of the stored rows
+
+    // row v decoded into the buffer of the caller, float32 rows are returned in place
+    // the pointer stays valid until the buffer is used again, so several threads can decode with their own buffers
+    const Float_t* getRow(const Int_t v, std::vector<Float_t>& buffer) const;
+    // the same with the buffer of the matrix: valid only until the next call on this matrix, not thread-safe
+    const Float_t* getRow(const Int_t v) const {return getRow(v, row);}
+
+    Int_t getNumberOfVoxels() const {return numberOfVoxels;}
+    size_t getNumberOfBytes() const;
+    const void* getData() const;
+
+private:
+    void encode(const std::function<const Float_t*(const Int_t)> getSourceRow, const Int_t numberOfSourceVoxels,
+                const std::vector<UInt_t>& elements, const Int_t numberOfBins);
+
+    Precision precision;
+    Scaling scaling;
+    Precision storedPrecision;
+    Scaling storedScaling;
+    Int_t numberOfVoxels;
+    size_t numberOfElements;
+
+    LargeFloatArray floats;              // float32
+    LargeShortArray shorts;              // float16, bfloat16, quantized16
+    LargeByteArray bytes;                // quantized8
+    std::vector<Float_t> voxelScales;    // per voxel
+    std::vector<Float_t> elementScales;  // per measured element, the scale of its pair
+
+    mutable std::vector<Float_t> row;    // buffer of getRow(v)
+};
@@ -0,0 +1,313 @@
+// dynamic.cpp
+
+#include "dynamic.h"
+#include <algorithm>
+#include <TFile.h>
+#include <TGraph.h>
+#include <TBenchmark.h>
+
+#include "batchmlem.h"
+#include "listmode.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+// ##### DYNAMIC RECONSTRUCTION #####
+ReconstructionDynamicMLEM::ReconstructionDynamicMLEM(const std::vector<TString> pathsToSlices,
+                                                     const TString pathToProjections,
+                                                     const std::vector<Double_t> volume,
+                                                     const Selection& selection,
+                                                     const RegionOfInterest& regionOfInterest) :
+    numberOfFrames(0),
+    isCalculationValid(kTRUE),
+    accelerator(1),
+    window(1),
+    stride(1),
+    framesPerBatch(8){
+    // prepare data for the reconstruction of time frames using ML-EM
+
+    TBenchmark b;
+
+    // prepare the measurement data
+    b.Start("N_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+    Int_t numberOfDetectors = 0;
+    for (UInt_t s = 0; s < pathsToSlices.size(); ++s){
+        Measurements measurementData(pathsToSlices[s], selection);
+        measurementData.createN_dcb();
+        measurementData.fillN_dcb(kFALSE);
+
+        if (s == 0){
+            numberOfDetectors = measurementData.numberOfDetectors;
+        }
+
+        if (measurementData.numberOfDetectors != numberOfDetectors){
+            std::cout << "Number of detectors is not consistent: " << pathsToSlices[s] << "\n";
+            isCalculationValid = kFALSE;
+        }
+
+        isCalculationValid = isCalculationValid
+                             && Utilities::checkForSameNumberOfBins(measurementData.numberOfBins,
+                                                                    systemMatrixData->numberOfBins);
+
+        N_dcbOfSlices.push_back(measurementData.getN_dcbArray());
+    }
+    b.Stop("N_dcb");
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    isCalculationValid = isCalculationValid && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(numberOfDetectors);
+    }
+    b.Stop("p_dcb");
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    setWindow(1, 1);
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionDynamicMLEM::ReconstructionDynamicMLEM(const TString pathToEvents,
+                                                     const Double_t durationOfSlice,
+                                                     const TString pathToProjections,
+                                                     const std::vector<Double_t> volume,
+                                                     const Selection& selection,
+                                                     const RegionOfInterest& regionOfInterest) :
+    numberOfFrames(0),
+    isCalculationValid(kTRUE),
+    accelerator(1),
+    window(1),
+    stride(1),
+    framesPerBatch(8){
+    // prepare data for the reconstruction of time frames of list-mode events using ML-EM
+
+    TBenchmark b;
+
+    ListModeEvents events(pathToEvents);
+    events.setSelection(selection);
+    isCalculationValid = (events.numberOfEntries > 0) && (durationOfSlice > 0);
+
+    // prepare the system matrix first, it defines the energy bins
+    b.Start("p_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+    isCalculationValid = isCalculationValid && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(events.numberOfDetectors);
+    }
+    b.Stop("p_dcb");
+
+    // prepare the measurement data: slice s holds the events of [first + s * duration, first + (s + 1) * duration)
+    b.Start("N_dcb");
+    if (isCalculationValid){
+        events.setEnergyAxis(systemMatrixData->numberOfBins,
+                             systemMatrixData->minimumEnergy,
+                             systemMatrixData->maximumEnergy);
+
+        Int_t numberOfSlices = Int_t((events.lastTime - events.firstTime) / durationOfSlice) + 1;
+        N_dcbOfSlices.assign(numberOfSlices, std::vector<Double_t>(systemMatrixData->numberOfElements, 0.0));
+
+        std::vector<UInt_t> elements;
+        std::vector<Double_t> times;
+        while (events.readChunk(elements, times)){
+            for (UInt_t n = 0; n < elements.size(); ++n){
+                Int_t s = Int_t((times[n] - events.firstTime) / durationOfSlice);
+                N_dcbOfSlices[s][elements[n]] += 1;
+            }
+        }
+
+        std::cout << "\nSlices:\t\t\t" << numberOfSlices << " of " << durationOfSlice << " s\n";
+    }
+    b.Stop("N_dcb");
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    setWindow(1, 1);
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionDynamicMLEM::~ReconstructionDynamicMLEM(){
+    delete image;
+    delete systemMatrixData;
+}
+
+void ReconstructionDynamicMLEM::setWindow(const Int_t window, const Int_t stride){
+    // frames of `window` slices, starting every `stride` slices
+
+    this->window = std::max(1, window);
+    this->stride = std::max(1, stride);
+
+    Int_t numberOfSlices = N_dcbOfSlices.size();
+    numberOfFrames = (numberOfSlices >= this->window) ? (numberOfSlices - this->window) / this->stride + 1 : 0;
+}
+
+std::vector<Double_t> ReconstructionDynamicMLEM::getN_dcbOfFrame(const Int_t frame) const{
+    // sum of the slices of one frame
+
+    std::vector<Double_t> N_dcb(N_dcbOfSlices[0].size(), 0.0);
+    for (Int_t s = frame * stride; s < frame * stride + window; ++s){
+        for (UInt_t i = 0; i < N_dcb.size(); ++i){
+            N_dcb[i] += N_dcbOfSlices[s][i];
+        }
+    }
+
+    return N_dcb;
+}
+
+void ReconstructionDynamicMLEM::start(const Int_t iterationsOfReference, const Int_t iterationsPerFrame){
+    // reconstruct the image of all slices, then all frames starting from it
+
+    if (!isCalculationValid || (numberOfFrames == 0)){
+        return;
+    }
+
+    TBenchmark b;
+
+    // reference image of all slices
+    b.Start("reference");
+    {
+        std::vector<Double_t> N_dcb(N_dcbOfSlices[0].size(), 0.0);
+        for (UInt_t s = 0; s < N_dcbOfSlices.size(); ++s){
+            for (UInt_t i = 0; i < N_dcb.size(); ++i){
+                N_dcb[i] += N_dcbOfSlices[s][i];
+            }
+        }
+
+        BatchMLEM batch(systemMatrixData, std::vector<std::vector<Double_t> >(1, N_dcb));
+        batch.setAccelerator(accelerator);
+        for (Int_t n = 0; n < iterationsOfReference; ++n){
+            batch.iterate();
+        }
+        batch.getImage(0, referenceImage);
+
+        // scaled to the counts of an average frame
+        for (UInt_t v = 0; v < referenceImage.size(); ++v){
+            referenceImage[v] *= Double_t(window) / N_dcbOfSlices.size();
+        }
+    }
+    b.Stop("reference");
+
+    imagesOfFrames.assign(numberOfFrames, std::vector<Double_t>());
+    logLikeOfFrames.assign(numberOfFrames, 0.0);
+
+    b.Start("frames");
+    {
+        ThreadPool pool;
+
+        // as many chunks as there are jobs in all threads, chunks of equal length
+        Int_t K = std::max(1, framesPerBatch);
+        Int_t numberOfChunks = std::min<Int_t>(numberOfFrames, pool.getNumberOfThreads() * K);
+        Int_t chunkLength = (numberOfFrames + numberOfChunks - 1) / numberOfChunks;
+        numberOfChunks = (numberOfFrames + chunkLength - 1) / chunkLength;
+
+        for (Int_t firstChunk = 0; firstChunk < numberOfChunks; firstChunk += K){
+            pool.enqueue(std::bind(&ReconstructionDynamicMLEM::reconstructChunks, this,
+                                   firstChunk, std::min(K, numberOfChunks - firstChunk),
+                                   chunkLength, iterationsPerFrame));
+        }
+
+        pool.wait();
+    }
+    b.Stop("frames");
+
+    // Inform user
+    std::cout << "\nDynamic reconstruction done. Frames: " << numberOfFrames << ", Slices per frame: " << window
+              << ", Stride: " << stride << "\n";
+    std::cout << "\nReference Time:\t\t" << b.GetRealTime("reference") << " seconds\n";
+    std::cout << "\nFrames Time:\t\t" << b.GetRealTime("frames") << " seconds\n";
+
+    saveResults("MLEM_Dynamic.root");
+}
+
+void ReconstructionDynamicMLEM::reconstructChunks(const Int_t firstChunk, const Int_t numberOfChunks,
+                                                  const Int_t chunkLength, const Int_t iterationsPerFrame){
+    // (WORKER THREAD) reconstruct chunks of neighbouring frames as one batch, frame after frame
+
+    Int_t K = numberOfChunks;
+
+    std::vector<std::vector<Double_t> > N_dcbOfJobs;
+    for (Int_t k = 0; k < K; ++k){
+        N_dcbOfJobs.push_back(getN_dcbOfFrame((firstChunk + k) * chunkLength));
+    }
+
+    BatchMLEM batch(systemMatrixData, N_dcbOfJobs);
+    batch.setAccelerator(accelerator);
+    for (Int_t k = 0; k < K; ++k){
+        batch.setImage(k, referenceImage);
+    }
+
+    for (Int_t i = 0; i < chunkLength; ++i){
+
+        // the next frame of every chunk continues from the image of the previous one
+        if (i > 0){
+            for (Int_t k = 0; k < K; ++k){
+                Int_t frame = (firstChunk + k) * chunkLength + i;
+                if (frame < numberOfFrames){
+                    batch.setCounts(k, getN_dcbOfFrame(frame));
+                } else {
+                    batch.setActive(k, kFALSE);
+                }
+            }
+        }
+
+        for (Int_t n = 0; n < iterationsPerFrame; ++n){
+            batch.iterate();
+        }
+
+        std::vector<Double_t> logLike = batch.calculateLogLike();
+        for (Int_t k = 0; k < K; ++k){
+            Int_t frame = (firstChunk + k) * chunkLength + i;
+            if (frame < numberOfFrames){
+                batch.getImage(k, imagesOfFrames[frame]);
+                logLikeOfFrames[frame] = logLike[k];
+            }
+        }
+    }
+}
+
+void ReconstructionDynamicMLEM::saveResults(const TString pathToResults){
+    // write the image of every frame and the activity over time
+
+    TFile* file = new TFile(pathToResults, "RECREATE");
+    file->cd();
+
+    std::vector<Double_t> firstSlices, activities;
+    for (Int_t f = 0; f < numberOfFrames; ++f){
+        image->A_v->Reset();
+        for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+            std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+            image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], imagesOfFrames[f][v]);
+        }
+
+        // images are not normalized, so the activity of the frames can be compared
+        TString name, title;
+        name.Form("A_v_%i", f);
+        title.Form("Frame %i: slices %i - %i", f, f * stride, f * stride + window - 1);
+        image->A_v->SetTitle(title);
+        image->A_v->Write(name);
+
+        firstSlices.push_back(f * stride);
+        activities.push_back(image->A_v->Integral());
+    }
+
+    TGraph activity(numberOfFrames, &firstSlices[0], &activities[0]);
+    activity.Write("activity");
+
+    TGraph logLike(numberOfFrames, &firstSlices[0], &logLikeOfFrames[0]);
+    logLike.Write("logLike");
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nImages written to " << pathToResults << "\n";
+}
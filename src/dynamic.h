@@ -0,0 +1,64 @@
+// dynamic.h
+// ML-EM of a series of time frames with one loaded system matrix
+//
+// The acquisition is given as consecutive time slices (one N_dcb each), either as spectra files
+// or as list-mode events (see listmode.h) cut into slices of equal duration. A frame sums `window` slices,
+// consecutive frames start `stride` slices apart. All frames start from the image of the summed slices;
+// the frames are split into chunks of neighbouring frames, each frame of a chunk continues from the
+// image of the previous one. Chunks are reconstructed as jobs of batches (see batchmlem.h) on a thread pool.
+
+#pragma once
+#include <vector>
+#include <TH3.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+// ##### DYNAMIC RECONSTRUCTION #####
+class ReconstructionDynamicMLEM{
+public:
+    ReconstructionDynamicMLEM(const std::vector<TString> pathsToSlices,
+                              const TString pathToProjections,
+                              const std::vector<Double_t> volume,
+                              const Selection& selection = Selection(),
+                              const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ReconstructionDynamicMLEM(const TString pathToEvents,
+                              const Double_t durationOfSlice,
+                              const TString pathToProjections,
+                              const std::vector<Double_t> volume,
+                              const Selection& selection = Selection(),
+                              const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionDynamicMLEM();
+
+    void setAccelerator(const Double_t a){accelerator = a;}
+    void setWindow(const Int_t window, const Int_t stride);
+    void setFramesPerBatch(const Int_t f){framesPerBatch = f;}
+
+    void start(const Int_t iterationsOfReference, const Int_t iterationsPerFrame);
+
+    Int_t numberOfFrames;
+
+private:
+    std::vector<Double_t> getN_dcbOfFrame(const Int_t frame) const;
+    void reconstructChunks(const Int_t firstChunk, const Int_t numberOfChunks,
+                           const Int_t chunkLength, const Int_t iterationsPerFrame);
+    void saveResults(const TString pathToResults);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Double_t accelerator;
+    Int_t window;               // slices per frame
+    Int_t stride;               // slices between the starts of two frames
+    Int_t framesPerBatch;       // jobs of one batch, i.e. chunks reconstructed together
+
+    std::vector<std::vector<Double_t> > N_dcbOfSlices;
+    std::vector<Double_t> referenceImage;      // image of all slices, start of every chunk
+
+    // results, frame after frame
+    std::vector<std::vector<Double_t> > imagesOfFrames;
+    std::vector<Double_t> logLikeOfFrames;
+
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+};
@@ -3,14 +3,15 @@
 #include "imagespace.h"
 
 // ##### IMAGE SPACE / ACTIVITY #####
-ImageSpace::ImageSpace(const std::vector<Double_t> volume, const std::array<Int_t, 3> size){
+ImageSpace::ImageSpace(const std::vector<Double_t> volume, const std::array<Int_t, 3> size,
+                       const std::vector<Int_t> voxels){
     setImageVolume(volume);
 
     numberOfBinsX = size[0] + 1;
     numberOfBinsY = size[1] + 1;
     numberOfBinsZ = size[2] + 1;
 
-    setImageIndices();
+    setImageIndices(voxels);
     numberOfVoxels = imageIndices.size();
 
     createA_v();
@@ -53,8 +54,8 @@ void ImageSpace::makeA_vHomogeneous(){
     }
 }
 
-void ImageSpace::setImageIndices(){
-    // assign coordinates to voxel number v
+void ImageSpace::setImageIndices(const std::vector<Int_t> voxels){
+    // assign coordinates to voxel number v, with a region of interest only to its voxels (empty: all voxels)
 
     Int_t x = numberOfBinsX - 1;
     Int_t y = numberOfBinsY - 1;
@@ -69,4 +70,12 @@ void ImageSpace::setImageIndices(){
             }
         }
     }
+
+    if (!voxels.empty()){
+        std::vector<std::array<Int_t, 3> > allIndices;
+        allIndices.swap(imageIndices);
+        for (UInt_t i = 0; i < voxels.size(); ++i){
+            imageIndices.push_back(allIndices.at(voxels[i]));
+        }
+    }
 }
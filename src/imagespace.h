@@ -9,7 +9,8 @@
 // ##### IMAGE SPACE / ACTIVITY #####
 class ImageSpace{
 public:
-    ImageSpace(const std::vector<Double_t> volume, const std::array<Int_t, 3> size);
+    ImageSpace(const std::vector<Double_t> volume, const std::array<Int_t, 3> size,
+               const std::vector<Int_t> voxels = std::vector<Int_t>());
     ~ImageSpace();
 
     void createA_v();
@@ -17,7 +18,7 @@ public:
 
     // Image space info
     std::vector<Double_t> imageVolume;                      // in mm, xMin, xMax, yMin, yMax, zMin, zMax
-    std::vector<std::array<Int_t, 3> > imageIndices;        // coordinates of voxel v
+    std::vector<std::array<Int_t, 3> > imageIndices;        // coordinates of voxel v (only the voxels of the region of interest)
 
     // Activity distribution
     Int_t numberOfBinsX;
@@ -30,5 +31,5 @@ public:
 
 private:
     void setImageVolume(const std::vector<Double_t> volume){imageVolume = volume;}
-    void setImageIndices();
+    void setImageIndices(const std::vector<Int_t> voxels);
 };
@@ -0,0 +1,242 @@
+// largearray.cpp
+
+#include "largearray.h"
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace {
+    const Int_t interleavePolicy = 3;                       // MPOL_INTERLEAVE of <numaif.h>, without libnuma
+    const size_t transparentHugePageSize = 2 * 1024 * 1024;
+
+    struct Mapping{
+        size_t numberOfBytes;   // mapped, rounded up to the pages
+        size_t pageSize;
+        Bool_t isHugePage;      // explicit huge pages
+        Int_t numberOfNodes;    // interleaved over, 1: not interleaved
+    };
+
+    std::mutex mutex;
+    std::map<const void*, Mapping> mappings;
+
+    std::vector<Int_t> getNodes(){
+        // online NUMA nodes, e.g. "0-1,3"
+
+        std::vector<Int_t> nodes;
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string range;
+        while (std::getline(file, range, ',')){
+            Int_t first, last;
+            Int_t numberOfValues = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (numberOfValues == 1){
+                last = first;
+            }
+
+            for (Int_t node = first; (numberOfValues >= 1) && (node <= last); ++node){
+                nodes.push_back(node);
+            }
+        }
+
+        return nodes;
+    }
+
+    Bool_t interleave(void* memory, const size_t numberOfBytes, const std::vector<Int_t>& nodes){
+        // pages are placed round robin over the nodes when they are touched first
+#ifdef SYS_mbind
+        const size_t bitsPerLong = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(nodes.back() / bitsPerLong + 1, 0);
+        for (UInt_t i = 0; i < nodes.size(); ++i){
+            mask[nodes[i] / bitsPerLong] |= 1UL << (nodes[i] % bitsPerLong);
+        }
+
+        return syscall(SYS_mbind, memory, numberOfBytes, interleavePolicy, mask.data(), mask.size() * bitsPerLong + 1, 0) == 0;
+#else
+        return kFALSE;
+#endif
+    }
+
+    size_t getTransparentHugePages(const void* memory, const size_t numberOfBytes){
+        // bytes of the array backed by transparent huge pages, from the memory map of the process
+
+        ULong64_t begin = reinterpret_cast<ULong64_t>(memory);
+        ULong64_t end = begin + numberOfBytes;
+
+        size_t hugePages = 0;
+        Bool_t isInArray = kFALSE;
+        std::ifstream file("/proc/self/smaps");
+        std::string line;
+        while (std::getline(file, line)){
+            ULong64_t first, last;
+            if (std::sscanf(line.c_str(), "%llx-%llx ", &first, &last) == 2){
+                isInArray = (first < end) && (last > begin);
+                continue;
+            }
+
+            size_t kilobytes;
+            if (isInArray && ((std::sscanf(line.c_str(), "AnonHugePages: %zu kB", &kilobytes) == 1)
+                              || (std::sscanf(line.c_str(), "ShmemPmdMapped: %zu kB", &kilobytes) == 1))){
+                hugePages += kilobytes * 1024;
+            }
+        }
+
+        return hugePages;
+    }
+
+    std::map<Int_t, Int_t> getPagesOfNodes(const void* memory, const size_t numberOfBytes, const size_t pageSize){
+        // node of up to 1000 pages spread over the array, untouched pages are not counted
+
+        std::map<Int_t, Int_t> pagesOfNodes;
+#ifdef SYS_move_pages
+        size_t step = std::max(pageSize, numberOfBytes / 1000);
+        std::vector<void*> pages;
+        for (size_t offset = 0; offset < numberOfBytes; offset += step){
+            pages.push_back(const_cast<char*>(static_cast<const char*>(memory)) + offset);
+        }
+
+        std::vector<Int_t> status(pages.size(), -1);
+        if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) == 0){
+            for (UInt_t i = 0; i < status.size(); ++i){
+                if (status[i] >= 0){
+                    ++pagesOfNodes[status[i]];
+                }
+            }
+        }
+#endif
+        return pagesOfNodes;
+    }
+}
+
+// ##### LARGE ARRAYS #####
+void* LargeArrays::allocate(const size_t numberOfBytes){
+    // small arrays from the heap, large ones mapped with huge pages and interleaved
+
+    if (numberOfBytes < largeArrayThreshold){
+        return ::operator new(numberOfBytes);
+    }
+
+    Mapping mapping = { 0, size_t(sysconf(_SC_PAGESIZE)), kFALSE, 1 };
+    void* memory = MAP_FAILED;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    // explicit huge pages, if reserved and not more than an eighth is lost by rounding up
+    const Int_t hugePageShifts[2] = { 30, 21 };
+    for (Int_t i = 0; (i < 2) && (memory == MAP_FAILED); ++i){
+        size_t hugePageSize = size_t(1) << hugePageShifts[i];
+        size_t numberOfMappedBytes = (numberOfBytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+        if (numberOfMappedBytes - numberOfBytes > numberOfBytes / 8){
+            continue;
+        }
+
+        memory = mmap(nullptr, numberOfMappedBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (hugePageShifts[i] << MAP_HUGE_SHIFT), -1, 0);
+        if (memory != MAP_FAILED){
+            mapping.numberOfBytes = numberOfMappedBytes;
+            mapping.pageSize = hugePageSize;
+            mapping.isHugePage = kTRUE;
+        }
+    }
+#endif
+
+    if (memory == MAP_FAILED){
+        // normal pages, aligned to 2 MB so that the kernel can use transparent huge pages throughout
+        size_t numberOfMappedBytes = (numberOfBytes + mapping.pageSize - 1) / mapping.pageSize * mapping.pageSize;
+        void* region = mmap(nullptr, numberOfMappedBytes + transparentHugePageSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+
+        char* begin = static_cast<char*>(region);
+        char* alignedBegin = reinterpret_cast<char*>((reinterpret_cast<size_t>(begin) + transparentHugePageSize - 1)
+                                                     / transparentHugePageSize * transparentHugePageSize);
+        if (alignedBegin > begin){
+            munmap(begin, alignedBegin - begin);
+        }
+        munmap(alignedBegin + numberOfMappedBytes, begin + transparentHugePageSize - alignedBegin);
+
+        memory = alignedBegin;
+        mapping.numberOfBytes = numberOfMappedBytes;
+    }
+
+    // before the first touch
+    placePages(memory, mapping.numberOfBytes);
+    std::vector<Int_t> nodes = getNodes();
+    if (nodes.size() > 1){
+        mapping.numberOfNodes = nodes.size();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    mappings[memory] = mapping;
+    return memory;
+}
+
+void LargeArrays::deallocate(void* memory, const size_t numberOfBytes){
+    if (numberOfBytes < largeArrayThreshold){
+        ::operator delete(memory);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<const void*, Mapping>::iterator mapping = mappings.find(memory);
+    if (mapping != mappings.end()){
+        munmap(memory, mapping->second.numberOfBytes);
+        mappings.erase(mapping);
+    }
+}
+
+void LargeArrays::placePages(void* memory, const size_t numberOfBytes){
+    // request transparent huge pages and interleave over the NUMA nodes, before the first touch
+
+#ifdef MADV_HUGEPAGE
+    madvise(memory, numberOfBytes, MADV_HUGEPAGE);
+#endif
+
+    std::vector<Int_t> nodes = getNodes();
+    if ((nodes.size() > 1) && !interleave(memory, numberOfBytes, nodes)){
+        std::cout << "\nPages could not be interleaved over " << nodes.size() << " NUMA nodes.\n";
+    }
+}
+
+void LargeArrays::report(const void* memory, const size_t numberOfBytes, const TString nameOfArray){
+    // pages and nodes actually obtained by the array, after it has been filled
+
+    Mapping mapping = { numberOfBytes, size_t(sysconf(_SC_PAGESIZE)), kFALSE, Int_t(std::max<size_t>(1, getNodes().size())) };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<const void*, Mapping>::const_iterator found = mappings.find(memory);
+        if (found != mappings.end()){
+            mapping = found->second;
+        }
+    }
+
+    std::ostringstream pages;
+    if (mapping.isHugePage){
+        pages << (mapping.pageSize >> 20) << " MB huge pages";
+    } else{
+        pages << (mapping.pageSize >> 10) << " kB pages, " << getTransparentHugePages(memory, numberOfBytes) / (1024.0 * 1024.0)
+              << " MB in transparent huge pages";
+    }
+
+    std::cout << "\n" << nameOfArray << ":\t" << numberOfBytes / (1024.0 * 1024.0) << " MB, " << pages.str() << "\n";
+
+    std::map<Int_t, Int_t> pagesOfNodes = getPagesOfNodes(memory, numberOfBytes, mapping.pageSize);
+    if (mapping.numberOfNodes > 1){
+        Int_t numberOfPages = 0;
+        for (std::map<Int_t, Int_t>::const_iterator node = pagesOfNodes.begin(); node != pagesOfNodes.end(); ++node){
+            numberOfPages += node->second;
+        }
+
+        std::cout << "NUMA nodes:\t\t";
+        for (std::map<Int_t, Int_t>::const_iterator node = pagesOfNodes.begin(); node != pagesOfNodes.end(); ++node){
+            std::cout << "node " << node->first << ": " << 100.0 * node->second / numberOfPages << " %  ";
+        }
+        std::cout << "(of " << mapping.numberOfNodes << " nodes)\n";
+    }
+}
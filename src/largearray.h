@@ -0,0 +1,46 @@
+// largearray.h
+// placement of the large read-only arrays (system matrices): huge pages and NUMA interleaving
+//
+// Arrays of at least largeArrayThreshold bytes are mapped on their own instead of taken from the heap:
+// with explicit huge pages (1 GB, then 2 MB) if the system has them reserved, otherwise transparent huge
+// pages are requested. On machines with several NUMA nodes the pages are interleaved over all nodes
+// before the first touch, so the loader thread does not place the whole array on its own socket. The
+// parallel kernels (batches, replicas, sweeps, frames) all read the whole array, so interleaving is the
+// placement that matches them. report() tells which pages and nodes were obtained in the end.
+
+#pragma once
+#include <vector>
+#include <new>
+#include <TROOT.h>
+
+const size_t largeArrayThreshold = 4 * 1024 * 1024;  // in bytes, smaller arrays stay on the heap
+
+namespace LargeArrays {
+    void* allocate(const size_t numberOfBytes);
+    void deallocate(void* memory, const size_t numberOfBytes);
+    void placePages(void* memory, const size_t numberOfBytes);  // for memory mapped elsewhere, e.g. shared memory
+    void report(const void* memory, const size_t numberOfBytes, const TString nameOfArray);
+}
+
+// ##### ALLOCATOR #####
+template <typename T>
+class LargeArrayAllocator{
+public:
+    typedef T value_type;
+
+    LargeArrayAllocator(){}
+    template <typename U>
+    LargeArrayAllocator(const LargeArrayAllocator<U>&){}
+
+    T* allocate(const size_t n){ return static_cast<T*>(LargeArrays::allocate(n * sizeof(T))); }
+    void deallocate(T* p, const size_t n){ LargeArrays::deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&){ return true; }
+template <typename T, typename U>
+bool operator!=(const LargeArrayAllocator<T>&, const LargeArrayAllocator<U>&){ return false; }
+
+typedef std::vector<Float_t, LargeArrayAllocator<Float_t> > LargeFloatArray;
+typedef std::vector<UShort_t, LargeArrayAllocator<UShort_t> > LargeShortArray;
+typedef std::vector<UChar_t, LargeArrayAllocator<UChar_t> > LargeByteArray;
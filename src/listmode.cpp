@@ -0,0 +1,252 @@
+// listmode.cpp
+
+#include "listmode.h"
+#include <cmath>
+#include <algorithm>
+#include <TGraph.h>
+#include <TBenchmark.h>
+
+#include "batchmlem.h"
+#include "utilities.h"
+
+// ##### LIST-MODE EVENTS #####
+ListModeEvents::ListModeEvents(const TString pathToEvents) :
+    numberOfEntries(0),
+    numberOfRejectedEvents(0),
+    numberOfDetectors(0),
+    firstTime(0),
+    lastTime(0),
+    nextEntry(0),
+    detectorD(0),
+    detectorC(0),
+    energy(0),
+    time(0),
+    numberOfBins(0),
+    minimumEnergy(0),
+    maximumEnergy(0),
+    startOfWindow(0),
+    endOfWindow(0){
+    // open the list-mode *.root file
+
+    eventsFile = new TFile(pathToEvents, "READ");
+    events = eventsFile->IsOpen() ? (TTree*)eventsFile->Get("events") : nullptr;
+    if (!events){
+        std::cout << "No list-mode events found in " << pathToEvents << "\n";
+        return;
+    }
+
+    events->SetBranchAddress("d", &detectorD);
+    events->SetBranchAddress("c", &detectorC);
+    events->SetBranchAddress("energy", &energy);
+    events->SetBranchAddress("time", &time);
+
+    numberOfEntries = events->GetEntries();
+    numberOfDetectors = Int_t(std::max(events->GetMaximum("d"), events->GetMaximum("c"))) + 1;
+    firstTime = events->GetMinimum("time");
+    lastTime = events->GetMaximum("time");
+}
+
+ListModeEvents::~ListModeEvents(){
+    delete events;
+    delete eventsFile;
+}
+
+Bool_t ListModeEvents::isListMode(const TString pathToEvents){
+    // list-mode files contain the tree "events" instead of spectra
+
+    TFile file(pathToEvents, "READ");
+    Bool_t isTreeFound = file.IsOpen() && (file.Get("events") != nullptr);
+    file.Close();
+
+    return isTreeFound;
+}
+
+void ListModeEvents::setEnergyAxis(const Int_t nBins, const Double_t minimumEnergy, const Double_t maximumEnergy){
+    // binning of the energy, same as in the spectra of the system matrix
+
+    numberOfBins = nBins;
+    this->minimumEnergy = minimumEnergy;
+    this->maximumEnergy = maximumEnergy;
+}
+
+Bool_t ListModeEvents::readChunk(std::vector<UInt_t>& elements, std::vector<Double_t>& times){
+    // read the next chunk of events as measurement elements (see Utilities::getElementIndex) and times,
+    // returns kFALSE if all events have been read
+
+    elements.clear();
+    times.clear();
+
+    if (!events || (numberOfBins == 0) || (nextEntry >= numberOfEntries)){
+        return kFALSE;
+    }
+
+    Long64_t lastEntry = std::min(nextEntry + listModeChunkSize, numberOfEntries);
+    elements.reserve(lastEntry - nextEntry);
+    times.reserve(lastEntry - nextEntry);
+
+    Bool_t isWindowUsed = (endOfWindow > startOfWindow);
+    Double_t binWidth = (maximumEnergy - minimumEnergy) / numberOfBins;
+
+    for (; nextEntry < lastEntry; ++nextEntry){
+        events->GetEntry(nextEntry);
+
+        Int_t b = Int_t(std::floor((energy - minimumEnergy) / binWidth));
+        if ((b < 0) || (b >= numberOfBins) || (detectorD < 0) || (detectorC < 0)
+            || !selection.isPairSelected(detectorD, detectorC)
+            || (isWindowUsed && ((time < startOfWindow) || (time >= endOfWindow)))){
+
+            ++numberOfRejectedEvents;
+            continue;
+        }
+
+        elements.push_back(Utilities::getElementIndex(detectorD, detectorC, b, numberOfDetectors, numberOfBins));
+        times.push_back(time);
+    }
+
+    return kTRUE;
+}
+
+// ##### LIST-MODE RECONSTRUCTION #####
+ReconstructionListModeMLEM::ReconstructionListModeMLEM(const TString pathToEvents,
+                                                       const TString pathToProjections,
+                                                       const std::vector<Double_t> volume,
+                                                       const Selection& selection,
+                                                       const RegionOfInterest& regionOfInterest) :
+    isCalculationValid(kTRUE),
+    accelerator(1),
+    numberOfCounts(0){
+    // prepare data for the reconstruction of list-mode events using ML-EM
+
+    TBenchmark b;
+
+    // the events are read at start(), only the number of detectors is needed here
+    events = new ListModeEvents(pathToEvents);
+    events->setSelection(selection);
+    isCalculationValid = (events->numberOfEntries > 0);
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+    isCalculationValid = isCalculationValid && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(events->numberOfDetectors);
+        events->setEnergyAxis(systemMatrixData->numberOfBins,
+                              systemMatrixData->minimumEnergy,
+                              systemMatrixData->maximumEnergy);
+    }
+    b.Stop("p_dcb");
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionListModeMLEM::~ReconstructionListModeMLEM(){
+    delete batch;
+    delete image;
+    delete systemMatrixData;
+    delete events;
+}
+
+void ReconstructionListModeMLEM::readEvents(){
+    // add the events chunk by chunk, events of the same element are counted together
+
+    delete batch;
+    std::vector<std::vector<Double_t> > noCounts(1, std::vector<Double_t>(systemMatrixData->numberOfElements, 0.0));
+    batch = new BatchMLEM(systemMatrixData, noCounts);
+
+    std::vector<UInt_t> elementsOfEvents;
+    std::vector<Double_t> times;
+    std::vector<UInt_t> elements;
+    std::vector<Double_t> counts;
+
+    events->rewind();
+    while (events->readChunk(elementsOfEvents, times)){
+        std::sort(elementsOfEvents.begin(), elementsOfEvents.end());
+
+        elements.clear();
+        counts.clear();
+        for (UInt_t n = 0; n < elementsOfEvents.size(); ++n){
+            if (elements.empty() || (elements.back() != elementsOfEvents[n])){
+                elements.push_back(elementsOfEvents[n]);
+                counts.push_back(0);
+            }
+            counts.back() += 1;
+        }
+
+        batch->addCounts(0, elements, counts);
+        numberOfCounts += elementsOfEvents.size();
+    }
+}
+
+void ReconstructionListModeMLEM::start(const Int_t maxNumberOfIterations){
+    // execute the calculation on the events
+
+    if (!isCalculationValid){
+        return;
+    }
+
+    TBenchmark b;
+
+    b.Start("N_dcb");
+    readEvents();
+    b.Stop("N_dcb");
+
+    std::cout << "\nEvents:\t\t\t" << numberOfCounts << " used, " << events->numberOfRejectedEvents << " rejected\n";
+    std::cout << "\nEvents Reading Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+
+    batch->setAccelerator(accelerator);
+    logLike.clear();
+
+    b.Start("stats");
+    for (Int_t n = 0; n < maxNumberOfIterations; ++n){
+        batch->iterate();
+        logLike.push_back(batch->calculateLogLike()[0]);
+    }
+    b.Stop("stats");
+
+    // Inform user
+    std::cout << "\nImage reconstruction done. Steps: " << maxNumberOfIterations << "\n";
+    std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
+
+    saveResults("MLEM_ListMode.root");
+}
+
+void ReconstructionListModeMLEM::saveResults(const TString pathToResults){
+    // write the normalized image and the log-likelihood
+
+    std::vector<Double_t> activities;
+    batch->getImage(0, activities);
+
+    image->A_v->Reset();
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], activities[v]);
+    }
+
+    if (image->A_v->Integral() > 0){
+        image->A_v->Scale(1.0 / image->A_v->Integral());
+    }
+
+    TFile* file = new TFile(pathToResults, "RECREATE");
+    file->cd();
+    image->A_v->Write("A_v");
+
+    if (!logLike.empty()){
+        std::vector<Double_t> iterations;
+        for (UInt_t i = 0; i < logLike.size(); ++i){
+            iterations.push_back(i + 1);
+        }
+
+        TGraph logLikeGraph(logLike.size(), &iterations[0], &logLike[0]);
+        logLikeGraph.Write("logLike");
+    }
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nImage written to " << pathToResults << "\n";
+}
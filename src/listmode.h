@@ -0,0 +1,93 @@
+// listmode.h
+// list-mode input: one entry per detected event instead of one spectrum per detector pair
+//
+// The events are stored in a TTree "events" with the branches
+//   d, c    (Int_t)     indices of both the detectors, starting at 0 as in the "ddcc" spectra
+//   energy  (Double_t)  in the units of the spectra of the system matrix
+//   time    (Double_t)  in s
+// and are read in chunks, so the whole list never has to be in memory at once.
+
+#pragma once
+#include <vector>
+#include <TH3.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "selection.h"
+
+class BatchMLEM;
+
+// events read from the tree at once
+const Long64_t listModeChunkSize = 1048576;
+
+// ##### LIST-MODE EVENTS #####
+class ListModeEvents{
+public:
+    ListModeEvents(const TString pathToEvents);
+    ~ListModeEvents();
+
+    static Bool_t isListMode(const TString pathToEvents);
+
+    void setEnergyAxis(const Int_t nBins, const Double_t minimumEnergy, const Double_t maximumEnergy);
+    void setTimeWindow(const Double_t start, const Double_t end){startOfWindow = start; endOfWindow = end;}
+    void setSelection(const Selection& s){selection = s;}
+    void rewind(){nextEntry = 0;}
+    Bool_t readChunk(std::vector<UInt_t>& elements, std::vector<Double_t>& times);
+
+    Long64_t numberOfEntries;
+    Long64_t numberOfRejectedEvents;   // outside of the energy range, the time window or the selected pairs
+    Int_t numberOfDetectors;
+    Double_t firstTime;
+    Double_t lastTime;
+
+private:
+    TFile* eventsFile = nullptr;
+    TTree* events = nullptr;
+    Long64_t nextEntry;
+
+    // branches
+    Int_t detectorD;
+    Int_t detectorC;
+    Double_t energy;
+    Double_t time;
+
+    Int_t numberOfBins;
+    Double_t minimumEnergy;
+    Double_t maximumEnergy;
+    Double_t startOfWindow;            // [start, end), end <= start: all events
+    Double_t endOfWindow;
+    Selection selection;
+};
+
+// ##### LIST-MODE RECONSTRUCTION #####
+// ML-EM on the measurement elements hit by at least one event, no N_dcb histogram is built
+class ReconstructionListModeMLEM{
+public:
+    ReconstructionListModeMLEM(const TString pathToEvents,
+                               const TString pathToProjections,
+                               const std::vector<Double_t> volume,
+                               const Selection& selection = Selection(),
+                               const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionListModeMLEM();
+
+    void start(const Int_t maxNumberOfIterations);
+    void setAccelerator(const Double_t a){accelerator = a;}
+    void setTimeWindow(const Double_t start, const Double_t end){events->setTimeWindow(start, end);}
+
+private:
+    void readEvents();
+    void saveResults(const TString pathToResults);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Double_t accelerator;
+    Double_t numberOfCounts;
+    std::vector<Double_t> logLike;
+
+    ListModeEvents* events = nullptr;
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+    BatchMLEM* batch = nullptr;
+};
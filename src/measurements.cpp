@@ -4,8 +4,9 @@
 #include "utilities.h"
 
 // ##### MEASUREMENTS #####
-Measurements::Measurements(const TString pathToMeasurements) : numberOfDetectors(0), numberOfBins(0){
-    // open the measurement *.root file
+Measurements::Measurements(const TString pathToMeasurements, const Selection& selection) :
+    numberOfDetectors(0), numberOfBins(0), selection(selection), firstBin(1){
+    // open the measurement *.root file, only the selected spectra will be read
 
     measurementsFile = new TFile(pathToMeasurements, "READ");
     nextS_dcMeasurements = new TIter(measurementsFile->GetListOfKeys());
@@ -44,17 +45,20 @@ void Measurements::fillN_dcb(const Bool_t normalized){
             Int_t detectorC;
             TString nameOfS_dc = keyS_dcMeasurements->GetName();
             Utilities::getDetectorIndices(nameOfS_dc, detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
 
             // get spectrum
             TH1F* S_dc = (TH1F*)measurementsFile->Get(nameOfS_dc);
 
-            Double_t integral = S_dc->Integral();
+            Double_t integral = S_dc->Integral(firstBin, firstBin + numberOfBins - 1);
             if (integral != 0){
 
                 S_dc->Scale(1.0 / integral);
                 for (Int_t bin = 1; bin <= numberOfBins; ++bin){
                     N_dcb->SetBinContent(detectorD + 1, detectorC + 1, bin,
-                                         S_dc->GetBinContent(bin));
+                                         S_dc->GetBinContent(firstBin + bin - 1));
                 }
 
             } else{
@@ -77,14 +81,17 @@ void Measurements::fillN_dcb(const Bool_t normalized){
             Int_t detectorC;
             TString nameOfS_dc = keyS_dcMeasurements->GetName();
             Utilities::getDetectorIndices(nameOfS_dc, detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
 
             // get spectrum
             TH1F* S_dc = (TH1F*)measurementsFile->Get(nameOfS_dc);
 
-            if (S_dc->Integral() != 0){
+            if (S_dc->Integral(firstBin, firstBin + numberOfBins - 1) != 0){
                 for (Int_t bin = 1; bin <= numberOfBins; ++bin){
                     N_dcb->SetBinContent(detectorD + 1, detectorC + 1, bin,
-                                         S_dc->GetBinContent(bin));
+                                         S_dc->GetBinContent(firstBin + bin - 1));
                 }
             }
 
@@ -93,6 +100,21 @@ void Measurements::fillN_dcb(const Bool_t normalized){
     }
 }
 
+std::vector<Double_t> Measurements::getN_dcbArray() const{
+    // N_dcb as one array, see Utilities::getElementIndex
+
+    std::vector<Double_t> N(numberOfDetectors * numberOfDetectors * numberOfBins, 0.0);
+    for (Int_t d = 1; d <= numberOfDetectors; ++d){
+        for (Int_t c = 1; c <= numberOfDetectors; ++c){
+            for (Int_t bin = 1; bin <= numberOfBins; ++bin){
+                N[Utilities::getElementIndex(d - 1, c - 1, bin - 1, numberOfDetectors, numberOfBins)] = N_dcb->GetBinContent(d, c, bin);
+            }
+        }
+    }
+
+    return N;
+}
+
 void Measurements::getNumbers(){
     // extract number of detectors and bins
 
@@ -106,8 +128,10 @@ void Measurements::getNumbers(){
     // get number of detectors
     numberOfDetectors = std::max(detD, detC) + 1;
 
-    // get number of bins
+    // get number of bins in the energy window
     TH1F* lastS_dc = (TH1F*)measurementsFile->Get(nameOfLastS_dc);
-    numberOfBins = lastS_dc->GetNbinsX();
+    Int_t lastBin;
+    selection.getBinRange(lastS_dc, firstBin, lastBin);
+    numberOfBins = lastBin - firstBin + 1;
     delete lastS_dc;
 }
@@ -2,18 +2,22 @@
 
 #pragma once
 #include <algorithm>
+#include <vector>
 #include <TH3.h>
 #include <TKey.h>
 #include <TFile.h>
 
+#include "selection.h"
+
 // ##### MEASUREMENTS #####
 class Measurements{
 public:
-    Measurements(const TString pathToMeasurements);
+    Measurements(const TString pathToMeasurements, const Selection& selection = Selection());
     ~Measurements();
 
     void createN_dcb();
     void fillN_dcb(const Bool_t normalized);
+    std::vector<Double_t> getN_dcbArray() const;
 
     Int_t numberOfDetectors;
     Int_t numberOfBins;
@@ -23,6 +27,9 @@ public:
 private:
     void getNumbers();
 
+    Selection selection;
+    Int_t firstBin;         // first bin of the spectra in the energy window
+
     TFile* measurementsFile = nullptr;
     TIter* nextS_dcMeasurements = nullptr;
     TKey* keyS_dcMeasurements = nullptr;
@@ -2,6 +2,11 @@
 
 #include "mlem.h"
 #include <TGraph.h>
+#include <TParameter.h>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 
 // ##### RESULTS #####
 ResultsMLEM::ResultsMLEM(){
@@ -124,51 +129,76 @@ void ResultsMLEM::plotLogLikelihood(std::vector<Double_t> xAxis, std::vector<Dou
 // ##### PUBLIC FUNCTIONS #####
 ReconstructionMLEM::ReconstructionMLEM(const TString pathToMeasurements,
                                        const TString pathToProjections,
-                                       const std::vector<Double_t> volume) :
-    accelerator(1) {
+                                       const std::vector<Double_t> volume,
+                                       const Selection& selection,
+                                       const RegionOfInterest& regionOfInterest) :
+    accelerator(1),
+    completedIterations(0),
+    checkpointInterval(0),
+    timeOfConstruction(std::chrono::steady_clock::now()),
+    timeBudget(0),
+    isActiveSetUsed(kFALSE),
+    freezeTolerance(0),
+    freezeIterations(1),
+    refreshInterval(0),
+    isDeltaProjectionUsed(kFALSE),
+    deltaThreshold(0),
+    fullProjectionInterval(0),
+    iterationsSinceFullProjection(-1),
+    numberOfResolutionLevels(1),
+    iterationsPerLevel(0),
+    isLineSearchUsed(kFALSE),
+    sumOfStepLengths(0),
+    numberOfLineSearches(0),
+    iterationsPerEnergyStage(0) {
     // prepare data for reconstruction using ML-EM
 
     TBenchmark b;
 
     // prepare the measurement data
     b.Start("N_dcb");
-    measurementData = new Measurements(pathToMeasurements);
+    measurementData = new Measurements(pathToMeasurements, selection);
     measurementData->createN_dcb();
     measurementData->fillN_dcb(normalizeSpectra);
     b.Stop("N_dcb");
 
     // prepare the image & system matrix
     b.Start("p_dcb");
-    systemMatrixData = new SystemMatrix(pathToProjections);
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
 
     isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
-                                                             systemMatrixData->numberOfBins);
+                                                             systemMatrixData->numberOfBins)
+                         && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
 
     if (isCalculationValid){
         systemMatrixData->createSystemMatrix(normalizeSpectra,
                                              measurementData->N_dcb,
                                              measurementData->numberOfDetectors);
 
-        systemMatrixData->createP_dcbvPrime(measurementData->N_dcb);
-        createProjections();
+        createCompactSystemMatrix();
     }
     b.Stop("p_dcb");
 
     b.Start("A_v");
     image = new ImageSpace(volume,
-                           systemMatrixData->size);
+                           systemMatrixData->size,
+                           systemMatrixData->voxels);
     image->makeA_vHomogeneous();
     b.Stop("A_v");
 
     std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
     std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
     std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+    if (isCalculationValid){
+        std::cout << "\nMeasured elements:\t" << measuredElements.size() << " of "
+                  << measurementData->numberOfDetectors * measurementData->numberOfDetectors * measurementData->numberOfBins << "\n";
+    }
 }
 
 ReconstructionMLEM::~ReconstructionMLEM(){
+    delete bestA_v;
     delete results;
     delete image;
-    delete projections;
     delete measurementData;
     delete systemMatrixData;
 }
@@ -183,23 +213,63 @@ void ReconstructionMLEM::start(const Int_t maxNumberOfIterations){
     TBenchmark b;
 
     Double_t chiSquare = 0;
-    std::vector<Double_t> chiSquareXaxis;
-    std::vector<Double_t> chiSquareYaxis;
-
     Double_t logLike = 0;
-    std::vector<Double_t> logLikeXaxis;
-    std::vector<Double_t> logLikeYaxis;
 
     results = new ResultsMLEM();
 
+    // a resumed reconstruction is already past the coarse stages and levels
+    if (completedIterations == 0){
+        if (!energyRebinningFactors.empty()){
+            reconstructCoarseEnergyStages();
+        }
+
+        if (numberOfResolutionLevels > 1){
+            reconstructCoarseLevels();
+        }
+    }
+
+    refreshActiveSet();
+    iterationsSinceFullProjection = -1;
+
+    // with a time budget, the image of the lowest -log L is kept, since the exponent may overshoot
+    // the statistics belong to the image before the update, unless the projections follow the image
+    Bool_t isBestImageKept = (timeBudget > 0);
+    Bool_t doProjectionsFollowImage = isDeltaProjectionUsed || isLineSearchUsed;
+    Double_t bestLogLike = 0;
+    Int_t bestIteration = -1;
+    TH3F* previousA_v = nullptr;
+    if (isBestImageKept){
+        delete bestA_v;
+        bestA_v = (TH3F*)image->A_v->Clone("bestA_v");
+        previousA_v = (TH3F*)image->A_v->Clone("previousA_v");
+    }
+
     b.Start("stats");
-    Int_t numberOfIterations = 0;
+    Int_t numberOfIterations = completedIterations;
+    Double_t timeOfIteration = 0;
+    Bool_t isDeadlineReached = kFALSE;
     for (;;){
 
-        if (numberOfIterations == maxNumberOfIterations){
+        if (numberOfIterations >= maxNumberOfIterations){
             break;
         }
 
+        // stop if the next iteration would not finish in time
+        if (isBeyondDeadline(timeOfIteration)){
+            isDeadlineReached = kTRUE;
+            break;
+        }
+        Double_t timeBeforeIteration = getElapsedTime();
+
+        if (isActiveSetUsed && (refreshInterval > 0) && (numberOfIterations % refreshInterval == 0)){
+            refreshActiveSet();
+        }
+
+        if (isBestImageKept && !doProjectionsFollowImage){
+            previousA_v->Reset();
+            previousA_v->Add(image->A_v);
+        }
+
         calculate();
 
         if (numberOfIterations % 1 == 0){
@@ -210,14 +280,50 @@ void ReconstructionMLEM::start(const Int_t maxNumberOfIterations){
             logLike = calculateLogLike();
             logLikeXaxis.push_back(numberOfIterations + 1);
             logLikeYaxis.push_back(logLike);
+
+            if (isBestImageKept && ((bestIteration < 0) || (logLike < bestLogLike))){
+                bestLogLike = logLike;
+                bestIteration = doProjectionsFollowImage ? numberOfIterations + 1 : numberOfIterations;
+                bestA_v->Reset();
+                bestA_v->Add(doProjectionsFollowImage ? image->A_v : previousA_v);
+            }
         }
 
         ++numberOfIterations;
+        timeOfIteration = getElapsedTime() - timeBeforeIteration;
+
+        completedIterations = numberOfIterations;
+        if ((checkpointInterval > 0) && (completedIterations % checkpointInterval == 0)){
+            writeCheckpoint();
+        }
     }
     b.Stop("stats");
 
+    // the final checkpoint allows to continue with more iterations later on
+    writeCheckpoint();
+
     // Inform user
     std::cout << "\nImage reconstruction done. Steps: " << numberOfIterations << "\n";
+    if (isBestImageKept){
+        if (isDeadlineReached){
+            std::cout << "\nTime budget reached after " << numberOfIterations << " of " << maxNumberOfIterations << " iterations\n";
+        }
+        std::cout << "\nElapsed Time:\t\t" << getElapsedTime() << " of " << timeBudget << " seconds (loading included)\n";
+
+        if (bestIteration >= 0){
+            std::cout << "\nBest image:\t\titeration " << bestIteration << ", -log L = " << bestLogLike << "\n";
+            image->A_v->Reset();
+            image->A_v->Add(bestA_v);
+        }
+
+        delete previousA_v;
+    }
+    if (isActiveSetUsed){
+        std::cout << "\nActive voxels:\t\t" << activeVoxels.size() << " of " << image->numberOfVoxels << "\n";
+    }
+    if (numberOfLineSearches > 0){
+        std::cout << "\nMean step length:\t" << sumOfStepLengths / numberOfLineSearches << "\n";
+    }
     std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
 
     image->A_v->Scale(1.0 / image->A_v->Integral());
@@ -231,16 +337,334 @@ void ReconstructionMLEM::start(const Int_t maxNumberOfIterations){
 }
 
 // ##### PREPARATION FUNCTIONS #####
-void ReconstructionMLEM::createProjections(){
-    // create the 3D histogram for the forward projection
+void ReconstructionMLEM::createCompactSystemMatrix(){
+    // restrict the measurement space to the elements with counts, empty elements (e.g. d = c) never
+    // contribute to the likelihood, and the system matrix is masked to the measured elements anyway
+    // the histograms of the system matrix are released afterwards
 
     Int_t numberOfDetectors = measurementData->numberOfDetectors;
     Int_t numberOfBins = measurementData->numberOfBins;
 
-    projections = new TH3F("projections", "Projections",
-                           numberOfDetectors, 0, numberOfDetectors,
-                           numberOfDetectors, 0, numberOfDetectors,
-                           numberOfBins, 0, numberOfBins);
+    std::vector<Int_t> bins;  // of the measured elements in the 3D histograms
+    for (Int_t d = 1; d <= numberOfDetectors; ++d){
+        for (Int_t c = 1; c <= numberOfDetectors; ++c){
+            for (Int_t bin = 1; bin <= numberOfBins; ++bin){
+
+                Double_t N_dcbBinContent = measurementData->N_dcb->GetBinContent(d, c, bin);
+                if (N_dcbBinContent != 0){
+                    measuredElements.push_back(Utilities::getElementIndex(d - 1, c - 1, bin - 1, numberOfDetectors, numberOfBins));
+                    measuredCounts.push_back(N_dcbBinContent);
+                    bins.push_back(measurementData->N_dcb->GetBin(d, c, bin));
+                }
+            }
+        }
+    }
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    Int_t numberOfVoxels = systemMatrixData->systemMatrix->GetSize();
+    LargeFloatArray p_vm(numberOfVoxels * numberOfMeasuredElements, 0);
+
+    Int_t v = 0;
+    TIter next(systemMatrixData->systemMatrix);
+    TH3F* p_dcb;
+    while ((p_dcb = (TH3F*)next())){
+        Float_t* p_m = &p_vm[v * numberOfMeasuredElements];
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            p_m[m] = p_dcb->GetBinContent(bins[m]);
+        }
+        ++v;
+    }
+    compactSystemMatrix.store(p_vm, measuredElements, numberOfBins);
+    LargeArrays::report(compactSystemMatrix.getData(), compactSystemMatrix.getNumberOfBytes(), "System matrix");
+
+    systemMatrixData->systemMatrix->Delete();
+    delete systemMatrixData->systemMatrix;
+    systemMatrixData->systemMatrix = nullptr;
+
+    projections.assign(numberOfMeasuredElements, 0.0);
+    frozenProjections.assign(numberOfMeasuredElements, 0.0);
+    directionProjections.assign(numberOfMeasuredElements, 0.0);
+}
+
+void ReconstructionMLEM::rebinMeasuredElements(const Int_t factor, std::vector<UInt_t>& elements,
+                                               std::vector<Double_t>& counts, CompactSystemMatrix& systemMatrix) const{
+    // merge factor neighbouring energy bins of the measured elements, in the compact space
+    // the measured elements are in ascending order, so are the rebinned ones
+
+    Int_t numberOfBins = measurementData->numberOfBins;
+    Int_t numberOfRebinnedBins = numberOfBins / factor;
+    size_t numberOfMeasuredElements = measuredElements.size();
+
+    elements.clear();
+    counts.clear();
+    std::vector<UInt_t> rebinnedElementOfElement(numberOfMeasuredElements);
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        UInt_t pair = measuredElements[m] / numberOfBins;
+        UInt_t bin = measuredElements[m] % numberOfBins;
+        UInt_t element = pair * numberOfRebinnedBins + bin / factor;
+
+        if (elements.empty() || (elements.back() != element)){
+            elements.push_back(element);
+            counts.push_back(0);
+        }
+        counts.back() += measuredCounts[m];
+        rebinnedElementOfElement[m] = elements.size() - 1;
+    }
+
+    size_t numberOfRebinnedElements = elements.size();
+    Int_t numberOfVoxels = systemMatrixData->sensitivities.size();
+    LargeFloatArray p_vm(numberOfVoxels * numberOfRebinnedElements, 0);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* p_m = compactSystemMatrix.getRow(v);
+        Float_t* rebinnedP_m = &p_vm[v * numberOfRebinnedElements];
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            rebinnedP_m[rebinnedElementOfElement[m]] += p_m[m];
+        }
+    }
+
+    systemMatrix.setPrecision(compactSystemMatrix.getPrecision(), compactSystemMatrix.getScaling());
+    systemMatrix.store(p_vm, elements, numberOfRebinnedBins);
+}
+
+void ReconstructionMLEM::refreshActiveSet(){
+    // all voxels with activity are active again, the frozen voxels are released
+
+    activeVoxels.clear();
+    iterationsWithoutChange.assign(image->numberOfVoxels, 0);
+    frozenProjections.assign(measuredElements.size(), 0.0);
+
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+
+        // multiplicative updates: a voxel at zero stays at zero
+        if (!isActiveSetUsed || (image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]) > 0)){
+            activeVoxels.push_back(v);
+        }
+    }
+}
+
+ImageSpace* ReconstructionMLEM::createCoarseLevel(const ImageSpace* fineImage,
+                                                  std::vector<Int_t>& coarseVoxelOfFineVoxel) const{
+    // image space with 2x2(x2) voxels of fineImage merged, z is only merged with more than one layer
+
+    Int_t factorZ = (fineImage->numberOfBinsZ > 1) ? 2 : 1;
+    std::array<Int_t, 3> coarseSize = {{ (fineImage->numberOfBinsX + 1) / 2 - 1,
+                                         (fineImage->numberOfBinsY + 1) / 2 - 1,
+                                         (fineImage->numberOfBinsZ + factorZ - 1) / factorZ - 1 }};
+
+    std::vector<Int_t> coarseNumberOfFineVoxel(fineImage->numberOfVoxels);
+    for (Int_t v = 0; v < fineImage->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = fineImage->imageIndices.at(v);
+
+        // same voxel order as ImageSpace::setImageIndices
+        Int_t x = (coordinate[0] - 1) / 2;
+        Int_t y = (coordinate[1] - 1) / 2;
+        Int_t z = (coordinate[2] - 1) / factorZ;
+        coarseNumberOfFineVoxel[v] = x + (coarseSize[0] + 1) * (y + (coarseSize[1] + 1) * z);
+    }
+
+    // with a region of interest, only the coarse voxels containing fine voxels belong to the coarse level
+    std::vector<Int_t> coarseVoxels(coarseNumberOfFineVoxel);
+    std::sort(coarseVoxels.begin(), coarseVoxels.end());
+    coarseVoxels.erase(std::unique(coarseVoxels.begin(), coarseVoxels.end()), coarseVoxels.end());
+
+    // the coarse histogram must not replace A_v in the current directory
+    Bool_t addDirectory = TH1::AddDirectoryStatus();
+    TH1::AddDirectory(kFALSE);
+    ImageSpace* coarseImage = new ImageSpace(fineImage->imageVolume, coarseSize, coarseVoxels);
+    TH1::AddDirectory(addDirectory);
+
+    coarseVoxelOfFineVoxel.resize(fineImage->numberOfVoxels);
+    for (Int_t v = 0; v < fineImage->numberOfVoxels; ++v){
+        coarseVoxelOfFineVoxel[v] = std::lower_bound(coarseVoxels.begin(), coarseVoxels.end(), coarseNumberOfFineVoxel[v])
+                                    - coarseVoxels.begin();
+    }
+
+    return coarseImage;
+}
+
+// ##### MULTI-RESOLUTION FUNCTIONS #####
+void ReconstructionMLEM::reconstructCoarseLevels(){
+    // reconstruct on coarser voxel grids first, every level continues from the upsampled image of the coarser one
+    // the system matrix of a coarse voxel is the sum of its fine voxels, so copying the activity
+    // of a coarse voxel into its fine voxels keeps the forward projection
+
+    TBenchmark b;
+
+    // level 0 is the full resolution, its system matrix stays in compactSystemMatrix
+    size_t numberOfMeasuredElements = measuredElements.size();
+    std::vector<ImageSpace*> images = { image };
+    std::vector<CompactSystemMatrix> systemMatrices(1);
+    std::vector<std::vector<Double_t> > sensitivities = { systemMatrixData->sensitivities };
+    std::vector<std::vector<Int_t> > coarseVoxels(1);  // [level]: voxel of this level for each voxel of the finer level
+
+    b.Start("pyramid");
+    for (Int_t level = 1; level < numberOfResolutionLevels; ++level){
+        const ImageSpace* fineImage = images.back();
+        if ((fineImage->numberOfBinsX == 1) && (fineImage->numberOfBinsY == 1) && (fineImage->numberOfBinsZ == 1)){
+            break;  // nothing left to merge
+        }
+
+        std::vector<Int_t> coarseVoxelOfFineVoxel;
+        ImageSpace* coarseImage = createCoarseLevel(fineImage, coarseVoxelOfFineVoxel);
+
+        const CompactSystemMatrix& fineSystemMatrix = (level == 1) ? compactSystemMatrix : systemMatrices.back();
+        LargeFloatArray systemMatrix(coarseImage->numberOfVoxels * numberOfMeasuredElements, 0);
+        std::vector<Double_t> sensitivitiesOfLevel(coarseImage->numberOfVoxels, 0.0);
+        for (Int_t v = 0; v < fineImage->numberOfVoxels; ++v){
+            Int_t coarseVoxel = coarseVoxelOfFineVoxel[v];
+
+            const Float_t* p_m = fineSystemMatrix.getRow(v);
+            Float_t* coarseP_m = &systemMatrix[coarseVoxel * numberOfMeasuredElements];
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                coarseP_m[m] += p_m[m];
+            }
+            sensitivitiesOfLevel[coarseVoxel] += sensitivities.back()[v];
+        }
+
+        images.push_back(coarseImage);
+        systemMatrices.push_back(CompactSystemMatrix());
+        systemMatrices.back().setPrecision(compactSystemMatrix.getPrecision(), compactSystemMatrix.getScaling());
+        systemMatrices.back().store(systemMatrix, measuredElements, measurementData->numberOfBins);
+        if (compactSystemMatrix.getPrecision() != CompactSystemMatrix::float32){
+            sensitivitiesOfLevel = systemMatrices.back().getSensitivities();  // of the stored rows, as the other levels
+        }
+        sensitivities.push_back(sensitivitiesOfLevel);
+        coarseVoxels.push_back(coarseVoxelOfFineVoxel);
+    }
+    b.Stop("pyramid");
+
+    Int_t coarsestLevel = images.size() - 1;
+    if (coarsestLevel == 0){
+        return;
+    }
+
+    std::cout << "\nPyramid Creation Time:\t" << b.GetRealTime("pyramid") << " s\n";
+
+    // the coarsest level starts from the mean activity of the merged voxels of the current image
+    for (Int_t level = 1; level <= coarsestLevel; ++level){
+        std::vector<Double_t> sumOfActivities(images[level]->numberOfVoxels, 0.0);
+        std::vector<Int_t> numberOfMergedVoxels(images[level]->numberOfVoxels, 0);
+        for (Int_t v = 0; v < images[level - 1]->numberOfVoxels; ++v){
+            std::array<Int_t, 3> coordinate = images[level - 1]->imageIndices.at(v);
+            sumOfActivities[coarseVoxels[level][v]] += images[level - 1]->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
+            ++numberOfMergedVoxels[coarseVoxels[level][v]];
+        }
+
+        for (Int_t v = 0; v < images[level]->numberOfVoxels; ++v){
+            std::array<Int_t, 3> coordinate = images[level]->imageIndices.at(v);
+            images[level]->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2],
+                                              sumOfActivities[v] / numberOfMergedVoxels[v]);
+        }
+    }
+
+    for (Int_t level = coarsestLevel; level >= 0; --level){
+        if (level < coarsestLevel){
+            // upsample the image of the coarser level
+            for (Int_t v = 0; v < images[level]->numberOfVoxels; ++v){
+                std::array<Int_t, 3> coordinate = images[level]->imageIndices.at(v);
+                std::array<Int_t, 3> coarseCoordinate = images[level + 1]->imageIndices.at(coarseVoxels[level + 1][v]);
+
+                images[level]->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2],
+                                                  images[level + 1]->A_v->GetBinContent(coarseCoordinate[0],
+                                                                                        coarseCoordinate[1],
+                                                                                        coarseCoordinate[2]));
+            }
+        }
+
+        if (level == 0){
+            break;  // full resolution is continued by start()
+        }
+
+        // swap the level in
+        image = images[level];
+        std::swap(compactSystemMatrix, systemMatrices[level]);
+        std::swap(systemMatrixData->sensitivities, sensitivities[level]);
+
+        b.Start("level");
+        refreshActiveSet();
+        iterationsSinceFullProjection = -1;
+        for (Int_t n = 0; (n < iterationsPerLevel) && !isBeyondDeadline(0); ++n){
+            calculate();
+        }
+        b.Stop("level");
+
+        std::cout << "\nLevel " << level << " (" << image->numberOfVoxels << " voxels):\t"
+                  << iterationsPerLevel << " iterations, -log L = " << calculateLogLike()
+                  << ", " << b.GetRealTime("level") << " s\n";
+
+        // swap the level out
+        std::swap(compactSystemMatrix, systemMatrices[level]);
+        std::swap(systemMatrixData->sensitivities, sensitivities[level]);
+    }
+
+    image = images[0];
+
+    for (Int_t level = 1; level <= coarsestLevel; ++level){
+        delete images[level];
+    }
+}
+
+void ReconstructionMLEM::reconstructCoarseEnergyStages(){
+    // iterate with rebinned spectra first, the measured elements and the system matrix are rebinned in memory
+    // the image is shared by all stages, only the measurement side changes
+
+    TBenchmark b;
+
+    Int_t numberOfBins = measurementData->numberOfBins;
+    for (UInt_t stage = 0; stage < energyRebinningFactors.size(); ++stage){
+        Int_t factor = energyRebinningFactors[stage];
+        if (!Utilities::isRebinningPossible(numberOfBins, factor)){
+            continue;
+        }
+
+        b.Start("stage");
+
+        // rebinned measurement, system matrix and projections
+        std::vector<UInt_t> elements;
+        std::vector<Double_t> counts;
+        CompactSystemMatrix systemMatrix;
+        rebinMeasuredElements(factor, elements, counts, systemMatrix);
+
+        std::vector<Double_t> rebinnedProjections(elements.size(), 0.0);
+        std::vector<Double_t> rebinnedFrozenProjections(elements.size(), 0.0);
+        std::vector<Double_t> rebinnedDirectionProjections(elements.size(), 0.0);
+
+        // the sensitivities of the stored rows, rebinning keeps the sums only in float32
+        std::vector<Double_t> sensitivitiesOfStage = systemMatrixData->sensitivities;
+        if (systemMatrix.getPrecision() != CompactSystemMatrix::float32){
+            sensitivitiesOfStage = systemMatrix.getSensitivities();
+        }
+
+        // swap the stage in
+        std::swap(systemMatrixData->sensitivities, sensitivitiesOfStage);
+        std::swap(measuredElements, elements);
+        std::swap(measuredCounts, counts);
+        std::swap(compactSystemMatrix, systemMatrix);
+        std::swap(projections, rebinnedProjections);
+        std::swap(frozenProjections, rebinnedFrozenProjections);
+        std::swap(directionProjections, rebinnedDirectionProjections);
+
+        refreshActiveSet();
+        iterationsSinceFullProjection = -1;
+        for (Int_t n = 0; (n < iterationsPerEnergyStage) && !isBeyondDeadline(0); ++n){
+            calculate();
+        }
+        Double_t logLike = calculateLogLike();
+
+        // swap the stage out
+        std::swap(systemMatrixData->sensitivities, sensitivitiesOfStage);
+        std::swap(measuredElements, elements);
+        std::swap(measuredCounts, counts);
+        std::swap(compactSystemMatrix, systemMatrix);
+        std::swap(projections, rebinnedProjections);
+        std::swap(frozenProjections, rebinnedFrozenProjections);
+        std::swap(directionProjections, rebinnedDirectionProjections);
+        b.Stop("stage");
+
+        std::cout << "\nEnergy stage " << numberOfBins / factor << " bins:\t" << iterationsPerEnergyStage
+                  << " iterations, -log L = " << logLike << ", " << b.GetRealTime("stage") << " s\n";
+    }
 }
 
 // ##### CALCULATION FUNCTIONS #####
@@ -248,84 +672,256 @@ void ReconstructionMLEM::calculate(){
     // execute the maximum likelihood expectation maximization algorithm
     // to calculate the activity distribution A (=A_v)
 
-    // calculate the projection
-    projection();
+    // calculate the projection, in delta and line search mode only when it is due
+    // line search always recalculates periodically, its projections are only followed linearly
+    Int_t interval = fullProjectionInterval;
+    if (isLineSearchUsed && (interval <= 0)){
+        interval = lineSearchProjectionInterval;
+    }
+
+    if ((!isDeltaProjectionUsed && !isLineSearchUsed) || (iterationsSinceFullProjection < 0)
+        || ((interval > 0) && (iterationsSinceFullProjection >= interval))){
+
+        projection();
+        iterationsSinceFullProjection = 0;
+    }
 
     // calculate the backprojection
     backprojection();
+    ++iterationsSinceFullProjection;
 }
 
 void ReconstructionMLEM::projection(){
-    // calculates the forward projections
+    // calculates the forward projections, frozen voxels contribute through frozenProjections
 
-    projections->Reset();
-    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+    if (isActiveSetUsed){
+        projections = frozenProjections;
+    } else{
+        projections.assign(measuredElements.size(), 0.0);
+    }
+
+    for (UInt_t i = 0; i < activeVoxels.size(); ++i){
+        Int_t v = activeVoxels[i];
 
         std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
         Double_t activityInVoxel = image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
 
-        TH3F* p_dcb = (TH3F*)systemMatrixData->systemMatrix->At(v);
-        projections->Add(p_dcb, activityInVoxel);
+        addProjection(projections, v, activityInVoxel);
+    }
+}
+
+void ReconstructionMLEM::addProjection(std::vector<Double_t>& projection, const Int_t v, const Double_t activityInVoxel) const{
+    // add the forward projection of one voxel with the given activity
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    const Float_t* p_m = compactSystemMatrix.getRow(v);
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        projection[m] += activityInVoxel * p_m[m];
     }
 }
 
 void ReconstructionMLEM::backprojection(){
     // create TH3 for activity correction factors
 
-    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+    projectionUpdates.clear();
+    if (isLineSearchUsed){
+        directions.assign(activeVoxels.size(), 0.0);
+    }
+
+    // N_dcb / projection of the measured elements, the same for all voxels
+    size_t numberOfMeasuredElements = measuredElements.size();
+    std::vector<Double_t> ratios(numberOfMeasuredElements, 0.0);
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        if (projections[m] != 0){
+            ratios[m] = measuredCounts[m] / projections[m];
+        }
+    }
+
+    UInt_t numberOfActiveVoxels = 0;
+    for (UInt_t i = 0; i < activeVoxels.size(); ++i){
+        Int_t v = activeVoxels[i];
 
         std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
         Double_t activityInVoxel = image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
 
-        TH3F* p_dcbPrime = (TH3F*)systemMatrixData->p_dcbvPrime->At(v);
+        const Float_t* p_m = compactSystemMatrix.getRow(v);
 
         Double_t correctionFactor = 0.0;
-        for (Int_t d = 1; d <= measurementData->numberOfDetectors; ++d){
-            for (Int_t c = 1; c <= measurementData->numberOfDetectors; ++c){
-                for (Int_t bin = 1; bin <= measurementData->numberOfBins; ++bin){
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            correctionFactor += p_m[m] * ratios[m];
+        }
 
-                    Double_t N_dcbPrimeBinContent = projections->GetBinContent(d, c, bin);
-                    if (N_dcbPrimeBinContent != 0){
+        correctionFactor = correctionFactor / systemMatrixData->sensitivities[v];
+        // line search needs the plain EM step, the only one guaranteed not to increase -log L
+        if (!isLineSearchUsed){
+            correctionFactor = std::pow(correctionFactor, accelerator);
+        }
 
-                        Double_t p_dcbPrimeBinContent = p_dcbPrime->GetBinContent(d, c, bin);
-                        if (p_dcbPrimeBinContent != 0){
+        if (isLineSearchUsed){
+            directions[i] = (correctionFactor - 1) * activityInVoxel;
+            continue;
+        }
 
-                            correctionFactor += p_dcbPrimeBinContent / N_dcbPrimeBinContent;
-                        }
-                    }
-                }
+        if (isDeltaProjectionUsed && (std::abs(correctionFactor - 1) > deltaThreshold)){
+            projectionUpdates.push_back(std::make_pair(v, (correctionFactor - 1) * activityInVoxel));
+        }
+
+        activityInVoxel *= correctionFactor;
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], activityInVoxel);
+
+        if (updateActiveSet(v, correctionFactor, activityInVoxel)){
+            activeVoxels[numberOfActiveVoxels++] = v;
+        }
+    }
+
+    if (isLineSearchUsed){
+        lineSearch();
+        return;
+    }
+
+    activeVoxels.resize(numberOfActiveVoxels);
+
+    // delta projection for the next iteration, the projections above were needed unchanged until now
+    for (UInt_t i = 0; i < projectionUpdates.size(); ++i){
+        addProjection(projections, projectionUpdates[i].first, projectionUpdates[i].second);
+    }
+}
+
+Bool_t ReconstructionMLEM::updateActiveSet(const Int_t v, const Double_t correctionFactor, const Double_t activityInVoxel){
+    // keep track of unchanged voxels, returns kFALSE if the voxel leaves the active set
+
+    if (!isActiveSetUsed){
+        return kTRUE;
+    }
+
+    if (std::abs(correctionFactor - 1) <= freezeTolerance){
+        ++iterationsWithoutChange[v];
+    } else{
+        iterationsWithoutChange[v] = 0;
+    }
+
+    if (!(activityInVoxel > 0)){
+        return kFALSE;  // dead voxel, dropped
+    }
+
+    if ((freezeTolerance > 0) && (iterationsWithoutChange[v] >= freezeIterations)){
+        addProjection(frozenProjections, v, activityInVoxel);
+        return kFALSE;  // frozen voxel, dropped until the next refresh
+    }
+
+    return kTRUE;
+}
+
+void ReconstructionMLEM::lineSearch(){
+    // over-relaxed EM: move along the EM step as far as -log L keeps decreasing
+    // -log L is convex along the step and the projections are linear in the step length,
+    // so it is minimized with Newton's method on the projections alone (no additional projection)
+
+    // projection of the EM step, the step length is limited to non-negative activities
+    Double_t maximumStep = maximumStepLength;
+    directionProjections.assign(measuredElements.size(), 0.0);
+    for (UInt_t i = 0; i < activeVoxels.size(); ++i){
+        if (directions[i] != 0){
+            Int_t v = activeVoxels[i];
+            addProjection(directionProjections, v, directions[i]);
+
+            if (directions[i] < 0){
+                std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+                Double_t activityInVoxel = image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
+                maximumStep = std::min(maximumStep, -activityInVoxel / directions[i]);
             }
         }
+    }
 
-        correctionFactor = correctionFactor / systemMatrixData->sensitivities[v];
-        correctionFactor = std::pow(correctionFactor, accelerator);
+    // keep a margin to zero activity, but never below the plain EM step
+    maximumStep = std::max(1.0, 0.9 * maximumStep);
+
+    // the measured elements
+    const std::vector<Double_t>& N = measuredCounts;
+    const std::vector<Double_t>& P = projections;
+    const std::vector<Double_t>& dP = directionProjections;
+
+    // Newton's method on the step length, starting at the EM step
+    Double_t stepLength = 1.0;
+    for (Int_t n = 0; n < 20; ++n){
+        Double_t gradient = 0.0;
+        Double_t curvature = 0.0;
+        for (UInt_t m = 0; m < N.size(); ++m){
+            Double_t projectionBinContent = P[m] + stepLength * dP[m];
+            gradient += dP[m];
+            if ((N[m] != 0) && (projectionBinContent > 0)){
+                gradient -= N[m] * dP[m] / projectionBinContent;
+                curvature += N[m] * dP[m] * dP[m] / (projectionBinContent * projectionBinContent);
+            }
+        }
 
-        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2],
-                                  correctionFactor * activityInVoxel);
+        if (!(curvature > 0)){
+            break;
+        }
+
+        Double_t nextStepLength = std::min(maximumStep, std::max(1.0, stepLength - gradient / curvature));
+        if (std::abs(nextStepLength - stepLength) < 1e-6 * stepLength){
+            stepLength = nextStepLength;
+            break;
+        }
+        stepLength = nextStepLength;
+    }
+
+    // safeguard: fall back to the EM step, which never increases -log L (the exponent is not applied in line search mode)
+    Double_t change = 0.0;
+    for (UInt_t m = 0; m < N.size(); ++m){
+        Double_t projectionAtStep = P[m] + stepLength * dP[m];
+        Double_t projectionAtEM = P[m] + dP[m];
+        change += (stepLength - 1) * dP[m];
+        if (N[m] != 0){
+            if (!(projectionAtStep > 0) || !(projectionAtEM > 0)){
+                change = 1.0;
+                break;
+            }
+            change -= N[m] * std::log(projectionAtStep / projectionAtEM);
+        }
+    }
+    if (!(change <= 0)){
+        stepLength = 1.0;
+    }
+
+    sumOfStepLengths += stepLength;
+    ++numberOfLineSearches;
+
+    // update the image and, linearly, the projections
+    UInt_t numberOfActiveVoxels = 0;
+    for (UInt_t i = 0; i < activeVoxels.size(); ++i){
+        Int_t v = activeVoxels[i];
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        Double_t activityInVoxel = image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
+
+        Double_t newActivity = std::max(0.0, activityInVoxel + stepLength * directions[i]);
+        Double_t correctionFactor = (activityInVoxel > 0) ? newActivity / activityInVoxel : 0.0;
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], newActivity);
+
+        if (updateActiveSet(v, correctionFactor, newActivity)){
+            activeVoxels[numberOfActiveVoxels++] = v;
+        }
+    }
+
+    activeVoxels.resize(numberOfActiveVoxels);
+    for (size_t m = 0; m < projections.size(); ++m){
+        projections[m] += stepLength * directionProjections[m];
     }
 }
 
 Double_t ReconstructionMLEM::calculateChiSquare(){
     // Calculate the Chi Square Statistics
 
+    // the system matrix is masked to the measured elements, so all others have no projection
     Double_t ChiSquareTestVariable = 0.0;
-    for (Int_t d = 1; d <= measurementData->numberOfDetectors; ++d){
-        for (Int_t c = 1; c <= measurementData->numberOfDetectors; ++c){
-            for (Int_t bin = 1; bin <= measurementData->numberOfBins; ++bin){
-
-                Double_t projectionBinContent = projections->GetBinContent(d, c, bin);
-                if (projectionBinContent != 0){
+    for (size_t m = 0; m < measuredElements.size(); ++m){
 
-                    Double_t N_dcbBinContent = measurementData->N_dcb->GetBinContent(d, c, bin);
-                    if (N_dcbBinContent != 0){
+        Double_t projectionBinContent = projections[m];
+        if (projectionBinContent != 0){
 
-                        ChiSquareTestVariable += std::pow(N_dcbBinContent - projectionBinContent, 2) / projectionBinContent;
-                    } else{
-
-                        ChiSquareTestVariable += projectionBinContent;
-                    }
-                }
-            }
+            Double_t N_dcbBinContent = measuredCounts[m];
+            ChiSquareTestVariable += std::pow(N_dcbBinContent - projectionBinContent, 2) / projectionBinContent;
         }
     }
 
@@ -336,19 +932,388 @@ Double_t ReconstructionMLEM::calculateLogLike(){
     // Calculate the Log-Likelihood-Function
 
     Double_t LogLike = 0.0;
-    for (Int_t d = 1; d <= measurementData->numberOfDetectors; ++d){
-        for (Int_t c = 1; c <= measurementData->numberOfDetectors; ++c){
-            for (Int_t bin = 1; bin <= measurementData->numberOfBins; ++bin){
+    for (size_t m = 0; m < measuredElements.size(); ++m){
 
-                Double_t projectionBinContent = projections->GetBinContent(d, c, bin);
-                if (projectionBinContent != 0){
+        Double_t projectionBinContent = projections[m];
+        if (projectionBinContent != 0){
 
-                    Double_t N_dcbBinContent = measurementData->N_dcb->GetBinContent(d, c, bin);
-                    Double_t summand = projectionBinContent - N_dcbBinContent * std::log(projectionBinContent);
+            Double_t N_dcbBinContent = measuredCounts[m];
+            Double_t summand = projectionBinContent - N_dcbBinContent * std::log(projectionBinContent);
 
-                    LogLike += summand;
-                }
+            LogLike += summand;
+        }
+    }
+
+    return LogLike;
+}
+
+// ##### TIME BUDGET FUNCTIONS #####
+Double_t ReconstructionMLEM::getElapsedTime() const{
+    // wall clock time since the construction, in s
+
+    return std::chrono::duration<Double_t>(std::chrono::steady_clock::now() - timeOfConstruction).count();
+}
+
+Bool_t ReconstructionMLEM::isBeyondDeadline(const Double_t timeOfNextStep) const{
+    // kTRUE if a step of the given duration would not finish within the time budget
+
+    return (timeBudget > 0) && (getElapsedTime() + timeOfNextStep > timeBudget);
+}
+
+// ##### CHECKPOINT FUNCTIONS #####
+void ReconstructionMLEM::writeCheckpoint(){
+    // write image and statistics atomically: a complete temporary file replaces the previous checkpoint
+
+    if (pathToCheckpoint.Length() == 0){
+        return;
+    }
+
+    TString pathToTemporary = pathToCheckpoint + ".tmp";
+    TFile* file = new TFile(pathToTemporary, "RECREATE");
+    if (!file->IsOpen()){
+        std::cout << "Checkpoint " << pathToTemporary << " could not be written.\n";
+        delete file;
+        return;
+    }
+
+    file->cd();
+    Bool_t isWritten = !file->IsZombie() && (image->A_v->Write("A_v") > 0);
+
+    TParameter<Int_t> iterations("iterations", completedIterations);
+    isWritten = (iterations.Write() > 0) && isWritten;
+
+    if (!chiSquareXaxis.empty()){
+        TGraph chiSquare(chiSquareXaxis.size(), &chiSquareXaxis[0], &chiSquareYaxis[0]);
+        isWritten = (chiSquare.Write("chiSquare") > 0) && isWritten;
+
+        TGraph logLike(logLikeXaxis.size(), &logLikeXaxis[0], &logLikeYaxis[0]);
+        isWritten = (logLike.Write("logLike") > 0) && isWritten;
+    }
+
+    file->Close();
+    isWritten = isWritten && !file->TestBit(TFile::kWriteError);
+    delete file;
+
+    // on disk before it replaces the previous checkpoint, a full disk must not leave a truncated one
+    Int_t fileDescriptor = open(pathToTemporary.Data(), O_RDONLY);
+    isWritten = isWritten && (fileDescriptor >= 0) && (fsync(fileDescriptor) == 0);
+    if (fileDescriptor >= 0){
+        close(fileDescriptor);
+    }
+
+    if (!isWritten || (std::rename(pathToTemporary.Data(), pathToCheckpoint.Data()) != 0)){
+        std::cout << "Checkpoint " << pathToCheckpoint << " could not be written.\n";
+    }
+}
+
+Bool_t ReconstructionMLEM::resume(const TString path){
+    // restore image and statistics from a checkpoint, start() then continues the iterations
+    // the image is taken as it is, so the iterations continue exactly where they stopped
+
+    if (!loadImage(path)){
+        return kFALSE;
+    }
+
+    TFile* file = new TFile(path, "READ");
+
+    TParameter<Int_t>* iterations = (TParameter<Int_t>*)file->Get("iterations");
+    if (iterations){
+        completedIterations = iterations->GetVal();
+        delete iterations;
+    }
+
+    chiSquareXaxis.clear();
+    chiSquareYaxis.clear();
+    TGraph* chiSquare = (TGraph*)file->Get("chiSquare");
+    if (chiSquare){
+        chiSquareXaxis.assign(chiSquare->GetX(), chiSquare->GetX() + chiSquare->GetN());
+        chiSquareYaxis.assign(chiSquare->GetY(), chiSquare->GetY() + chiSquare->GetN());
+        delete chiSquare;
+    }
+
+    logLikeXaxis.clear();
+    logLikeYaxis.clear();
+    TGraph* logLike = (TGraph*)file->Get("logLike");
+    if (logLike){
+        logLikeXaxis.assign(logLike->GetX(), logLike->GetX() + logLike->GetN());
+        logLikeYaxis.assign(logLike->GetY(), logLike->GetY() + logLike->GetN());
+        delete logLike;
+    }
+
+    file->Close();
+    delete file;
+
+    pathToCheckpoint = path;
+    std::cout << "\nResuming after " << completedIterations << " iterations.\n";
+    return kTRUE;
+}
+
+void ReconstructionMLEM::setActiveSet(const Double_t tolerance, const Int_t iterationsToFreeze, const Int_t interval){
+    // skip voxels at zero and voxels whose correction factor stayed close to 1 in projection and backprojection
+    // tolerance = 0: only voxels at zero are dropped, which does not change the result
+
+    isActiveSetUsed = kTRUE;
+    freezeTolerance = tolerance;
+    freezeIterations = std::max(1, iterationsToFreeze);
+    refreshInterval = interval;
+}
+
+void ReconstructionMLEM::setDeltaProjection(const Double_t threshold, const Int_t interval){
+    // update the projections incrementally, only with voxels that changed noticeably
+    // interval: full recalculation every interval iterations bounds the accumulated error
+
+    isDeltaProjectionUsed = kTRUE;
+    deltaThreshold = threshold;
+    fullProjectionInterval = interval;
+}
+
+Bool_t ReconstructionMLEM::warmStart(const TString pathToImage){
+    // start from the image "A_v" of a previous reconstruction instead of a homogeneous image
+
+    if (!loadImage(pathToImage)){
+        return kFALSE;
+    }
+
+    Double_t sumOfActivities = 0.0;
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        sumOfActivities += image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]);
+    }
+
+    if (sumOfActivities <= 0){
+        std::cout << "Image in " << pathToImage << " is empty, starting from a homogeneous image.\n";
+        image->makeA_vHomogeneous();
+        sumOfActivities = image->numberOfVoxels;
+    }
+
+    // ML-EM updates are multiplicative, voxels at zero could never recover
+    Double_t minimumActivity = 1e-6 * sumOfActivities / image->numberOfVoxels;
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        if (image->A_v->GetBinContent(coordinate[0], coordinate[1], coordinate[2]) < minimumActivity){
+            image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], minimumActivity);
+        }
+    }
+
+    return kTRUE;
+}
+
+Bool_t ReconstructionMLEM::loadImage(const TString pathToImage){
+    // copy the image "A_v" of a file into the current image
+    // the image may have a different binning (e.g. coarser run), it is sampled at the voxel centers
+
+    TFile* file = new TFile(pathToImage, "READ");
+    TH3F* previousA_v = file->IsOpen() ? (TH3F*)file->Get("A_v") : nullptr;
+    if (!previousA_v){
+        std::cout << "No image A_v found in " << pathToImage << "\n";
+        delete file;
+        return kFALSE;
+    }
+
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+
+        Double_t x = image->A_v->GetXaxis()->GetBinCenter(coordinate[0]);
+        Double_t y = image->A_v->GetYaxis()->GetBinCenter(coordinate[1]);
+        Double_t z = image->A_v->GetZaxis()->GetBinCenter(coordinate[2]);
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2],
+                                  previousA_v->GetBinContent(previousA_v->FindBin(x, y, z)));
+    }
+
+    delete previousA_v;
+    file->Close();
+    delete file;
+
+    return kTRUE;
+}
+
+void ReconstructionMLEM::setStoragePrecision(const CompactSystemMatrix::Precision precision,
+                                             const CompactSystemMatrix::Scaling scaling,
+                                             const Int_t validationIterations){
+    // store the system matrix in reduced precision, compared with full precision if validationIterations > 0
+    // call before start(), coarse levels and energy stages are derived in the same precision
+
+    if (!isCalculationValid){
+        return;
+    }
+
+    Int_t numberOfBins = measurementData->numberOfBins;
+    size_t numberOfMeasuredElements = measuredElements.size();
+    size_t fullNumberOfBytes = size_t(compactSystemMatrix.getNumberOfVoxels()) * numberOfMeasuredElements * sizeof(Float_t);
+
+    // the float32 rows are moved out, not copied
+    LargeFloatArray p_vm;
+    compactSystemMatrix.release(p_vm);
+
+    // for the validation, the full precision matrix is kept and the reduced one is encoded from it row by row,
+    // so there is never more than one float32 copy
+    CompactSystemMatrix fullSystemMatrix;
+    std::vector<Double_t> fullSensitivities(systemMatrixData->sensitivities);
+    Bool_t isFullSystemMatrixKept = (validationIterations > 0) && (precision != CompactSystemMatrix::float32);
+
+    compactSystemMatrix.setPrecision(precision, scaling);
+    if (isFullSystemMatrixKept){
+        fullSystemMatrix.store(p_vm, measuredElements, numberOfBins);
+        compactSystemMatrix.store(fullSystemMatrix, measuredElements, numberOfBins);
+    } else{
+        compactSystemMatrix.store(p_vm, measuredElements, numberOfBins);
+    }
+
+    // the sensitivities have to match the stored probabilities, otherwise the fixed point of ML-EM shifts
+    if (precision != CompactSystemMatrix::float32){
+        systemMatrixData->sensitivities = compactSystemMatrix.getSensitivities();
+    }
+
+    std::cout << "\nSystem matrix storage:\t" << compactSystemMatrix.getDescription() << ", "
+              << compactSystemMatrix.getNumberOfBytes() / (1024.0 * 1024.0) << " MB (float32: "
+              << fullNumberOfBytes / (1024.0 * 1024.0) << " MB)\n";
+    LargeArrays::report(compactSystemMatrix.getData(), compactSystemMatrix.getNumberOfBytes(), "System matrix");
+
+    if (validationIterations > 0){
+        validateStoragePrecision(isFullSystemMatrixKept ? fullSystemMatrix : compactSystemMatrix, fullSensitivities, validationIterations);
+    }
+}
+
+// ##### STORAGE PRECISION FUNCTIONS #####
+void ReconstructionMLEM::validateStoragePrecision(const CompactSystemMatrix& fullSystemMatrix,
+                                                  const std::vector<Double_t>& fullSensitivities,
+                                                  const Int_t numberOfIterations) const{
+    // error of the stored probabilities and of the image reconstructed with them, both against float32
+
+    TBenchmark b;
+    b.Start("validation");
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    Int_t numberOfVoxels = fullSystemMatrix.getNumberOfVoxels();
+
+    // probabilities, relative to the largest one
+    Double_t sumOfSquares = 0;
+    Double_t sumOfSquaredErrors = 0;
+    Double_t largestProbability = 0;
+    Double_t largestError = 0;
+    std::vector<Float_t> fullRow, storedRow;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        const Float_t* fullP_m = fullSystemMatrix.getRow(v, fullRow);
+        const Float_t* storedP_m = compactSystemMatrix.getRow(v, storedRow);
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            Double_t error = storedP_m[m] - fullP_m[m];
+            sumOfSquares += Double_t(fullP_m[m]) * fullP_m[m];
+            sumOfSquaredErrors += error * error;
+            largestProbability = std::max(largestProbability, Double_t(fullP_m[m]));
+            largestError = std::max(largestError, std::abs(error));
+        }
+    }
+
+    // images after the same number of plain ML-EM iterations from a homogeneous image, normalized
+    std::vector<Double_t> fullImage = reconstructWith(fullSystemMatrix, fullSensitivities, numberOfIterations);
+    std::vector<Double_t> storedImage = reconstructWith(compactSystemMatrix, systemMatrixData->sensitivities, numberOfIterations);
+
+    Double_t fullSum = 0;
+    Double_t storedSum = 0;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        fullSum += fullImage[v];
+        storedSum += storedImage[v];
+    }
+
+    Double_t imageSumOfSquares = 0;
+    Double_t imageSumOfSquaredErrors = 0;
+    Double_t largestActivity = 0;
+    Double_t largestImageError = 0;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        Double_t fullActivity = (fullSum > 0) ? fullImage[v] / fullSum : 0;
+        Double_t error = ((storedSum > 0) ? storedImage[v] / storedSum : 0) - fullActivity;
+        imageSumOfSquares += fullActivity * fullActivity;
+        imageSumOfSquaredErrors += error * error;
+        largestActivity = std::max(largestActivity, fullActivity);
+        largestImageError = std::max(largestImageError, std::abs(error));
+    }
+
+    // both images judged by the full precision model
+    Double_t fullLogLike = calculateLogLikeOfImage(fullSystemMatrix, fullImage);
+    Double_t storedLogLike = calculateLogLikeOfImage(fullSystemMatrix, storedImage);
+    b.Stop("validation");
+
+    std::cout << "\nSTORAGE PRECISION VALIDATION (" << compactSystemMatrix.getDescription() << " against float32)\n";
+    std::cout << "\nProbabilities:\t\trelative RMS error " << std::sqrt(sumOfSquaredErrors / sumOfSquares)
+              << ", largest error " << largestError / largestProbability << " of the largest probability\n";
+    std::cout << "\nImage (" << numberOfIterations << " iterations):\trelative RMS error "
+              << std::sqrt(imageSumOfSquaredErrors / imageSumOfSquares)
+              << ", largest error " << largestImageError / largestActivity << " of the largest activity\n";
+    std::cout << "\n-log L:\t\t\t" << storedLogLike << " (float32: " << fullLogLike << ", difference "
+              << storedLogLike - fullLogLike << ")\n";
+    std::cout << "\nValidation Time:\t" << b.GetRealTime("validation") << " s\n";
+}
+
+std::vector<Double_t> ReconstructionMLEM::reconstructWith(const CompactSystemMatrix& systemMatrix,
+                                                          const std::vector<Double_t>& sensitivities,
+                                                          const Int_t numberOfIterations) const{
+    // plain ML-EM from a homogeneous image, independent of the image of this reconstruction
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    Int_t numberOfVoxels = systemMatrix.getNumberOfVoxels();
+
+    std::vector<Double_t> activities(numberOfVoxels, 0.0);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        activities[v] = (sensitivities[v] > 0) ? 1.0 : 0.0;
+    }
+
+    std::vector<Double_t> projection(numberOfMeasuredElements);
+    std::vector<Double_t> ratios(numberOfMeasuredElements);
+    for (Int_t n = 0; n < numberOfIterations; ++n){
+        projection.assign(numberOfMeasuredElements, 0.0);
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            const Float_t* p_m = systemMatrix.getRow(v);
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                projection[m] += activities[v] * p_m[m];
+            }
+        }
+
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            ratios[m] = (projection[m] != 0) ? measuredCounts[m] / projection[m] : 0.0;
+        }
+
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            if (!(activities[v] > 0)){
+                continue;
+            }
+
+            const Float_t* p_m = systemMatrix.getRow(v);
+            Double_t correctionFactor = 0.0;
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                correctionFactor += p_m[m] * ratios[m];
             }
+            activities[v] *= correctionFactor / sensitivities[v];
+        }
+    }
+
+    return activities;
+}
+
+Double_t ReconstructionMLEM::calculateLogLikeOfImage(const CompactSystemMatrix& systemMatrix,
+                                                     const std::vector<Double_t>& activities) const{
+    // -log L of the given activities (scaled to the measured counts)
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    std::vector<Double_t> projection(numberOfMeasuredElements, 0.0);
+    for (Int_t v = 0; v < systemMatrix.getNumberOfVoxels(); ++v){
+        const Float_t* p_m = systemMatrix.getRow(v);
+        for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+            projection[m] += activities[v] * p_m[m];
+        }
+    }
+
+    Double_t sumOfProjections = 0;
+    Double_t sumOfCounts = 0;
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        sumOfProjections += projection[m];
+        sumOfCounts += measuredCounts[m];
+    }
+
+    Double_t LogLike = 0.0;
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        Double_t expected = (sumOfProjections > 0) ? projection[m] * sumOfCounts / sumOfProjections : 0;
+        if (expected > 0){
+            LogLike += expected - measuredCounts[m] * std::log(expected);
         }
     }
 
@@ -1,6 +1,7 @@
 // mlem.h
 
 #pragma once
+#include <chrono>
 #include <TH2.h>
 #include <TH3.h>
 #include <TBenchmark.h>
@@ -11,11 +12,18 @@
 #include "systemmatrix.h"
 #include "measurements.h"
 #include "utilities.h"
+#include "compactmatrix.h"
 
 // It should always be kFALSE
 // kTRUE will probably never work with noise or real measurements
 const Bool_t normalizeSpectra = kFALSE;
 
+// upper limit of the step length along the EM step in line search mode (1 = plain EM step)
+const Double_t maximumStepLength = 100.0;
+
+// full projection in line search mode when no interval is set, bounds the drift of the linearly followed projections
+const Int_t lineSearchProjectionInterval = 10;
+
 // ##### RESULTS #####
 class ResultsMLEM{
 public:
@@ -43,29 +51,123 @@ class ReconstructionMLEM{
 public:
     ReconstructionMLEM(const TString pathToMeasurements,
                        const TString pathToProjections,
-                       const std::vector<Double_t> volume);
+                       const std::vector<Double_t> volume,
+                       const Selection& selection = Selection(),
+                       const RegionOfInterest& regionOfInterest = RegionOfInterest());
     ~ReconstructionMLEM();
 
     void start(const Int_t maxNumberOfIterations);
-    void setAccelerator(const Double_t a){accelerator = a;}
+    void setAccelerator(const Double_t a){accelerator = a;}  // not applied in line search mode
+    void setCheckpoint(const TString path, const Int_t interval){pathToCheckpoint = path; checkpointInterval = interval;}
+    Bool_t resume(const TString path);
+    Bool_t warmStart(const TString pathToImage);
+    void setActiveSet(const Double_t tolerance, const Int_t iterationsToFreeze, const Int_t interval);
+    void setDeltaProjection(const Double_t threshold, const Int_t interval);
+    void setMultiResolution(const Int_t levels, const Int_t iterations){numberOfResolutionLevels = levels; iterationsPerLevel = iterations;}
+    void setLineSearch(const Bool_t l){isLineSearchUsed = l;}
+    void setTimeBudget(const Double_t seconds){timeBudget = seconds;}
+    void setEnergySchedule(const std::vector<Int_t> factors, const Int_t iterations){energyRebinningFactors = factors; iterationsPerEnergyStage = iterations;}
+    void setStoragePrecision(const CompactSystemMatrix::Precision precision, const CompactSystemMatrix::Scaling scaling,
+                             const Int_t validationIterations);
 
 private:
     // ##### PREPARATION FUNCTIONS #####
-    void createProjections();
+    void createCompactSystemMatrix();
+    void rebinMeasuredElements(const Int_t factor, std::vector<UInt_t>& elements,
+                               std::vector<Double_t>& counts, CompactSystemMatrix& systemMatrix) const;
+    void refreshActiveSet();
+    ImageSpace* createCoarseLevel(const ImageSpace* fineImage, std::vector<Int_t>& coarseVoxelOfFineVoxel) const;
+
+    // ##### MULTI-RESOLUTION FUNCTIONS #####
+    void reconstructCoarseLevels();
+    void reconstructCoarseEnergyStages();
 
     // ##### CALCULATION FUNCTIONS #####
     void calculate();
     void projection();
     void backprojection();
+    void addProjection(std::vector<Double_t>& projection, const Int_t v, const Double_t activityInVoxel) const;
+    Bool_t updateActiveSet(const Int_t v, const Double_t correctionFactor, const Double_t activityInVoxel);
+    void lineSearch();
 
     Double_t calculateChiSquare();
     Double_t calculateLogLike();
 
+    // ##### STORAGE PRECISION FUNCTIONS #####
+    void validateStoragePrecision(const CompactSystemMatrix& fullSystemMatrix, const std::vector<Double_t>& fullSensitivities,
+                                  const Int_t numberOfIterations) const;
+    std::vector<Double_t> reconstructWith(const CompactSystemMatrix& systemMatrix, const std::vector<Double_t>& sensitivities,
+                                          const Int_t numberOfIterations) const;
+    Double_t calculateLogLikeOfImage(const CompactSystemMatrix& systemMatrix, const std::vector<Double_t>& activities) const;
+
+    // ##### TIME BUDGET FUNCTIONS #####
+    Double_t getElapsedTime() const;
+    Bool_t isBeyondDeadline(const Double_t timeOfNextStep) const;
+
+    // ##### CHECKPOINT FUNCTIONS #####
+    void writeCheckpoint();
+    Bool_t loadImage(const TString pathToImage);  // A_v as it is, without the floor of warmStart()
+
     // ##### MEMBERS #####
     Bool_t isCalculationValid;
     Double_t accelerator;
 
-    TH3F* projections = nullptr;
+    // progress of the reconstruction, restored when resuming
+    Int_t completedIterations;
+    std::vector<Double_t> chiSquareXaxis;
+    std::vector<Double_t> chiSquareYaxis;
+    std::vector<Double_t> logLikeXaxis;
+    std::vector<Double_t> logLikeYaxis;
+
+    TString pathToCheckpoint;   // empty: no checkpoints
+    Int_t checkpointInterval;   // in iterations
+
+    // time budget: wall clock time from the construction (loading included) until the image is ready
+    std::chrono::steady_clock::time_point timeOfConstruction;
+    Double_t timeBudget;        // in s, 0 = no limit
+
+    // active set: voxels at zero are dropped, voxels with a correction factor within
+    // 1 +- freezeTolerance for freezeIterations iterations are frozen until the next refresh
+    Bool_t isActiveSetUsed;
+    Double_t freezeTolerance;
+    Int_t freezeIterations;
+    Int_t refreshInterval;                      // in iterations, 0 = never
+    std::vector<Int_t> activeVoxels;
+    std::vector<Int_t> iterationsWithoutChange;  // of each voxel
+
+    // delta projection: the projections are updated with (A_new - A_old) * p_dcbv of the voxels
+    // whose correction factor differs from 1 by more than deltaThreshold, fully recalculated every fullProjectionInterval
+    Bool_t isDeltaProjectionUsed;
+    Double_t deltaThreshold;
+    Int_t fullProjectionInterval;               // in iterations, 0 = never (lineSearchProjectionInterval in line search mode)
+    Int_t iterationsSinceFullProjection;        // < 0: projections do not belong to the current image
+    std::vector<std::pair<Int_t, Double_t> > projectionUpdates;  // voxel, change of activity
+
+    // multi-resolution: levels with 2x2(x2) voxels merged, the coarsest level starts from the current image
+    Int_t numberOfResolutionLevels;             // 1 = full resolution only
+    Int_t iterationsPerLevel;                   // on every coarse level
+
+    // line search: the step A_v -> A_v + alpha * (EM step) minimizes -log L for alpha in [1, maximumStepLength],
+    // alpha is limited to non-negative activities, the projections follow linearly
+    Bool_t isLineSearchUsed;
+    std::vector<Double_t> directions;          // EM step of each active voxel
+    Double_t sumOfStepLengths;
+    Int_t numberOfLineSearches;
+
+    // energy schedule: first stages with factor neighbouring energy bins of N_dcb and p_dcbv merged
+    std::vector<Int_t> energyRebinningFactors;  // in the order of the stages, e.g. 4, 2
+    Int_t iterationsPerEnergyStage;
+
+    // compact measurement space: only the elements with counts, the kernels never touch the empty ones
+    std::vector<UInt_t> measuredElements;       // in ascending order, see Utilities::getElementIndex
+    std::vector<Double_t> measuredCounts;       // N_dcb of each measured element
+    CompactSystemMatrix compactSystemMatrix;    // voxel after voxel, p_dcbv of the measured elements
+
+    // forward projections of the measured elements
+    std::vector<Double_t> projections;
+    std::vector<Double_t> frozenProjections;    // of the frozen voxels
+    std::vector<Double_t> directionProjections; // of the EM step
+    TH3F* bestA_v = nullptr;                    // image with the lowest -log L so far, time budget only
 
     Measurements* measurementData = nullptr;
     SystemMatrix* systemMatrixData = nullptr;
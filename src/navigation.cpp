@@ -3,10 +3,22 @@
 #include "navigation.h"
 #include "user_prompts.h"
 #include "mlem.h"
+#include "batchmlem.h"
+#include "bootstrap.h"
+#include "sweep.h"
+#include "online.h"
+#include "dynamic.h"
+#include "listmode.h"
+#include "coincidence.h"
+#include "outofcore.h"
 #include "oe.h"
+#include "selection.h"
+#include "roi.h"
 
 TString pathToSystemMatrix;
+RegionOfInterest regionOfInterest;
 TString pathToMeasurements;
+Selection selection;
 
 // ##### MAIN MENU #####
 MainMenu::MainMenu(){
@@ -46,13 +58,17 @@ SystemMatrixMenu::SystemMatrixMenu(){
     std::string title("\nSYSTEM MATRIX MENU\n");
     std::string option1("1 - Back\n");
     std::string option2("2 - Choose System Matrix (*.root)\n");
+    std::string option3("3 - Choose System Matrix (*.root) with a Region of Interest\n");
+    std::string option4("4 - Choose System Matrix (*.root) shared in memory with other processes\n");
 
-    messageText = title + option1 + option2;
+    messageText = title + option1 + option2 + option3 + option4;
 }
 
 TemplateMenu* SystemMatrixMenu::getNextMenu(bool& isQuitOptionSelected){
     // prompt user for system matrix
 
+    std::vector<double> box, voxels;
+
     TemplateMenu* nextMenu = nullptr;
     switch (promptChoice()){
         case 1:
@@ -61,6 +77,38 @@ TemplateMenu* SystemMatrixMenu::getNextMenu(bool& isQuitOptionSelected){
 
         case 2:
             pathToSystemMatrix = promptPath("TYPE PATH TO SYSTEM MATRIX: ");
+            regionOfInterest = RegionOfInterest();
+            SystemMatrix::setArraySharing(kFALSE);
+            nextMenu = new MeasurementsMenu();
+            break;
+
+        case 3:
+            pathToSystemMatrix = promptPath("TYPE PATH TO SYSTEM MATRIX: ");
+            regionOfInterest = RegionOfInterest();
+            SystemMatrix::setArraySharing(kFALSE);
+
+            // voxels outside are not loaded at all, a voxel has to meet all given criteria
+            box = promptList("BOX IN MM (xMin,xMax,yMin,yMax,zMin,zMax; 0 = NO BOX): ", -1e9, 1e9);
+            if (box.size() == 6){
+                regionOfInterest.setBox(box);
+            }
+
+            voxels = promptList("VOXEL NUMBERS (e.g. 154,155,156; -1 = NO LIST): ", -1, 1e9);
+            if (voxels[0] >= 0){
+                regionOfInterest.setVoxels(std::vector<Int_t>(voxels.begin(), voxels.end()));
+            }
+
+            regionOfInterest.setSensitivityThreshold(promptParameter("SENSITIVITY THRESHOLD RELATIVE TO THE MOST SENSITIVE VOXEL (0 = NONE): ", 0.0, 1.0));
+
+            nextMenu = new MeasurementsMenu();
+            break;
+
+        case 4:
+            // the first process loads the array (batched, bootstrap, sweep, dynamic, list-mode and online ML-EM),
+            // all further processes on this node attach to it
+            pathToSystemMatrix = promptPath("TYPE PATH TO SYSTEM MATRIX: ");
+            regionOfInterest = RegionOfInterest();
+            SystemMatrix::setArraySharing(kTRUE);
             nextMenu = new MeasurementsMenu();
             break;
 
@@ -78,13 +126,18 @@ MeasurementsMenu::MeasurementsMenu(){
     std::string title("\nMEASUREMENTS MENU\n");
     std::string option1("1 - Back\n");
     std::string option2("2 - Choose Measurements (*.root)\n");
+    std::string option3("3 - Choose Measurements (*.root) with a Subset of Dies, Pairs and Energies\n");
 
-    messageText = title + option1 + option2;
+    messageText = title + option1 + option2 + option3;
 }
 
 TemplateMenu* MeasurementsMenu::getNextMenu(bool& isQuitOptionSelected){
     // prompt user for measurements file
 
+    std::vector<double> dies;
+    TString pathToMask;
+    double minimumEnergy, maximumEnergy;
+
     TemplateMenu* nextMenu = nullptr;
     switch (promptChoice()){
         case 1:
@@ -92,7 +145,37 @@ TemplateMenu* MeasurementsMenu::getNextMenu(bool& isQuitOptionSelected){
             break;
 
         case 2:
-            pathToMeasurements = promptPath("TYPE PATH TO MEASUREMENTS: ");
+            pathToMeasurements = promptPath("TYPE PATH TO MEASUREMENTS (SPECTRA OR LIST-MODE EVENTS): ");
+            selection = Selection();
+            nextMenu = new AlgorithMenu();
+            break;
+
+        case 3:
+            pathToMeasurements = promptPath("TYPE PATH TO MEASUREMENTS (SPECTRA OR LIST-MODE EVENTS): ");
+            selection = Selection();
+
+            // excluded spectra are not read at all, neither of the measurements nor of the system matrix
+            dies = promptList("DIES TO USE (e.g. 0,1,4,5; -1 = ALL): ", -1, 1e4);
+            if (dies[0] >= 0){
+                selection.setDies(std::vector<Int_t>(dies.begin(), dies.end()));
+            }
+
+            std::cout << "TYPE PATH TO PAIR MASK (TEXT FILE, ONE PAIR \"d c\" PER LINE; 0 = ALL PAIRS): ";
+            std::cin >> pathToMask;
+            if ((pathToMask != "0") && !selection.readPairMask(pathToMask)){
+                break;
+            }
+
+            minimumEnergy = promptParameter("LOWER END OF THE ENERGY WINDOW (IN UNITS OF THE SPECTRA): ", -1e9, 1e9);
+            maximumEnergy = promptParameter("UPPER END OF THE ENERGY WINDOW (<= LOWER END = FULL RANGE): ", -1e9, 1e9);
+            selection.setEnergyWindow(minimumEnergy, maximumEnergy);
+
+            // a window between two bin centers would leave no energy bin to reconstruct
+            if (SystemMatrix(pathToSystemMatrix, selection).numberOfBins <= 0){
+                std::cout << "The energy window contains no bin center of the spectra.\n";
+                break;
+            }
+
             nextMenu = new AlgorithMenu();
             break;
 
@@ -146,17 +229,43 @@ MLEMMenu::MLEMMenu(){
     std::string option1("1 - Back\n");
     std::string option2("2 - Use standard settings\n");
     std::string option3("3 - Advanced\n");
-
-    messageText = title + option1 + option2 + option3;
+    std::string option4("4 - Resume from MLEM_Checkpoint.root\n");
+    std::string option5("5 - Warm start from a previous image (*.root)\n");
+    std::string option6("6 - Batch reconstruction of several measurements\n");
+    std::string option7("7 - Bootstrap uncertainty of the image\n");
+    std::string option8("8 - Sweep over accelerators, iterations and subsets\n");
+    std::string option9("9 - Time budget (as many iterations as fit)\n");
+    std::string option10("10 - Online, while new spectra keep arriving\n");
+    std::string option11("11 - Dynamic, series of time frames\n");
+    std::string option12("12 - List-mode events\n");
+    std::string option13("13 - Coincidences from raw hits (list-mode file or online reconstruction)\n");
+    std::string option14("14 - Out-of-core (system matrix streamed from disk)\n");
+    std::string option15("15 - Reduced-precision system matrix (validated against float32)\n");
+
+    messageText = title + option1 + option2 + option3 + option4 + option5 + option6 + option7 + option8 + option9
+                  + option10 + option11 + option12 + option13 + option14 + option15;
 }
 
 TemplateMenu* MLEMMenu::getNextMenu(bool& isQuitOptionSelected){
     // prompt user for measurements file
 
     TBenchmark b;
-    int iterations;
-    double accelerator;
+    int iterations, interval, replicas, freezeIterations, levels, window, stride, precision, scaling, validationIterations, action;
+    double accelerator, tolerance, budget, duration, startOfWindow, endOfWindow;
+    double coincidenceWindow, hitThreshold, minimumSum, maximumSum;
+    bool isLineSearchUsed;
+    TString pathToImage, pathToEvents;
+    std::vector<TString> pathsToMeasurements;
+    std::vector<double> accelerators, tolerances, listOfIterations, listOfSubsets, factors;
     ReconstructionMLEM* reco = nullptr;
+    ReconstructionBatchMLEM* batchReco = nullptr;
+    ReconstructionBootstrapMLEM* bootstrapReco = nullptr;
+    ReconstructionSweepMLEM* sweepReco = nullptr;
+    ReconstructionOnlineMLEM* onlineReco = nullptr;
+    ReconstructionDynamicMLEM* dynamicReco = nullptr;
+    ReconstructionListModeMLEM* listModeReco = nullptr;
+    CoincidenceSorter* sorter = nullptr;
+    ReconstructionOutOfCoreMLEM* outOfCoreReco = nullptr;
 
     TemplateMenu* nextMenu = nullptr;
     switch (promptChoice()){
@@ -169,11 +278,15 @@ TemplateMenu* MLEMMenu::getNextMenu(bool& isQuitOptionSelected){
 
             reco = new ReconstructionMLEM(pathToMeasurements,
                                           pathToSystemMatrix,
-                                          {-52.5, 52.5, -52.5, 52.5, 5, 10});
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
             accelerator = 1.9;
             reco->setAccelerator(accelerator);
 
             iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            interval = promptChoice("CHECKPOINT INTERVAL IN ITERATIONS (0 = ONLY AT THE END): ");
+            reco->setCheckpoint("MLEM_Checkpoint.root", interval);
             reco->start(iterations);
 
             b.Stop("totalMLEM");
@@ -187,7 +300,405 @@ TemplateMenu* MLEMMenu::getNextMenu(bool& isQuitOptionSelected){
 
             reco = new ReconstructionMLEM(pathToMeasurements,
                                           pathToSystemMatrix,
-                                          {-52.5, 52.5, -52.5, 52.5, 5, 10});
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
+
+            // line search replaces the exponent, it needs the plain EM step
+            isLineSearchUsed = (promptChoice("LINE SEARCH ON -LOG L ALONG THE EM STEP (0 = NO, 1 = YES): ") == 1);
+            reco->setLineSearch(isLineSearchUsed);
+            if (!isLineSearchUsed){
+                accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+                reco->setAccelerator(accelerator);
+            }
+
+            if (promptChoice("SKIP ZERO AND CONVERGED VOXELS (0 = NO, 1 = YES): ") == 1){
+                tolerance = promptParameter("FREEZE VOXELS WITH |CORRECTION - 1| BELOW ( 0 = ONLY ZERO VOXELS ): ", 0.0, 1.0);
+                freezeIterations = promptChoice("... FOR NUMBER OF ITERATIONS: ");
+                interval = promptChoice("RELEASE FROZEN VOXELS EVERY NUMBER OF ITERATIONS (0 = NEVER): ");
+                reco->setActiveSet(tolerance, freezeIterations, interval);
+            }
+
+            if (promptChoice("UPDATE PROJECTIONS INCREMENTALLY (0 = NO, 1 = YES): ") == 1){
+                tolerance = promptParameter("SKIP VOXELS WITH |CORRECTION - 1| BELOW: ", 0.0, 1.0);
+                interval = promptChoice("FULL PROJECTION EVERY NUMBER OF ITERATIONS (0 = NEVER, 10 WITH LINE SEARCH): ");
+                reco->setDeltaProjection(tolerance, interval);
+            }
+
+            factors = promptList("ENERGY REBINNING FACTORS OF THE FIRST STAGES (e.g. 4,2; 1 = NONE): ", 1, 1e3);
+            if (factors[0] > 1){
+                reco->setEnergySchedule(std::vector<Int_t>(factors.begin(), factors.end()),
+                                        promptChoice("ITERATIONS ON EACH ENERGY STAGE: "));
+            }
+
+            levels = promptChoice("NUMBER OF RESOLUTION LEVELS (1 = ONLY FULL RESOLUTION): ");
+            if (levels > 1){
+                reco->setMultiResolution(levels, promptChoice("ITERATIONS ON EACH COARSE LEVEL: "));
+            }
+
+            iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            interval = promptChoice("CHECKPOINT INTERVAL IN ITERATIONS (0 = ONLY AT THE END): ");
+            reco->setCheckpoint("MLEM_Checkpoint.root", interval);
+            reco->start(iterations);
+
+            b.Stop("totalMLEM2");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM2") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 4:
+            b.Start("totalMLEM3");
+
+            reco = new ReconstructionMLEM(pathToMeasurements,
+                                          pathToSystemMatrix,
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
+
+            if (reco->resume("MLEM_Checkpoint.root")){
+                accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+                reco->setAccelerator(accelerator);
+
+                // a number larger than in the checkpoint adds iterations
+                iterations = promptChoice("TOTAL NUMBER OF ITERATIONS: ");
+                interval = promptChoice("CHECKPOINT INTERVAL IN ITERATIONS (0 = ONLY AT THE END): ");
+                reco->setCheckpoint("MLEM_Checkpoint.root", interval);
+                reco->start(iterations);
+            }
+
+            b.Stop("totalMLEM3");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM3") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 5:
+            pathToImage = promptPath("TYPE PATH TO IMAGE (e.g. MLEM_Checkpoint.root of a previous run): ");
+            b.Start("totalMLEM4");
+
+            reco = new ReconstructionMLEM(pathToMeasurements,
+                                          pathToSystemMatrix,
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
+
+            if (reco->warmStart(pathToImage)){
+                accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+                reco->setAccelerator(accelerator);
+
+                iterations = promptChoice("NUMBER OF ITERATIONS: ");
+                interval = promptChoice("CHECKPOINT INTERVAL IN ITERATIONS (0 = ONLY AT THE END): ");
+                reco->setCheckpoint("MLEM_Checkpoint.root", interval);
+                reco->start(iterations);
+            }
+
+            b.Stop("totalMLEM4");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM4") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 6:
+            pathsToMeasurements.push_back(pathToMeasurements);
+            for (int k = promptChoice("NUMBER OF ADDITIONAL MEASUREMENTS: "); k > 0; --k){
+                pathsToMeasurements.push_back(promptPath("TYPE PATH TO MEASUREMENTS: "));
+            }
+
+            b.Start("totalMLEM5");
+
+            batchReco = new ReconstructionBatchMLEM(pathsToMeasurements,
+                                                    pathToSystemMatrix,
+                                                    {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                    selection,
+                                                    regionOfInterest);
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            batchReco->setAccelerator(accelerator);
+
+            iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            batchReco->start(iterations);
+
+            b.Stop("totalMLEM5");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM5") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 7:
+            b.Start("totalMLEM6");
+
+            bootstrapReco = new ReconstructionBootstrapMLEM(pathToMeasurements,
+                                                            pathToSystemMatrix,
+                                                            {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                            selection,
+                                                            regionOfInterest);
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            bootstrapReco->setAccelerator(accelerator);
+
+            replicas = promptChoice("NUMBER OF BOOTSTRAP REPLICAS: ");
+            iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            bootstrapReco->start(replicas, iterations);
+
+            b.Stop("totalMLEM6");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM6") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 8:
+            b.Start("totalMLEM7");
+
+            sweepReco = new ReconstructionSweepMLEM(pathToMeasurements,
+                                                    pathToSystemMatrix,
+                                                    {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                    selection,
+                                                    regionOfInterest);
+
+            if (promptChoice("COMPARE WITH A KNOWN PHANTOM (0 = NO, 1 = YES): ") == 1){
+                sweepReco->setPhantom(promptPath("TYPE PATH TO PHANTOM (*.root with A_v): "));
+            }
+            sweepReco->setSaveImages(promptChoice("SAVE IMAGES (0 = NO, 1 = YES): ") == 1);
+
+            accelerators = promptList("EXPONENTS ( 1 < ... < 2, e.g. 1,1.5,1.9 ): ", 1.0, 2.0);
+            listOfIterations = promptList("NUMBERS OF ITERATIONS (e.g. 10,50,100): ", 1, 1e6);
+            listOfSubsets = promptList("NUMBERS OF SUBSETS (1 = NO SUBSETS): ", 1, 1e3);
+            tolerances = promptList("STOP TOLERANCES OF THE RELATIVE CHANGE OF -LOG L (0 = NONE): ", 0.0, 1.0);
+
+            sweepReco->start(accelerators,
+                             std::vector<Int_t>(listOfIterations.begin(), listOfIterations.end()),
+                             std::vector<Int_t>(listOfSubsets.begin(), listOfSubsets.end()),
+                             tolerances);
+
+            b.Stop("totalMLEM7");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM7") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 9:
+            // everything is asked first, the budget includes loading
+            budget = promptParameter("TIME BUDGET IN SECONDS (LOADING INCLUDED): ", 0.0, 1e9);
+            iterations = promptChoice("MAXIMUM NUMBER OF ITERATIONS: ");
+            isLineSearchUsed = (promptChoice("LINE SEARCH ON -LOG L ALONG THE EM STEP (0 = NO, 1 = YES): ") == 1);
+            b.Start("totalMLEM8");
+
+            reco = new ReconstructionMLEM(pathToMeasurements,
+                                          pathToSystemMatrix,
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
+            reco->setTimeBudget(budget);
+            reco->setLineSearch(isLineSearchUsed);
+            reco->start(iterations);
+
+            b.Stop("totalMLEM8");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM8") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 10:
+            b.Start("totalMLEM9");
+
+            // the measurement holds the counts so far, every block the counts since the previous one
+            onlineReco = new ReconstructionOnlineMLEM(pathToMeasurements,
+                                                      pathToSystemMatrix,
+                                                      {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                      selection,
+                                                      regionOfInterest);
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            onlineReco->setAccelerator(accelerator);
+            onlineReco->setPublishInterval(promptParameter("PUBLISH THE IMAGE EVERY NUMBER OF SECONDS: ", 0.0, 1e9));
+            onlineReco->setIterationsPerUpdate(promptChoice("ITERATIONS AFTER EACH BLOCK (0 = NEVER PAUSE): "));
+            onlineReco->start();
+
+            for (;;){
+                action = promptChoice("1 - ADD BLOCK OF SPECTRA, 2 - ADD LIST-MODE EVENTS, 3 - STOP: ");
+                if (action == 1){
+                    onlineReco->addSpectra(promptPath("TYPE PATH TO SPECTRA: "));
+                } else if (action == 2){
+                    pathToEvents = promptPath("TYPE PATH TO LIST-MODE EVENTS: ");
+                    if (ListModeEvents::isListMode(pathToEvents)){
+                        ListModeEvents events(pathToEvents);
+                        onlineReco->addEvents(events);
+                    } else{
+                        std::cout << "The file holds no list-mode events.\n";
+                    }
+                } else{
+                    break;
+                }
+            }
+            onlineReco->stop();
+
+            b.Stop("totalMLEM9");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM9") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 11:
+            if (ListModeEvents::isListMode(pathToMeasurements)){
+                duration = promptParameter("DURATION OF A TIME SLICE IN SECONDS: ", 0.0, 1e9);
+            } else{
+                // the measurement is not used, the slices are given separately
+                pathsToMeasurements = promptSeries("TYPE PATH PATTERN OF THE TIME SLICES (e.g. slice_%i.root): ",
+                                                   promptChoice("NUMBER OF TIME SLICES: "));
+                if (pathsToMeasurements.empty()){
+                    break;
+                }
+            }
+            window = promptChoice("SLICES PER FRAME: ");
+            stride = promptChoice("SLICES BETWEEN THE STARTS OF TWO FRAMES: ");
+            b.Start("totalMLEM10");
+
+            if (pathsToMeasurements.empty()){
+                dynamicReco = new ReconstructionDynamicMLEM(pathToMeasurements,
+                                                            duration,
+                                                            pathToSystemMatrix,
+                                                            {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                            selection,
+                                                            regionOfInterest);
+            } else{
+                dynamicReco = new ReconstructionDynamicMLEM(pathsToMeasurements,
+                                                            pathToSystemMatrix,
+                                                            {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                            selection,
+                                                            regionOfInterest);
+            }
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            dynamicReco->setAccelerator(accelerator);
+            dynamicReco->setWindow(window, stride);
+
+            iterations = promptChoice("NUMBER OF ITERATIONS OF THE SUMMED SLICES: ");
+            dynamicReco->start(iterations, promptChoice("NUMBER OF ITERATIONS PER FRAME: "));
+
+            b.Stop("totalMLEM10");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM10") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 12:
+            if (!ListModeEvents::isListMode(pathToMeasurements)){
+                std::cout << "The measurements are not list-mode events.\n";
+                nextMenu = new MainMenu();
+                break;
+            }
+
+            b.Start("totalMLEM11");
+
+            listModeReco = new ReconstructionListModeMLEM(pathToMeasurements,
+                                                          pathToSystemMatrix,
+                                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                          selection,
+                                                          regionOfInterest);
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            listModeReco->setAccelerator(accelerator);
+
+            startOfWindow = promptParameter("START OF THE TIME WINDOW IN SECONDS: ", -1e12, 1e12);
+            endOfWindow = promptParameter("END OF THE TIME WINDOW IN SECONDS (<= START: ALL EVENTS): ", -1e12, 1e12);
+            listModeReco->setTimeWindow(startOfWindow, endOfWindow);
+
+            iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            listModeReco->start(iterations);
+
+            b.Stop("totalMLEM11");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM11") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 13:
+            sorter = new CoincidenceSorter(promptPath("TYPE PATH TO RAW HITS (*.root with TTree hits): "));
+
+            coincidenceWindow = promptParameter("COINCIDENCE WINDOW IN NANOSECONDS: ", 0.0, 1e9);
+            hitThreshold = promptParameter("ENERGY THRESHOLD OF A HIT: ", 0.0, 1e9);
+            minimumSum = promptParameter("MINIMUM SUM ENERGY OF A PAIR: ", 0.0, 1e9);
+            maximumSum = promptParameter("MAXIMUM SUM ENERGY OF A PAIR (<= MINIMUM: NONE): ", 0.0, 1e9);
+            sorter->setCoincidenceWindow(coincidenceWindow * 1e-9);
+            sorter->setEnergyThresholds(hitThreshold, minimumSum, maximumSum);
+
+            if (promptChoice("1 - WRITE PAIRS TO Coincidences.root, 2 - RECONSTRUCT ONLINE WHILE SORTING: ") == 1){
+                b.Start("totalMLEM12");
+                sorter->setListModeOutput("Coincidences.root");
+                sorter->start();
+
+            } else{
+                b.Start("totalMLEM12");
+
+                onlineReco = new ReconstructionOnlineMLEM(sorter->numberOfDetectors,
+                                                          pathToSystemMatrix,
+                                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                          selection,
+                                                          regionOfInterest);
+
+                accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+                onlineReco->setAccelerator(accelerator);
+                onlineReco->setPublishInterval(promptParameter("PUBLISH THE IMAGE EVERY NUMBER OF SECONDS: ", 0.0, 1e9));
+                onlineReco->setIterationsPerUpdate(promptChoice("ITERATIONS AFTER EACH BLOCK (0 = NEVER PAUSE): "));
+
+                // the pairs are binned and go straight into the solver
+                sorter->setSelection(selection);
+                sorter->setEnergyAxis(onlineReco->numberOfBins, onlineReco->minimumEnergy, onlineReco->maximumEnergy);
+                sorter->setCountsReceiver([onlineReco](const std::vector<UInt_t>& elements, const std::vector<Double_t>& counts){
+                    onlineReco->addCounts(elements, counts);
+                });
+
+                onlineReco->start();
+                sorter->start();
+                onlineReco->stop();
+            }
+
+            b.Stop("totalMLEM12");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM12") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 14:
+            budget = promptParameter("MEMORY FOR THE SYSTEM MATRIX IN MB: ", 1.0, 1e9);
+
+            b.Start("totalMLEM13");
+
+            outOfCoreReco = new ReconstructionOutOfCoreMLEM(pathToMeasurements,
+                                                            pathToSystemMatrix,
+                                                            {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                                            budget,
+                                                            selection,
+                                                            regionOfInterest);
+
+            accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
+            outOfCoreReco->setAccelerator(accelerator);
+
+            iterations = promptChoice("NUMBER OF ITERATIONS: ");
+            outOfCoreReco->start(iterations);
+
+            b.Stop("totalMLEM13");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM13") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 15:
+            b.Start("totalMLEM14");
+
+            reco = new ReconstructionMLEM(pathToMeasurements,
+                                          pathToSystemMatrix,
+                                          {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                          selection,
+                                          regionOfInterest);
+
+            precision = promptChoice("PRECISION (1 = FLOAT32, 2 = FLOAT16, 3 = BFLOAT16, 4 = 16 BIT, 5 = 8 BIT): ");
+            scaling = promptChoice("SCALE FACTORS (1 = PER VOXEL, 2 = PER DETECTOR PAIR): ");
+            validationIterations = promptChoice("ITERATIONS OF THE VALIDATION AGAINST FLOAT32 (0 = NO VALIDATION): ");
+            reco->setStoragePrecision(CompactSystemMatrix::Precision(std::min(std::max(precision, 1), 5) - 1),
+                                      (scaling == 2) ? CompactSystemMatrix::perPair : CompactSystemMatrix::perVoxel,
+                                      validationIterations);
 
             accelerator = promptParameter("SET THE EXPONENT ( 1 < ... < 2, 1 = NO ACCELERATION: ", 1.0, 2.0);
             reco->setAccelerator(accelerator);
@@ -195,8 +706,8 @@ TemplateMenu* MLEMMenu::getNextMenu(bool& isQuitOptionSelected){
             iterations = promptChoice("NUMBER OF ITERATIONS: ");
             reco->start(iterations);
 
-            b.Stop("totalMLEM2");
-            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM2") << " seconds\n";
+            b.Stop("totalMLEM14");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalMLEM14") << " seconds\n";
 
             nextMenu = new MainMenu();
             break;
@@ -206,6 +717,14 @@ TemplateMenu* MLEMMenu::getNextMenu(bool& isQuitOptionSelected){
     }
 
     isQuitOptionSelected = false;
+    delete outOfCoreReco;
+    delete sorter;
+    delete listModeReco;
+    delete dynamicReco;
+    delete onlineReco;
+    delete sweepReco;
+    delete bootstrapReco;
+    delete batchReco;
     delete reco;
     return nextMenu;
 }
@@ -216,15 +735,22 @@ OEMenu::OEMenu(){
     std::string title("\nORIGIN ENSEMBLE MENU\n");
     std::string option1("1 - Back\n");
     std::string option2("2 - Choose settings\n");
+    std::string option3("3 - Choose settings (Gibbs sampling)\n");
+    std::string option4("4 - Choose settings (store all samples in OE_Samples.oes)\n");
+    std::string option5("5 - Resume from OE_Checkpoint.bin\n");
+    std::string option6("6 - Time budget (as many samples as fit)\n");
 
-    messageText = title + option1 + option2;
+    messageText = title + option1 + option2 + option3 + option4 + option5 + option6;
 }
 
 TemplateMenu* OEMenu::getNextMenu(bool& isQuitOptionSelected){
     // prompt user for measurements file
 
     TBenchmark b;
-    int states, samples;
+    int states, samples, interval;
+    double budget;
+    bool isGibbsSamplingUsed;
+    std::vector<double> factors;
     ReconstructionOE* reco = nullptr;
 
     TemplateMenu* nextMenu = nullptr;
@@ -238,10 +764,20 @@ TemplateMenu* OEMenu::getNextMenu(bool& isQuitOptionSelected){
 
             reco = new ReconstructionOE(pathToMeasurements,
                                         pathToSystemMatrix,
-                                        {-52.5, 52.5, -52.5, 52.5, 5, 10});
+                                        {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                        selection,
+                                        regionOfInterest);
+
+            factors = promptList("ENERGY REBINNING FACTORS OF THE FIRST STAGES (e.g. 4,2; 1 = NONE): ", 1, 1e3);
+            if (factors[0] > 1){
+                reco->setEnergySchedule(std::vector<Int_t>(factors.begin(), factors.end()),
+                                        promptChoice("STATES ON EACH ENERGY STAGE: "));
+            }
 
             states = promptChoice("NUMBER OF STATES TO REACH EQUILIBRIUM: ");
             samples = promptChoice("NUMBER OF SAMPLES IN EQUILIBRIUM: ");
+            interval = promptChoice("CHECKPOINT INTERVAL IN STATES (0 = ONLY AT THE END): ");
+            reco->setCheckpoint("OE_Checkpoint.bin", interval);
             reco->start(states, samples);
 
             b.Stop("totalOE");
@@ -250,6 +786,101 @@ TemplateMenu* OEMenu::getNextMenu(bool& isQuitOptionSelected){
             nextMenu = new MainMenu();
             break;
 
+        case 3:
+            b.Start("totalOE2");
+
+            reco = new ReconstructionOE(pathToMeasurements,
+                                        pathToSystemMatrix,
+                                        {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                        selection,
+                                        regionOfInterest);
+            reco->setGibbsSampling(kTRUE);
+
+            factors = promptList("ENERGY REBINNING FACTORS OF THE FIRST STAGES (e.g. 4,2; 1 = NONE): ", 1, 1e3);
+            if (factors[0] > 1){
+                reco->setEnergySchedule(std::vector<Int_t>(factors.begin(), factors.end()),
+                                        promptChoice("STATES ON EACH ENERGY STAGE: "));
+            }
+
+            states = promptChoice("NUMBER OF STATES TO REACH EQUILIBRIUM: ");
+            samples = promptChoice("NUMBER OF SAMPLES IN EQUILIBRIUM: ");
+            interval = promptChoice("CHECKPOINT INTERVAL IN STATES (0 = ONLY AT THE END): ");
+            reco->setCheckpoint("OE_Checkpoint.bin", interval);
+            reco->start(states, samples);
+
+            b.Stop("totalOE2");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalOE2") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 4:
+            b.Start("totalOE3");
+
+            reco = new ReconstructionOE(pathToMeasurements,
+                                        pathToSystemMatrix,
+                                        {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                        selection,
+                                        regionOfInterest);
+            reco->setSampleStore("OE_Samples.oes");
+
+            states = promptChoice("NUMBER OF STATES TO REACH EQUILIBRIUM: ");
+            samples = promptChoice("NUMBER OF SAMPLES IN EQUILIBRIUM: ");
+            interval = promptChoice("CHECKPOINT INTERVAL IN STATES (0 = ONLY AT THE END): ");
+            reco->setCheckpoint("OE_Checkpoint.bin", interval);
+            reco->start(states, samples);
+
+            b.Stop("totalOE3");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalOE3") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 5:
+            b.Start("totalOE4");
+
+            reco = new ReconstructionOE(pathToMeasurements,
+                                        pathToSystemMatrix,
+                                        {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                        selection,
+                                        regionOfInterest);
+
+            if (reco->resume("OE_Checkpoint.bin")){
+                // numbers larger than in the checkpoint extend the run
+                states = promptChoice("TOTAL NUMBER OF STATES TO REACH EQUILIBRIUM: ");
+                samples = promptChoice("TOTAL NUMBER OF SAMPLES IN EQUILIBRIUM: ");
+                reco->start(states, samples);
+            }
+
+            b.Stop("totalOE4");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalOE4") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
+        case 6:
+            // everything is asked first, the budget includes loading
+            budget = promptParameter("TIME BUDGET IN SECONDS (LOADING INCLUDED): ", 0.0, 1e9);
+            states = promptChoice("MAXIMUM NUMBER OF STATES TO REACH EQUILIBRIUM: ");
+            samples = promptChoice("MAXIMUM NUMBER OF SAMPLES IN EQUILIBRIUM: ");
+            isGibbsSamplingUsed = (promptChoice("GIBBS SAMPLING INSTEAD OF METROPOLIS-HASTINGS (0 = NO, 1 = YES): ") == 1);
+            b.Start("totalOE5");
+
+            reco = new ReconstructionOE(pathToMeasurements,
+                                        pathToSystemMatrix,
+                                        {-52.5, 52.5, -52.5, 52.5, 5, 10},
+                                        selection,
+                                        regionOfInterest);
+            reco->setGibbsSampling(isGibbsSamplingUsed);
+            reco->setTimeBudget(budget);
+            reco->start(states, samples);
+
+            b.Stop("totalOE5");
+            std::cout << "\nTotal Time:\t\t" << b.GetRealTime("totalOE5") << " seconds\n";
+
+            nextMenu = new MainMenu();
+            break;
+
         default:
             break;
     }
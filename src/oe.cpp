@@ -5,6 +5,11 @@
 #include <TGraph.h>
 #include <TStyle.h>
 #include "utilities.h"
+#include "listmode.h"
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
 
 // ##### RESULTS #####
 ResultsOE::ResultsOE(){
@@ -88,36 +93,82 @@ void ResultsOE::plotTransitions(std::vector<Double_t> xAxis, std::vector<Double_
 // ##### RECONSTRUCTION #####
 ReconstructionOE::ReconstructionOE(const TString pathToMeasurements,
                                    const TString pathToProjections,
-                                   const std::vector<Double_t> volume){
+                                   const std::vector<Double_t> volume,
+                                   const Selection& selection,
+                                   const RegionOfInterest& regionOfInterest) :
+    isGibbsSamplingUsed(kFALSE),
+    numberOfSampledStates(0),
+    sampleStoreBytes(-1),
+    completedIterationsForEquilibrium(0),
+    completedIterationsInEquilibrium(0),
+    checkpointInterval(0),
+    timeOfConstruction(std::chrono::steady_clock::now()),
+    timeBudget(0),
+    deadlineForEquilibrium(0),
+    statesPerEnergyStage(0) {
     // prepare data for reconstruction using OE
 
     TBenchmark b;
 
-    // prepare the measurement data
-    b.Start("N_dcb");
-    measurementData = new Measurements(pathToMeasurements);
-    measurementData->createN_dcb();
-    measurementData->fillN_dcb(kFALSE);
-    b.Stop("N_dcb");
+    if (ListModeEvents::isListMode(pathToMeasurements)){
+        // list-mode: the events are taken as they are, no spectra are needed
+        ListModeEvents events(pathToMeasurements);
 
-    // prepare the image & system matrix
-    b.Start("p_dcb");
-    systemMatrixData = new SystemMatrix(pathToProjections);
+        b.Start("p_dcb");
+        systemMatrixData = new SystemMatrix(pathToProjections, selection);
 
-    isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
-                                                             systemMatrixData->numberOfBins);
+        isCalculationValid = (events.numberOfEntries > 0)
+                             && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+        if (isCalculationValid){
+            systemMatrixData->createSystemMatrix(events.numberOfDetectors);
+        }
+        b.Stop("p_dcb");
+
+        b.Start("N_dcb");
+        events.setSelection(selection);
+        events.setEnergyAxis(systemMatrixData->numberOfBins,
+                             systemMatrixData->minimumEnergy,
+                             systemMatrixData->maximumEnergy);
+
+        std::vector<UInt_t> elements;
+        std::vector<Double_t> times;
+        while (events.readChunk(elements, times)){
+            elementsOfEvents.insert(elementsOfEvents.end(), elements.begin(), elements.end());
+        }
+        b.Stop("N_dcb");
+
+        std::cout << "\nEvents:\t\t\t" << elementsOfEvents.size() << " used, " << events.numberOfRejectedEvents << " rejected\n";
+
+    } else{
+        // prepare the measurement data
+        b.Start("N_dcb");
+        measurementData = new Measurements(pathToMeasurements, selection);
+        measurementData->createN_dcb();
+        measurementData->fillN_dcb(kFALSE);
+        b.Stop("N_dcb");
+
+        // prepare the image & system matrix
+        b.Start("p_dcb");
+        systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+        isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
+                                                                 systemMatrixData->numberOfBins)
+                             && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+
+        if (isCalculationValid){
+            systemMatrixData->createSystemMatrix(measurementData->numberOfDetectors);
+        }
+        b.Stop("p_dcb");
+    }
 
-    if (isCalculationValid){
-        systemMatrixData->createSystemMatrix(measurementData->numberOfDetectors);
+    if (isCalculationValid && regionOfInterest.isUsed()){
+        dropEventsOutsideRegion();
     }
-    b.Stop("p_dcb");
 
     b.Start("A_v");
-    image = new ImageSpace(volume, systemMatrixData->size);
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
     b.Stop("A_v");
 
-    countsInVoxelsOfStates.reserve(10000);  // reserve enough memory for at least 10000 states
-
     std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
     std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
     std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
@@ -140,12 +191,29 @@ void ReconstructionOE::start(const Int_t numberOfIterationsForEquilibirum, const
 
     // step 1: create initial state s_0 by randomly selecting possible origins for the detected events
     b.Start("stats");
-    b.Start("S_0");
-    state = new State(measurementData->N_dcb);
-    std::vector<Int_t> countsInVoxel = state->generateRandomOrigins(image->numberOfVoxels,
-                                                                    systemMatrixData->systemMatrixVector);
-    b.Stop("S_0");
-    std::cout << "\nS_0 Creation Time:\t" << b.GetRealTime("S_0") << " s\n";
+    if (!state){
+        State* rebinnedState = runCoarseEnergyStages();
+
+        b.Start("S_0");
+        state = createState(1);
+        if (rebinnedState){
+            state->inheritOrigins(*rebinnedState, systemMatrixData->systemMatrixVector);
+            delete rebinnedState;
+        } else{
+            state->generateRandomOrigins(image->numberOfVoxels, systemMatrixData->systemMatrixVector);
+        }
+        sumOfCountsInVoxels.assign(image->numberOfVoxels, 0.0);
+        b.Stop("S_0");
+        std::cout << "\nS_0 Creation Time:\t" << b.GetRealTime("S_0") << " s\n";
+
+    } else{
+        std::cout << "\nResuming after " << completedIterationsForEquilibrium << " states to reach equilibrium and "
+                  << completedIterationsInEquilibrium << " states in equilibrium.\n";
+    }
+
+    if (timeBudget > 0){
+        deadlineForEquilibrium = getElapsedTime() + equilibriumShareOfBudget * (timeBudget - getElapsedTime());
+    }
 
     // step 2: generate new states until equilibrium is reached
     b.Start("UntilE");
@@ -160,10 +228,20 @@ void ReconstructionOE::start(const Int_t numberOfIterationsForEquilibirum, const
     std::cout << "\nSampling Time:\t" << b.GetRealTime("InE") << " s\n";
 
     // step 4: calculate "mean state" = mean of counts in each voxel of all sampled states
+    // without any sampled state (time budget), the current state is the best available image
+    if ((numberOfSampledStates == 0) && state){
+        sumOfCountsInVoxels.assign(state->countsInVoxel.begin(), state->countsInVoxel.end());
+        numberOfSampledStates = 1;
+    }
     calculateActivity();
     b.Stop("stats");
 
     std::cout << "\nImage reconstruction done.\n";
+    if (timeBudget > 0){
+        std::cout << "\nStates to reach equilibrium:\t" << completedIterationsForEquilibrium << " of " << numberOfIterationsForEquilibirum << "\n";
+        std::cout << "\nSamples in equilibrium:\t" << completedIterationsInEquilibrium << " of " << numberOfIterationsInEquilibrium << "\n";
+        std::cout << "\nElapsed Time:\t\t" << getElapsedTime() << " of " << timeBudget << " seconds (loading included)\n";
+    }
     std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
 
     // step 5: show results
@@ -175,19 +253,164 @@ void ReconstructionOE::start(const Int_t numberOfIterationsForEquilibirum, const
 }
 
 // ##### CALCULATION FUNCTIONS #####
+void ReconstructionOE::dropEventsOutsideRegion(){
+    // events of measurement elements that no voxel of the region of interest can contribute to
+    // could never get an origin, so they are removed
+
+    const std::vector<std::vector<Float_t> >& systemMatrix = systemMatrixData->systemMatrixVector;
+    UInt_t numberOfElements = systemMatrix.empty() ? 0 : systemMatrix[0].size();
+    std::vector<Bool_t> isElementPossible(numberOfElements, kFALSE);
+    for (UInt_t v = 0; v < systemMatrix.size(); ++v){
+        for (UInt_t element = 0; element < numberOfElements; ++element){
+            if (systemMatrix[v][element] > 0){
+                isElementPossible[element] = kTRUE;
+            }
+        }
+    }
+
+    ULong64_t numberOfDroppedEvents = 0;
+    if (measurementData){
+        Int_t numberOfDetectors = measurementData->numberOfDetectors;
+        Int_t numberOfBins = measurementData->numberOfBins;
+        for (Int_t d = 1; d <= numberOfDetectors; ++d){
+            for (Int_t c = 1; c <= numberOfDetectors; ++c){
+                for (Int_t bin = 1; bin <= numberOfBins; ++bin){
+
+                    UInt_t element = Utilities::getElementIndex(d - 1, c - 1, bin - 1, numberOfDetectors, numberOfBins);
+                    Double_t N_dcbBinContent = measurementData->N_dcb->GetBinContent(d, c, bin);
+                    if ((N_dcbBinContent != 0) && !isElementPossible[element]){
+                        numberOfDroppedEvents += ULong64_t(N_dcbBinContent);
+                        measurementData->N_dcb->SetBinContent(d, c, bin, 0);
+                    }
+                }
+            }
+        }
+
+    } else{
+        UInt_t numberOfKeptEvents = 0;
+        for (UInt_t n = 0; n < elementsOfEvents.size(); ++n){
+            if ((elementsOfEvents[n] < numberOfElements) && isElementPossible[elementsOfEvents[n]]){
+                elementsOfEvents[numberOfKeptEvents++] = elementsOfEvents[n];
+            }
+        }
+
+        numberOfDroppedEvents = elementsOfEvents.size() - numberOfKeptEvents;
+        elementsOfEvents.resize(numberOfKeptEvents);
+    }
+
+    std::cout << "\nEvents outside of the region of interest:\t" << numberOfDroppedEvents << "\n";
+}
+
+State* ReconstructionOE::runCoarseEnergyStages(){
+    // run the chain in rebinned spectra first, each stage continues with the origins of the previous one
+    // returns the last state (owned by the caller) or nullptr if there are no stages
+
+    TBenchmark b;
+
+    State* rebinnedState = nullptr;
+    Int_t numberOfBins = systemMatrixData->numberOfBins;
+    for (UInt_t stage = 0; stage < energyRebinningFactors.size(); ++stage){
+        Int_t factor = energyRebinningFactors[stage];
+        if (!Utilities::isRebinningPossible(numberOfBins, factor)){
+            continue;
+        }
+
+        b.Start("stage");
+
+        // the sensitivities stay the same since rebinning keeps the sums
+        std::vector<std::vector<Float_t> > systemMatrix = Utilities::rebinEnergy(systemMatrixData->systemMatrixVector,
+                                                                                 numberOfBins, factor);
+
+        State* stageState = createState(factor);
+        if (rebinnedState){
+            stageState->inheritOrigins(*rebinnedState, systemMatrix);
+            delete rebinnedState;
+        } else{
+            stageState->generateRandomOrigins(image->numberOfVoxels, systemMatrix);
+        }
+        rebinnedState = stageState;
+
+        // swap the stage in
+        std::swap(state, rebinnedState);
+        std::swap(systemMatrixData->systemMatrixVector, systemMatrix);
+
+        Double_t relTransitions = 0;
+        for (Int_t n = 0; (n < statesPerEnergyStage)
+                          && ((timeBudget == 0) || (getElapsedTime() < equilibriumShareOfBudget * timeBudget)); ++n){
+            nextState(relTransitions);
+        }
+
+        // swap the stage out
+        std::swap(state, rebinnedState);
+        std::swap(systemMatrixData->systemMatrixVector, systemMatrix);
+        b.Stop("stage");
+
+        std::cout << "\nEnergy stage " << numberOfBins / factor << " bins:\t" << statesPerEnergyStage
+                  << " states, rel. transitions " << relTransitions << ", " << b.GetRealTime("stage") << " s\n";
+    }
+
+    return rebinnedState;
+}
+
+State* ReconstructionOE::createState(const Int_t factor) const{
+    // events of the spectra or the list-mode events, with factor neighbouring energy bins merged
+
+    if (measurementData){
+        if (factor == 1){
+            return new State(measurementData->N_dcb);
+        }
+
+        TH3F* N_dcb = Utilities::rebinEnergy(measurementData->N_dcb, factor, "N_dcb_rebinned");
+        State* rebinnedState = new State(N_dcb);
+        delete N_dcb;
+        return rebinnedState;
+    }
+
+    Int_t numberOfBins = systemMatrixData->numberOfBins;
+    std::vector<UInt_t> elements(elementsOfEvents);
+    for (UInt_t n = 0; (factor != 1) && (n < elements.size()); ++n){
+        UInt_t pair = elements[n] / numberOfBins;
+        elements[n] = pair * (numberOfBins / factor) + (elements[n] % numberOfBins) / factor;
+    }
+
+    return new State(elements);
+}
+
+std::vector<Int_t> ReconstructionOE::nextState(Double_t& relTransitions){
+    // generate the next state of the Markov chain with the selected sampler
+
+    if (isGibbsSamplingUsed){
+        return state->GibbsNextState(systemMatrixData->systemMatrixVector,
+                                     systemMatrixData->sensitivities,
+                                     relTransitions);
+    }
+
+    return state->MCMCNextState(systemMatrixData->systemMatrixVector,
+                                systemMatrixData->sensitivities,
+                                relTransitions);
+}
+
 void ReconstructionOE::reachEquilibrium(const Int_t numberOfIterations){
     // generate random states until equilibrium is reached
 
-    std::vector<Double_t> relTransitionsXaxis;
-    std::vector<Double_t> relTransitionsYaxis;
+    Double_t timeOfState = 0;
+    for (Int_t n = completedIterationsForEquilibrium; n < numberOfIterations; ++n){
+        // stop if the next state would exceed the share of the time budget
+        if ((timeBudget > 0) && (getElapsedTime() + timeOfState > deadlineForEquilibrium)){
+            break;
+        }
+        Double_t timeBeforeState = getElapsedTime();
 
-    for (Int_t n = 0; n < numberOfIterations; ++n){
         Double_t relTransitions;
-        std::vector<Int_t> countsInVoxel = state->MCMCNextState(systemMatrixData->systemMatrixVector,
-                                                                systemMatrixData->sensitivities,
-                                                                relTransitions);
+        std::vector<Int_t> countsInVoxel = nextState(relTransitions);
         relTransitionsXaxis.push_back(n + 1);
         relTransitionsYaxis.push_back(relTransitions);
+
+        ++completedIterationsForEquilibrium;
+        timeOfState = getElapsedTime() - timeBeforeState;
+        if ((checkpointInterval > 0) && (completedIterationsForEquilibrium % checkpointInterval == 0)){
+            writeCheckpoint();
+        }
     }
 
     results->plotTransitions(relTransitionsXaxis, relTransitionsYaxis);
@@ -195,32 +418,73 @@ void ReconstructionOE::reachEquilibrium(const Int_t numberOfIterations){
 
 void ReconstructionOE::sampleEquilibriumStates(const Int_t numberOfIterations){
     // generate states in equilibrium
+    // only the running sums of the mean state are kept in memory, the states themselves only in the sample store
+    // after resuming, the store holds only the states sampled since then, the mean state is complete
+
+    if (!pathToSampleStore.empty()){
+        sampleStore = new SampleStoreWriter(pathToSampleStore, image->numberOfVoxels, 1000, sampleStoreBytes);
+    }
+
+    Double_t timeOfState = 0;
+    for (Int_t n = completedIterationsInEquilibrium; n < numberOfIterations; ++n){
+        // stop if the next state would not finish in time, the mean state is complete after every state
+        if ((timeBudget > 0) && (getElapsedTime() + timeOfState > timeBudget)){
+            break;
+        }
+        Double_t timeBeforeState = getElapsedTime();
 
-    for (Int_t n = 0; n < numberOfIterations; ++n){
         Double_t relTransitions;
-        std::vector<Int_t> countsInVoxel = state->MCMCNextState(systemMatrixData->systemMatrixVector,
-                                                                systemMatrixData->sensitivities,
-                                                                relTransitions);
+        std::vector<Int_t> countsInVoxel = nextState(relTransitions);
 
         if (n % 1 == 0){
             // save every state, can be changed according to needs
-            countsInVoxelsOfStates.push_back(countsInVoxel);
+            for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+                sumOfCountsInVoxels[v] += countsInVoxel[v];
+            }
+            ++numberOfSampledStates;
+
+            if (sampleStore){
+                sampleStore->push(countsInVoxel);
+            }
+        }
+
+        ++completedIterationsInEquilibrium;
+        timeOfState = getElapsedTime() - timeBeforeState;
+        if ((checkpointInterval > 0) && (completedIterationsInEquilibrium % checkpointInterval == 0)){
+            writeCheckpoint();
+        }
+
+        // the states would be missing in the store, the mean state is complete up to here
+        if (sampleStore && sampleStore->hasFailed()){
+            std::cout << "\nSampling stopped after " << completedIterationsInEquilibrium << " states in equilibrium.\n";
+            break;
         }
     }
+
+    // the final checkpoint allows to extend the sampling later on
+    writeCheckpoint();
+
+    if (sampleStore){
+        sampleStore->close();
+        if (sampleStore->hasFailed()){
+            std::cout << "\nSample store " << pathToSampleStore << " is incomplete, it ends after "
+                      << sampleStore->getNumberOfBytesWritten() << " bytes\n";
+        } else{
+            std::cout << "\nSamples written to " << pathToSampleStore << ": " << sampleStore->getNumberOfStates()
+                      << " states, " << sampleStore->getNumberOfBytesWritten() << " bytes\n";
+        }
+        delete sampleStore;
+        sampleStore = nullptr;
+    }
 }
 
 void ReconstructionOE::calculateActivity(){
     // calculate the voxel-specific means of the detected counts
 
-    Int_t numberOfStates = countsInVoxelsOfStates.size();
     for (Int_t v = 0; v < image->numberOfVoxels; ++v){
 
         // calculate the mean counts
-        Double_t meanCountsInVoxel = 0.0;
-        for (Int_t c = 0; c < numberOfStates; ++c){
-            meanCountsInVoxel += countsInVoxelsOfStates.at(c).at(v);
-        }
-        meanCountsInVoxel /= numberOfStates;
+        Double_t meanCountsInVoxel = sumOfCountsInVoxels.at(v) / numberOfSampledStates;
 
         // calculate the activity
         Double_t sensitivityOfVoxel = systemMatrixData->sensitivities.at(v);
@@ -234,3 +498,127 @@ void ReconstructionOE::calculateActivity(){
 
     image->A_v->Scale(1.0);  // bug handling to make Project3D work
 }
+
+// ##### TIME BUDGET FUNCTIONS #####
+Double_t ReconstructionOE::getElapsedTime() const{
+    // wall clock time since the construction, in s
+
+    return std::chrono::duration<Double_t>(std::chrono::steady_clock::now() - timeOfConstruction).count();
+}
+
+// ##### CHECKPOINT FUNCTIONS #####
+namespace {
+    const char checkpointMagic[8] = { 'S', 'P', 'C', 'I', 'O', 'E', 'C', 'P' };
+    const UInt_t checkpointVersion = 1;
+}
+
+void ReconstructionOE::writeCheckpoint(){
+    // write the chain atomically: a complete temporary file replaces the previous checkpoint
+
+    if (pathToCheckpoint.empty()){
+        return;
+    }
+
+    if (sampleStore){
+        // the store must contain exactly the states sampled until now
+        sampleStore->flush();
+        sampleStoreBytes = sampleStore->getNumberOfBytesWritten();
+    }
+
+    std::ostringstream stream;
+    UInt_t numberOfVoxels = image->numberOfVoxels;
+    UInt_t numberOfTransitions = relTransitionsYaxis.size();
+    UInt_t lengthOfStorePath = pathToSampleStore.size();
+
+    stream.write(checkpointMagic, sizeof(checkpointMagic));
+    stream.write((const char*)&checkpointVersion, sizeof(checkpointVersion));
+    stream.write((const char*)&numberOfVoxels, sizeof(numberOfVoxels));
+    stream.write((const char*)&isGibbsSamplingUsed, sizeof(isGibbsSamplingUsed));
+    stream.write((const char*)&checkpointInterval, sizeof(checkpointInterval));
+    stream.write((const char*)&completedIterationsForEquilibrium, sizeof(completedIterationsForEquilibrium));
+    stream.write((const char*)&completedIterationsInEquilibrium, sizeof(completedIterationsInEquilibrium));
+    stream.write((const char*)&numberOfSampledStates, sizeof(numberOfSampledStates));
+    stream.write((const char*)sumOfCountsInVoxels.data(), numberOfVoxels * sizeof(Double_t));
+    stream.write((const char*)&numberOfTransitions, sizeof(numberOfTransitions));
+    stream.write((const char*)relTransitionsYaxis.data(), numberOfTransitions * sizeof(Double_t));
+    stream.write((const char*)&lengthOfStorePath, sizeof(lengthOfStorePath));
+    stream.write(pathToSampleStore.data(), lengthOfStorePath);
+    stream.write((const char*)&sampleStoreBytes, sizeof(sampleStoreBytes));
+    state->write(stream);
+
+    std::string content = stream.str();
+    std::string pathToTemporary = pathToCheckpoint + ".tmp";
+
+    FILE* file = std::fopen(pathToTemporary.c_str(), "wb");
+    if (!file){
+        std::cout << "Checkpoint " << pathToTemporary << " could not be written.\n";
+        return;
+    }
+
+    Bool_t isWritten = (std::fwrite(content.data(), 1, content.size(), file) == content.size());
+    isWritten = isWritten && (std::fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    isWritten = (std::fclose(file) == 0) && isWritten;
+
+    if (!isWritten || (std::rename(pathToTemporary.c_str(), pathToCheckpoint.c_str()) != 0)){
+        std::cout << "Checkpoint " << pathToCheckpoint << " could not be written.\n";
+    }
+}
+
+Bool_t ReconstructionOE::resume(const std::string path){
+    // restore a chain from a checkpoint, start() then continues it exactly
+
+    std::ifstream stream(path, std::ios::binary);
+
+    char magic[sizeof(checkpointMagic)];
+    UInt_t version = 0;
+    UInt_t numberOfVoxels = 0;
+    stream.read(magic, sizeof(magic));
+    stream.read((char*)&version, sizeof(version));
+    stream.read((char*)&numberOfVoxels, sizeof(numberOfVoxels));
+
+    if (!stream || (std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0) || (version != checkpointVersion)){
+        std::cout << "Invalid checkpoint: " << path << "\n";
+        return kFALSE;
+    }
+
+    if (Int_t(numberOfVoxels) != image->numberOfVoxels){
+        std::cout << "Checkpoint does not match the system matrix.\n";
+        return kFALSE;
+    }
+
+    UInt_t numberOfTransitions = 0;
+    UInt_t lengthOfStorePath = 0;
+    stream.read((char*)&isGibbsSamplingUsed, sizeof(isGibbsSamplingUsed));
+    stream.read((char*)&checkpointInterval, sizeof(checkpointInterval));
+    stream.read((char*)&completedIterationsForEquilibrium, sizeof(completedIterationsForEquilibrium));
+    stream.read((char*)&completedIterationsInEquilibrium, sizeof(completedIterationsInEquilibrium));
+    stream.read((char*)&numberOfSampledStates, sizeof(numberOfSampledStates));
+
+    sumOfCountsInVoxels.resize(numberOfVoxels);
+    stream.read((char*)sumOfCountsInVoxels.data(), numberOfVoxels * sizeof(Double_t));
+
+    stream.read((char*)&numberOfTransitions, sizeof(numberOfTransitions));
+    relTransitionsYaxis.resize(numberOfTransitions);
+    stream.read((char*)relTransitionsYaxis.data(), numberOfTransitions * sizeof(Double_t));
+    relTransitionsXaxis.clear();
+    for (UInt_t n = 0; n < numberOfTransitions; ++n){
+        relTransitionsXaxis.push_back(n + 1);
+    }
+
+    stream.read((char*)&lengthOfStorePath, sizeof(lengthOfStorePath));
+    pathToSampleStore.resize(lengthOfStorePath);
+    stream.read(&pathToSampleStore[0], lengthOfStorePath);
+    stream.read((char*)&sampleStoreBytes, sizeof(sampleStoreBytes));
+
+    delete state;
+    state = createState(1);
+    if (!stream || !state->read(stream)){
+        std::cout << "Invalid checkpoint: " << path << "\n";
+        delete state;
+        state = nullptr;
+        return kFALSE;
+    }
+
+    pathToCheckpoint = path;
+    return kTRUE;
+}
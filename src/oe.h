@@ -1,6 +1,7 @@
 // oe.h
 
 #pragma once
+#include <chrono>
 #include <vector>
 #include <TH2.h>
 #include <TH3.h>
@@ -10,6 +11,10 @@
 #include "systemmatrix.h"
 #include "measurements.h"
 #include "state.h"
+#include "samplestore.h"
+
+// share of the time budget left at start() that may be spent to reach equilibrium
+const Double_t equilibriumShareOfBudget = 0.5;
 
 // ##### RESULTS #####
 class ResultsOE{
@@ -34,20 +39,67 @@ class ReconstructionOE{
 public:
     ReconstructionOE(const TString pathToMeasurements,
                      const TString pathToProjections,
-                     const std::vector<Double_t> volume);
+                     const std::vector<Double_t> volume,
+                     const Selection& selection = Selection(),
+                     const RegionOfInterest& regionOfInterest = RegionOfInterest());
     ~ReconstructionOE();
 
     void start(const Int_t numberOfIterationsForEquilibirum, const Int_t numberOfIterationsInEquilibrium);
+    void setGibbsSampling(const Bool_t g){isGibbsSamplingUsed = g;}
+    void setSampleStore(const std::string pathToStore){pathToSampleStore = pathToStore;}
+    void setCheckpoint(const std::string path, const Int_t interval){pathToCheckpoint = path; checkpointInterval = interval;}
+    Bool_t resume(const std::string path);
+    void setTimeBudget(const Double_t seconds){timeBudget = seconds;}
+    void setEnergySchedule(const std::vector<Int_t> factors, const Int_t states){energyRebinningFactors = factors; statesPerEnergyStage = states;}
 
 private:
     // ##### CALCULATION FUNCTIONS #####
+    void dropEventsOutsideRegion();
+    State* createState(const Int_t factor) const;
+    State* runCoarseEnergyStages();
+    std::vector<Int_t> nextState(Double_t& relTransitions);
     void reachEquilibrium(const Int_t numberOfIterations);
     void sampleEquilibriumStates(const Int_t numberOfIterations);
     void calculateActivity();
 
+    // ##### TIME BUDGET FUNCTIONS #####
+    Double_t getElapsedTime() const;
+
+    // ##### CHECKPOINT FUNCTIONS #####
+    void writeCheckpoint();
+
     // ##### MEMBERS #####
     Bool_t isCalculationValid;
-    std::vector<std::vector<Int_t> > countsInVoxelsOfStates;
+    Bool_t isGibbsSamplingUsed;     // kTRUE: exact Gibbs updates, kFALSE: Metropolis-Hastings
+
+    // running sums of the sampled states for the mean state
+    std::vector<Double_t> sumOfCountsInVoxels;
+    ULong64_t numberOfSampledStates;
+
+    std::string pathToSampleStore;  // empty: only the mean state is kept
+    SampleStoreWriter* sampleStore = nullptr;
+    Long64_t sampleStoreBytes;      // size of the store at the last checkpoint, -1: new store
+
+    // progress of the chain, restored when resuming
+    Int_t completedIterationsForEquilibrium;
+    Int_t completedIterationsInEquilibrium;
+    std::vector<Double_t> relTransitionsXaxis;
+    std::vector<Double_t> relTransitionsYaxis;
+
+    std::string pathToCheckpoint;   // empty: no checkpoints
+    Int_t checkpointInterval;       // in states
+
+    // time budget: wall clock time from the construction (loading included) until the image is ready
+    std::chrono::steady_clock::time_point timeOfConstruction;
+    Double_t timeBudget;            // in s, 0 = no limit
+    Double_t deadlineForEquilibrium;
+
+    // energy schedule: the chain starts in spectra with factor neighbouring energy bins merged
+    std::vector<Int_t> energyRebinningFactors;  // in the order of the stages, e.g. 4, 2
+    Int_t statesPerEnergyStage;
+
+    // list-mode: measurement elements of all events (measurementData is not used then)
+    std::vector<UInt_t> elementsOfEvents;
 
     Measurements* measurementData = nullptr;
     SystemMatrix* systemMatrixData = nullptr;
@@ -0,0 +1,332 @@
+// online.cpp
+
+#include "online.h"
+#include <cstdio>
+#include <algorithm>
+#include <TFile.h>
+#include <TParameter.h>
+#include <TBenchmark.h>
+
+#include "batchmlem.h"
+#include "listmode.h"
+#include "utilities.h"
+
+// ##### ONLINE RECONSTRUCTION #####
+ReconstructionOnlineMLEM::ReconstructionOnlineMLEM(const TString pathToMeasurements,
+                                                   const TString pathToProjections,
+                                                   const std::vector<Double_t> volume,
+                                                   const Selection& selection,
+                                                   const RegionOfInterest& regionOfInterest) :
+    numberOfDetectors(0),
+    numberOfBins(0),
+    minimumEnergy(0),
+    maximumEnergy(0),
+    isStopping(kFALSE),
+    accelerator(1),
+    publishInterval(10),
+    iterationsPerUpdate(20),
+    numberOfIterations(0),
+    numberOfUpdates(0),
+    numberOfCounts(0),
+    selection(selection){
+    // prepare data for the online reconstruction using ML-EM, the measurement holds the counts so far
+
+    TBenchmark b;
+
+    // prepare the measurement data
+    b.Start("N_dcb");
+    Measurements* measurementData = new Measurements(pathToMeasurements, selection);
+    measurementData->createN_dcb();
+    measurementData->fillN_dcb(kFALSE);
+    std::vector<Double_t> N_dcb = measurementData->getN_dcbArray();
+
+    numberOfDetectors = measurementData->numberOfDetectors;
+    numberOfBins = measurementData->numberOfBins;
+    delete measurementData;
+    b.Stop("N_dcb");
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+
+    prepareSolver(N_dcb, pathToProjections, volume, regionOfInterest);
+}
+
+ReconstructionOnlineMLEM::ReconstructionOnlineMLEM(const Int_t numberOfDetectors,
+                                                   const TString pathToProjections,
+                                                   const std::vector<Double_t> volume,
+                                                   const Selection& selection,
+                                                   const RegionOfInterest& regionOfInterest) :
+    numberOfDetectors(numberOfDetectors),
+    numberOfBins(0),
+    minimumEnergy(0),
+    maximumEnergy(0),
+    isStopping(kFALSE),
+    accelerator(1),
+    publishInterval(10),
+    iterationsPerUpdate(20),
+    numberOfIterations(0),
+    numberOfUpdates(0),
+    numberOfCounts(0),
+    selection(selection){
+    // prepare the online reconstruction using ML-EM without any counts so far, e.g. fed by the coincidence sorter
+
+    prepareSolver(std::vector<Double_t>(), pathToProjections, volume, regionOfInterest);
+}
+
+void ReconstructionOnlineMLEM::prepareSolver(std::vector<Double_t> N_dcb,
+                                             const TString pathToProjections,
+                                             const std::vector<Double_t> volume,
+                                             const RegionOfInterest& regionOfInterest){
+    // load the system matrix and set up the solver with the counts so far (empty: no counts)
+
+    // the image is published by the solver thread while new spectra are read
+    ROOT::EnableThreadSafety();
+
+    TBenchmark b;
+
+    for (UInt_t i = 0; i < N_dcb.size(); ++i){
+        numberOfCounts += N_dcb[i];
+    }
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+    minimumEnergy = systemMatrixData->minimumEnergy;
+    maximumEnergy = systemMatrixData->maximumEnergy;
+    if (N_dcb.empty()){
+        numberOfBins = systemMatrixData->numberOfBins;
+        N_dcb.assign(numberOfDetectors * numberOfDetectors * numberOfBins, 0.0);
+    }
+
+    isCalculationValid = Utilities::checkForSameNumberOfBins(numberOfBins, systemMatrixData->numberOfBins)
+                         && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(numberOfDetectors);
+        batch = new BatchMLEM(systemMatrixData, std::vector<std::vector<Double_t> >(1, N_dcb));
+    }
+    b.Stop("p_dcb");
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionOnlineMLEM::~ReconstructionOnlineMLEM(){
+    stop();
+
+    delete batch;
+    delete image;
+    delete systemMatrixData;
+}
+
+void ReconstructionOnlineMLEM::start(){
+    // run the solver in the background until stop() is called
+
+    if (!isCalculationValid || solver.joinable()){
+        return;
+    }
+
+    batch->setAccelerator(accelerator);
+    timeOfLastPublication = std::chrono::steady_clock::now();
+    solver = std::thread(&ReconstructionOnlineMLEM::solve, this);
+}
+
+void ReconstructionOnlineMLEM::stop(){
+    // add the remaining counts, finish the iterations and publish the final image
+
+    {
+        std::lock_guard<std::mutex> lock(updatesMutex);
+        isStopping = kTRUE;
+    }
+    updatesReady.notify_one();
+
+    if (solver.joinable()){
+        solver.join();
+    }
+}
+
+Bool_t ReconstructionOnlineMLEM::addSpectra(const TString pathToSpectra){
+    // queue a block of spectra (same format as the measurement) holding the counts since the previous block
+
+    Measurements measurementData(pathToSpectra, selection);
+    if ((measurementData.numberOfDetectors != numberOfDetectors) || (measurementData.numberOfBins != numberOfBins)){
+        std::cout << "Spectra do not match the measurement: " << pathToSpectra << "\n";
+        return kFALSE;
+    }
+
+    measurementData.createN_dcb();
+    measurementData.fillN_dcb(kFALSE);
+    std::vector<Double_t> N_dcb = measurementData.getN_dcbArray();
+
+    std::vector<UInt_t> elements;
+    std::vector<Double_t> counts;
+    for (UInt_t i = 0; i < N_dcb.size(); ++i){
+        if (N_dcb[i] > 0){
+            elements.push_back(i);
+            counts.push_back(N_dcb[i]);
+        }
+    }
+
+    addCounts(elements, counts);
+    return kTRUE;
+}
+
+Bool_t ReconstructionOnlineMLEM::addEvents(ListModeEvents& events){
+    // queue list-mode events holding the counts since the previous block, every chunk as soon as it is binned
+
+    if (events.numberOfDetectors != numberOfDetectors){
+        std::cout << "Events do not match the measurement.\n";
+        return kFALSE;
+    }
+
+    events.setEnergyAxis(numberOfBins, minimumEnergy, maximumEnergy);
+    events.setSelection(selection);
+    events.rewind();
+
+    std::vector<UInt_t> elementsOfEvents;
+    std::vector<Double_t> times;
+    while (events.readChunk(elementsOfEvents, times)){
+        // one count per event, events of the same element summed
+        std::sort(elementsOfEvents.begin(), elementsOfEvents.end());
+
+        std::vector<UInt_t> elements;
+        std::vector<Double_t> counts;
+        for (UInt_t n = 0; n < elementsOfEvents.size(); ++n){
+            if (elements.empty() || (elements.back() != elementsOfEvents[n])){
+                elements.push_back(elementsOfEvents[n]);
+                counts.push_back(0.0);
+            }
+            ++counts.back();
+        }
+
+        if (!elements.empty()){
+            addCounts(elements, counts);
+        }
+    }
+
+    return kTRUE;
+}
+
+void ReconstructionOnlineMLEM::addCounts(const std::vector<UInt_t>& elements, const std::vector<Double_t>& counts){
+    // queue counts of measurement elements (see Utilities::getElementIndex), may be called from any thread
+
+    {
+        std::lock_guard<std::mutex> lock(updatesMutex);
+        pendingElements.insert(pendingElements.end(), elements.begin(), elements.end());
+        pendingCounts.insert(pendingCounts.end(), counts.begin(), counts.end());
+    }
+    updatesReady.notify_one();
+}
+
+Bool_t ReconstructionOnlineMLEM::applyUpdates(){
+    // add the queued counts to the solver, returns kFALSE if there were none
+
+    std::vector<UInt_t> elements;
+    std::vector<Double_t> counts;
+    {
+        std::lock_guard<std::mutex> lock(updatesMutex);
+        elements.swap(pendingElements);
+        counts.swap(pendingCounts);
+    }
+
+    if (elements.empty()){
+        return kFALSE;
+    }
+
+    batch->addCounts(0, elements, counts);
+    for (UInt_t i = 0; i < counts.size(); ++i){
+        numberOfCounts += (counts[i] > 0) ? counts[i] : 0.0;
+    }
+    ++numberOfUpdates;
+
+    return kTRUE;
+}
+
+void ReconstructionOnlineMLEM::solve(){
+    // iterate, add new counts in between and publish the image at the given cadence
+
+    Int_t iterationsSinceUpdate = 0;
+
+    // nothing to do without counts or after enough iterations on the latest counts
+    auto isWaitingForCounts = [&](){
+        return pendingElements.empty()
+               && ((numberOfCounts == 0)
+                   || ((iterationsPerUpdate > 0) && (iterationsSinceUpdate >= iterationsPerUpdate)));
+    };
+
+    for (;;){
+        {
+            std::unique_lock<std::mutex> lock(updatesMutex);
+            updatesReady.wait(lock, [&](){ return isStopping || !isWaitingForCounts(); });
+
+            // when stopping, the latest counts still get their iterations (at least one)
+            if (isStopping && (isWaitingForCounts()
+                               || ((iterationsPerUpdate == 0) && pendingElements.empty() && (iterationsSinceUpdate > 0)))){
+                break;
+            }
+        }
+
+        if (applyUpdates()){
+            iterationsSinceUpdate = 0;
+        }
+
+        batch->iterate();
+        ++numberOfIterations;
+        ++iterationsSinceUpdate;
+
+        std::chrono::duration<Double_t> sinceLastPublication = std::chrono::steady_clock::now() - timeOfLastPublication;
+        if (sinceLastPublication.count() >= publishInterval){
+            publish();
+        }
+    }
+
+    publish();
+}
+
+void ReconstructionOnlineMLEM::publish(){
+    // write the current image atomically: a complete temporary file replaces the previous one
+
+    const TString pathToImage = "MLEM_Online.root";
+    const TString pathToTemporary = pathToImage + ".tmp";
+
+    timeOfLastPublication = std::chrono::steady_clock::now();
+
+    std::vector<Double_t> activities;
+    batch->getImage(0, activities);
+
+    image->A_v->Reset();
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], activities[v]);
+    }
+
+    TFile* file = new TFile(pathToTemporary, "RECREATE");
+    if (!file->IsOpen()){
+        std::cout << "Image " << pathToTemporary << " could not be written.\n";
+        delete file;
+        return;
+    }
+
+    file->cd();
+    image->A_v->Write("A_v");
+
+    TParameter<Int_t> iterations("iterations", numberOfIterations);
+    iterations.Write();
+    TParameter<Int_t> updates("updates", numberOfUpdates);
+    updates.Write();
+    TParameter<Double_t> counts("counts", numberOfCounts);
+    counts.Write();
+
+    file->Close();
+    delete file;
+
+    if (std::rename(pathToTemporary.Data(), pathToImage.Data()) != 0){
+        std::cout << "Image " << pathToImage << " could not be written.\n";
+        return;
+    }
+
+    std::cout << "\nImage published: iteration " << numberOfIterations << ", updates " << numberOfUpdates
+              << ", counts " << numberOfCounts << ", -log L " << batch->calculateLogLike()[0] << "\n";
+}
@@ -0,0 +1,86 @@
+// online.h
+// ML-EM while the measurement is still running
+//
+// The system matrix is loaded once. New counts (blocks of spectra or chunks of list-mode events)
+// are queued from any thread and added between two iterations to the affected measurement elements
+// only (see BatchMLEM::addCounts); the solver continues from its current image.
+// The image is published to a fixed file at a configurable cadence.
+
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <TH3.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+class BatchMLEM;
+class ListModeEvents;
+
+// ##### ONLINE RECONSTRUCTION #####
+class ReconstructionOnlineMLEM{
+public:
+    ReconstructionOnlineMLEM(const TString pathToMeasurements,
+                             const TString pathToProjections,
+                             const std::vector<Double_t> volume,
+                             const Selection& selection = Selection(),
+                             const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ReconstructionOnlineMLEM(const Int_t numberOfDetectors,
+                             const TString pathToProjections,
+                             const std::vector<Double_t> volume,
+                             const Selection& selection = Selection(),
+                             const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionOnlineMLEM();
+
+    void setAccelerator(const Double_t a){accelerator = a;}
+    void setPublishInterval(const Double_t seconds){publishInterval = seconds;}
+    void setIterationsPerUpdate(const Int_t i){iterationsPerUpdate = i;}
+
+    void start();
+    void stop();
+
+    Bool_t addSpectra(const TString pathToSpectra);
+    Bool_t addEvents(ListModeEvents& events);  // all events of the list, binned chunk by chunk
+    void addCounts(const std::vector<UInt_t>& elements, const std::vector<Double_t>& counts);
+
+    Int_t numberOfDetectors;
+    Int_t numberOfBins;
+    Double_t minimumEnergy;     // energy range of the spectra
+    Double_t maximumEnergy;
+
+private:
+    void prepareSolver(std::vector<Double_t> N_dcb, const TString pathToProjections, const std::vector<Double_t> volume,
+                       const RegionOfInterest& regionOfInterest);
+    void solve();
+    Bool_t applyUpdates();
+    void publish();
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Bool_t isStopping;
+    Double_t accelerator;
+    Double_t publishInterval;       // in s, 0 = publish after every iteration
+    Int_t iterationsPerUpdate;      // iterations after the latest update before waiting for new counts, 0 = never wait
+
+    Int_t numberOfIterations;
+    Int_t numberOfUpdates;
+    Double_t numberOfCounts;
+    std::chrono::steady_clock::time_point timeOfLastPublication;
+    Selection selection;            // applied to the measurement, to every block of spectra and to the events
+
+    // counts waiting to be added, filled by any thread
+    std::vector<UInt_t> pendingElements;
+    std::vector<Double_t> pendingCounts;
+    std::mutex updatesMutex;
+    std::condition_variable updatesReady;
+
+    std::thread solver;
+
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+    BatchMLEM* batch = nullptr;
+};
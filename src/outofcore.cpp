@@ -0,0 +1,416 @@
+// outofcore.cpp
+
+#include "outofcore.h"
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+#include <TGraph.h>
+#include <TBenchmark.h>
+
+#include "utilities.h"
+
+const char blocksMagic[8] = { 'S', 'P', 'C', 'I', 'O', 'O', 'C', 'M' };
+const UInt_t blocksVersion = 1;
+const std::streamoff blocksHeaderSize = sizeof(blocksMagic) + 4 * sizeof(UInt_t);
+
+// ##### BLOCK STREAM #####
+SystemMatrixBlocks::SystemMatrixBlocks(const std::string pathToBlocks, const Int_t numberOfVoxels,
+                                       const UInt_t numberOfElements, const Int_t voxelsPerBlock) :
+    timeWaitingForBlocks(0),
+    pathToBlocks(pathToBlocks),
+    numberOfVoxels(numberOfVoxels),
+    numberOfElements(numberOfElements),
+    voxelsPerBlock(voxelsPerBlock),
+    numberOfBlocks((numberOfVoxels + voxelsPerBlock - 1) / voxelsPerBlock),
+    output(pathToBlocks, std::ios::binary | std::ios::trunc),
+    currentBlock(0),
+    currentBuffer(-1),
+    isReadingFailed(kFALSE),
+    isStopping(kFALSE){
+    // create the block file, the rows follow with writeRow()
+
+    output.write(blocksMagic, sizeof(blocksMagic));
+    output.write(reinterpret_cast<const char*>(&blocksVersion), sizeof(UInt_t));
+    output.write(reinterpret_cast<const char*>(&numberOfVoxels), sizeof(Int_t));
+    output.write(reinterpret_cast<const char*>(&numberOfElements), sizeof(UInt_t));
+    output.write(reinterpret_cast<const char*>(&voxelsPerBlock), sizeof(Int_t));
+}
+
+SystemMatrixBlocks::~SystemMatrixBlocks(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = kTRUE;
+    }
+    bufferFree.notify_one();
+
+    if (reader.joinable()){
+        reader.join();
+    }
+
+    output.close();
+    std::remove(pathToBlocks.c_str());
+}
+
+void SystemMatrixBlocks::writeRow(const std::vector<Float_t>& p_m){
+    output.write(reinterpret_cast<const char*>(p_m.data()), numberOfElements * sizeof(Float_t));
+}
+
+Bool_t SystemMatrixBlocks::finishWriting(){
+    // close the block file, returns kFALSE if it could not be written completely (e.g. disk full)
+
+    Bool_t isWritten = output.good();
+    output.close();
+
+    if (!isWritten){
+        std::cout << "Block file " << pathToBlocks << " could not be written.\n";
+    }
+    return isWritten;
+}
+
+void SystemMatrixBlocks::startPass(){
+    // start reading ahead from the first block
+
+    if (reader.joinable()){
+        reader.join();
+    }
+
+    if (buffers.empty()){
+        buffers.assign(std::min<Int_t>(numberOfBlockBuffers, numberOfBlocks),
+                       std::vector<Float_t>(size_t(voxelsPerBlock) * numberOfElements));
+    }
+
+    freeBuffers.clear();
+    readBuffers.clear();
+    for (UInt_t i = 0; i < buffers.size(); ++i){
+        freeBuffers.push_back(i);
+    }
+    currentBlock = 0;
+    currentBuffer = -1;
+
+    reader = std::thread(&SystemMatrixBlocks::readBlocks, this);
+}
+
+const Float_t* SystemMatrixBlocks::nextBlock(Int_t& firstVoxel, Int_t& numberOfVoxelsInBlock){
+    // wait for the next block, nullptr after the last block or if reading failed
+
+    if (currentBlock < numberOfBlocks){
+        std::chrono::steady_clock::time_point timeBeforeWaiting = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bufferRead.wait(lock, [this]{ return !readBuffers.empty() || isReadingFailed; });
+
+            if (!readBuffers.empty()){
+                currentBuffer = readBuffers.front();
+                readBuffers.pop_front();
+            }
+        }
+        std::chrono::duration<Double_t> timeWaiting = std::chrono::steady_clock::now() - timeBeforeWaiting;
+        timeWaitingForBlocks += timeWaiting.count();
+
+        if (!isReadingFailed){
+            firstVoxel = currentBlock * voxelsPerBlock;
+            numberOfVoxelsInBlock = std::min(voxelsPerBlock, numberOfVoxels - firstVoxel);
+            ++currentBlock;
+            return buffers[currentBuffer].data();
+        }
+    }
+
+    if (reader.joinable()){
+        reader.join();
+    }
+    return nullptr;
+}
+
+void SystemMatrixBlocks::releaseBlock(){
+    // hand the buffer of the current block back to the reader
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(currentBuffer);
+    }
+    bufferFree.notify_one();
+}
+
+void SystemMatrixBlocks::readBlocks(){
+    // (BACKGROUND THREAD) read the blocks in order into the free buffers
+
+    std::ifstream input(pathToBlocks, std::ios::binary);
+    input.seekg(blocksHeaderSize);
+
+    for (Int_t block = 0; block < numberOfBlocks; ++block){
+        UInt_t buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bufferFree.wait(lock, [this]{ return !freeBuffers.empty() || isStopping; });
+
+            if (isStopping){
+                return;
+            }
+
+            buffer = freeBuffers.front();
+            freeBuffers.pop_front();
+        }
+
+        Int_t numberOfVoxelsInBlock = std::min(voxelsPerBlock, numberOfVoxels - block * voxelsPerBlock);
+        input.read(reinterpret_cast<char*>(buffers[buffer].data()),
+                   size_t(numberOfVoxelsInBlock) * numberOfElements * sizeof(Float_t));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!input){
+                std::cout << "Block " << block << " of " << pathToBlocks << " could not be read.\n";
+                isReadingFailed = kTRUE;
+            } else{
+                readBuffers.push_back(buffer);
+            }
+        }
+        bufferRead.notify_one();
+
+        if (isReadingFailed){
+            return;
+        }
+    }
+}
+
+// ##### OUT-OF-CORE RECONSTRUCTION #####
+ReconstructionOutOfCoreMLEM::ReconstructionOutOfCoreMLEM(const TString pathToMeasurements,
+                                                         const TString pathToProjections,
+                                                         const std::vector<Double_t> volume,
+                                                         const Double_t memoryBudget,
+                                                         const Selection& selection,
+                                                         const RegionOfInterest& regionOfInterest) :
+    accelerator(1),
+    memoryBudget(memoryBudget){
+    // prepare data for reconstruction using ML-EM, the system matrix is written to a block file
+
+    TBenchmark b;
+
+    // prepare the measurement data, only the measured elements are kept
+    b.Start("N_dcb");
+    Measurements* measurementData = new Measurements(pathToMeasurements, selection);
+    measurementData->createN_dcb();
+    measurementData->fillN_dcb(kFALSE);
+    std::vector<Double_t> N_dcb = measurementData->getN_dcbArray();
+    for (UInt_t i = 0; i < N_dcb.size(); ++i){
+        if (N_dcb[i] != 0){
+            measuredElements.push_back(i);
+            measuredCounts.push_back(N_dcb[i]);
+        }
+    }
+    b.Stop("N_dcb");
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    SystemMatrix* systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+    isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
+                                                             systemMatrixData->numberOfBins)
+                         && systemMatrixData->setRegionOfInterest(regionOfInterest, volume)
+                         && !measuredElements.empty();
+
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    if (isCalculationValid){
+        createBlocks(systemMatrixData, measurementData->numberOfDetectors);
+    }
+    b.Stop("p_dcb");
+
+    delete systemMatrixData;
+    delete measurementData;
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+}
+
+ReconstructionOutOfCoreMLEM::~ReconstructionOutOfCoreMLEM(){
+    delete blocks;
+    delete image;
+}
+
+void ReconstructionOutOfCoreMLEM::createBlocks(SystemMatrix* systemMatrixData, const Int_t numberOfDetectors){
+    // convert the system matrix voxel by voxel into the block file, only one row is in memory at once
+
+    Int_t numberOfVoxels = image->numberOfVoxels;
+    size_t bytesPerVoxel = measuredElements.size() * sizeof(Float_t);
+    Double_t voxelsInBudget = memoryBudget * 1024 * 1024 / (numberOfBlockBuffers * bytesPerVoxel);
+    Int_t voxelsPerBlock = Int_t(std::max(1.0, std::min(Double_t(numberOfVoxels), voxelsInBudget)));
+
+    // one block file per process, concurrent runs in the same directory must not share it
+    TString pathToBlocks;
+    pathToBlocks.Form("MLEM_OutOfCore_%d.blocks", Int_t(getpid()));
+    blocks = new SystemMatrixBlocks(pathToBlocks.Data(), numberOfVoxels, measuredElements.size(), voxelsPerBlock);
+
+    Int_t numberOfRowsWritten = 0;
+    sensitivities.assign(numberOfVoxels, 0.0);
+    systemMatrixData->createSystemMatrixRows(numberOfDetectors, measuredElements,
+                                             [&](const std::vector<Float_t>& p_m){
+        blocks->writeRow(p_m);
+        for (UInt_t m = 0; m < p_m.size(); ++m){
+            sensitivities[numberOfRowsWritten] += p_m[m];
+        }
+        ++numberOfRowsWritten;
+    });
+
+    isCalculationValid = blocks->finishWriting() && (numberOfRowsWritten == numberOfVoxels);
+
+    // voxels no measured element can see keep zero activity
+    activities.assign(numberOfVoxels, 0.0);
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        activities[v] = (sensitivities[v] > 0) ? 1.0 : 0.0;
+    }
+
+    std::cout << "\nBlock file:\t\t" << (numberOfVoxels + voxelsPerBlock - 1) / voxelsPerBlock << " blocks of "
+              << voxelsPerBlock << " voxels, " << numberOfVoxels * bytesPerVoxel / (1024.0 * 1024.0) << " MB\n";
+}
+
+void ReconstructionOutOfCoreMLEM::start(const Int_t maxNumberOfIterations){
+    // execute the calculation, one pass over the block file per iteration
+
+    if (!isCalculationValid){
+        return;
+    }
+
+    TBenchmark b;
+    logLike.clear();
+
+    b.Start("stats");
+    projection();
+
+    Int_t numberOfIterations = 0;
+    while ((numberOfIterations < maxNumberOfIterations) && !blocks->hasFailed()){
+        iterate();
+        ++numberOfIterations;
+        logLike.push_back(calculateLogLike());
+    }
+    b.Stop("stats");
+
+    if (blocks->hasFailed()){
+        std::cout << "\nReading the block file failed, the image of the last complete iteration is kept.\n";
+    }
+
+    // Inform user
+    std::cout << "\nImage reconstruction done. Steps: " << numberOfIterations << "\n";
+    std::cout << "\nCalculation Time:\t" << b.GetRealTime("stats") << " seconds\n";
+    std::cout << "\nWaiting for Blocks:\t" << blocks->timeWaitingForBlocks << " seconds\n";
+
+    saveResults("MLEM_OutOfCore.root");
+}
+
+void ReconstructionOutOfCoreMLEM::projection(){
+    // calculates the forward projections of the current image
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+    projections.assign(numberOfMeasuredElements, 0.0);
+
+    Int_t firstVoxel, numberOfVoxelsInBlock;
+    const Float_t* block;
+    blocks->startPass();
+    while ((block = blocks->nextBlock(firstVoxel, numberOfVoxelsInBlock))){
+        for (Int_t i = 0; i < numberOfVoxelsInBlock; ++i){
+            Double_t activityInVoxel = activities[firstVoxel + i];
+            const Float_t* p_m = block + size_t(i) * numberOfMeasuredElements;
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                projections[m] += activityInVoxel * p_m[m];
+            }
+        }
+        blocks->releaseBlock();
+    }
+}
+
+void ReconstructionOutOfCoreMLEM::iterate(){
+    // backprojection of the current image and projection of the updated one in the same pass
+
+    size_t numberOfMeasuredElements = measuredElements.size();
+
+    // N_dcb / projection of the measured elements, the same for all voxels
+    std::vector<Double_t> ratios(numberOfMeasuredElements, 0.0);
+    for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+        if (projections[m] != 0){
+            ratios[m] = measuredCounts[m] / projections[m];
+        }
+    }
+
+    std::vector<Double_t> previousActivities(activities);
+    nextProjections.assign(numberOfMeasuredElements, 0.0);
+
+    Int_t firstVoxel, numberOfVoxelsInBlock;
+    const Float_t* block;
+    blocks->startPass();
+    while ((block = blocks->nextBlock(firstVoxel, numberOfVoxelsInBlock))){
+        for (Int_t i = 0; i < numberOfVoxelsInBlock; ++i){
+            Int_t v = firstVoxel + i;
+            if (!(activities[v] > 0)){
+                continue;  // multiplicative updates: a voxel at zero stays at zero
+            }
+
+            const Float_t* p_m = block + size_t(i) * numberOfMeasuredElements;
+
+            Double_t correctionFactor = 0.0;
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                correctionFactor += p_m[m] * ratios[m];
+            }
+            correctionFactor = std::pow(correctionFactor / sensitivities[v], accelerator);
+            activities[v] *= correctionFactor;
+
+            for (size_t m = 0; m < numberOfMeasuredElements; ++m){
+                nextProjections[m] += activities[v] * p_m[m];
+            }
+        }
+        blocks->releaseBlock();
+    }
+
+    // an incomplete pass leaves the image of the previous iteration
+    if (blocks->hasFailed()){
+        activities.swap(previousActivities);
+        return;
+    }
+
+    projections.swap(nextProjections);
+}
+
+Double_t ReconstructionOutOfCoreMLEM::calculateLogLike() const{
+    // Calculate the Log-Likelihood-Function
+
+    Double_t LogLike = 0.0;
+    for (size_t m = 0; m < measuredElements.size(); ++m){
+        if (projections[m] != 0){
+            LogLike += projections[m] - measuredCounts[m] * std::log(projections[m]);
+        }
+    }
+
+    return LogLike;
+}
+
+void ReconstructionOutOfCoreMLEM::saveResults(const TString pathToResults){
+    // write the normalized image and the log-likelihood
+
+    image->A_v->Reset();
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+        image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], activities[v]);
+    }
+
+    if (image->A_v->Integral() > 0){
+        image->A_v->Scale(1.0 / image->A_v->Integral());
+    }
+
+    TFile* file = new TFile(pathToResults, "RECREATE");
+    file->cd();
+    image->A_v->Write("A_v");
+
+    if (!logLike.empty()){
+        std::vector<Double_t> iterations;
+        for (UInt_t i = 0; i < logLike.size(); ++i){
+            iterations.push_back(i + 1);
+        }
+
+        TGraph logLikeGraph(logLike.size(), &iterations[0], &logLike[0]);
+        logLikeGraph.Write("logLike");
+    }
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nImage written to " << pathToResults << "\n";
+}
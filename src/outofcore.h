@@ -0,0 +1,114 @@
+// outofcore.h
+// ML-EM with the system matrix on disk, for system matrices larger than the memory
+//
+// The system matrix is converted once into a block file: the probabilities of the measured elements
+// (Float_t) voxel after voxel, consecutive voxels forming a block. Every iteration streams the blocks
+// through a fixed number of buffers within the memory budget; a background thread reads ahead while
+// the current block is computed. One pass per iteration: every voxel of a block is corrected with the
+// projections of the current image and right away projected into the projections of the next image.
+//
+// file layout:
+//   header: "SPCIOOCM", version, number of voxels, number of measured elements, voxels per block
+//   rows:   p_dcbv of the measured elements, voxel after voxel
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <TH3.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+// buffers of the block stream, the one being computed included
+const UInt_t numberOfBlockBuffers = 4;
+
+// ##### BLOCK STREAM #####
+class SystemMatrixBlocks{
+public:
+    SystemMatrixBlocks(const std::string pathToBlocks, const Int_t numberOfVoxels,
+                       const UInt_t numberOfElements, const Int_t voxelsPerBlock);
+    ~SystemMatrixBlocks();
+
+    // conversion, rows in the order of the voxels
+    void writeRow(const std::vector<Float_t>& p_m);
+    Bool_t finishWriting();
+
+    // one pass over all blocks
+    void startPass();
+    const Float_t* nextBlock(Int_t& firstVoxel, Int_t& numberOfVoxelsInBlock);  // nullptr after the last block
+    void releaseBlock();
+    Bool_t hasFailed() const {return isReadingFailed;}
+
+    Double_t timeWaitingForBlocks;  // in s, of all passes
+
+private:
+    void readBlocks();
+
+    std::string pathToBlocks;
+    Int_t numberOfVoxels;
+    UInt_t numberOfElements;
+    Int_t voxelsPerBlock;
+    Int_t numberOfBlocks;
+    std::ofstream output;
+
+    // buffers: free ones for the reader, read ones for the computation, in block order
+    std::vector<std::vector<Float_t> > buffers;
+    std::deque<UInt_t> freeBuffers;
+    std::deque<UInt_t> readBuffers;
+    Int_t currentBlock;
+    Int_t currentBuffer;
+    std::atomic<Bool_t> isReadingFailed;    // set by the reader under the mutex, read by the computation without it
+    Bool_t isStopping;
+
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable bufferFree;
+    std::condition_variable bufferRead;
+};
+
+// ##### OUT-OF-CORE RECONSTRUCTION #####
+class ReconstructionOutOfCoreMLEM{
+public:
+    ReconstructionOutOfCoreMLEM(const TString pathToMeasurements,
+                                const TString pathToProjections,
+                                const std::vector<Double_t> volume,
+                                const Double_t memoryBudget,
+                                const Selection& selection = Selection(),
+                                const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionOutOfCoreMLEM();
+
+    void start(const Int_t maxNumberOfIterations);
+    void setAccelerator(const Double_t a){accelerator = a;}
+
+private:
+    void createBlocks(SystemMatrix* systemMatrixData, const Int_t numberOfDetectors);
+    void projection();
+    void iterate();
+    Double_t calculateLogLike() const;
+    void saveResults(const TString pathToResults);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Double_t accelerator;
+    Double_t memoryBudget;                  // in MB, for the buffers of the block stream
+    std::vector<Double_t> logLike;
+
+    // compact measurement space, see ReconstructionMLEM
+    std::vector<UInt_t> measuredElements;
+    std::vector<Double_t> measuredCounts;
+
+    std::vector<Double_t> activities;       // of each voxel
+    std::vector<Double_t> sensitivities;    // over the measured elements
+    std::vector<Double_t> projections;      // of the current image
+    std::vector<Double_t> nextProjections;  // of the image being updated
+
+    ImageSpace* image = nullptr;
+    SystemMatrixBlocks* blocks = nullptr;
+};
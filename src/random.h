@@ -115,12 +115,21 @@ public:
     {
         seed(rd);
     }
+    pcg(uint64_t s0, uint64_t s1)
+    {
+        seed(s0, s1);
+    }
 
     void seed(std::random_device &rd)
     {
         uint64_t s0 = uint64_t(rd()) << 31 | uint64_t(rd());
         uint64_t s1 = uint64_t(rd()) << 31 | uint64_t(rd());
 
+        seed(s0, s1);
+    }
+
+    void seed(uint64_t s0, uint64_t s1)
+    {
         m_state = 0;
         m_inc = (s1 << 1) | 1;
         (void)operator()();
@@ -0,0 +1,72 @@
+// roi.cpp
+
+#include "roi.h"
+#include <algorithm>
+
+// ##### REGION OF INTEREST #####
+RegionOfInterest::RegionOfInterest() : sensitivityThreshold(0){
+}
+
+Bool_t RegionOfInterest::isUsed() const{
+    return (box.size() == 6) || !listOfVoxels.empty() || (sensitivityThreshold > 0);
+}
+
+std::vector<Int_t> RegionOfInterest::getVoxels(const std::vector<Double_t> volume,
+                                               const std::array<Int_t, 3> size,
+                                               const std::vector<Double_t>& sensitivities) const{
+    // voxel numbers inside the region, in ascending order (same voxel order as ImageSpace::setImageIndices)
+
+    Int_t numberOfBinsX = size[0] + 1;
+    Int_t numberOfBinsY = size[1] + 1;
+    Int_t numberOfBinsZ = size[2] + 1;
+    Int_t numberOfVoxels = numberOfBinsX * numberOfBinsY * numberOfBinsZ;
+
+    std::vector<Bool_t> isInside(numberOfVoxels, kTRUE);
+
+    if (box.size() == 6){
+        Double_t widthX = (volume[1] - volume[0]) / numberOfBinsX;
+        Double_t widthY = (volume[3] - volume[2]) / numberOfBinsY;
+        Double_t widthZ = (volume[5] - volume[4]) / numberOfBinsZ;
+
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            Double_t x = volume[0] + (v % numberOfBinsX + 0.5) * widthX;
+            Double_t y = volume[2] + (v / numberOfBinsX % numberOfBinsY + 0.5) * widthY;
+            Double_t z = volume[4] + (v / (numberOfBinsX * numberOfBinsY) + 0.5) * widthZ;
+
+            if ((x < box[0]) || (x > box[1]) || (y < box[2]) || (y > box[3]) || (z < box[4]) || (z > box[5])){
+                isInside[v] = kFALSE;
+            }
+        }
+    }
+
+    if (!listOfVoxels.empty()){
+        std::vector<Bool_t> isListed(numberOfVoxels, kFALSE);
+        for (UInt_t i = 0; i < listOfVoxels.size(); ++i){
+            if ((listOfVoxels[i] >= 0) && (listOfVoxels[i] < numberOfVoxels)){
+                isListed[listOfVoxels[i]] = kTRUE;
+            }
+        }
+
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            isInside[v] = isInside[v] && isListed[v];
+        }
+    }
+
+    if ((sensitivityThreshold > 0) && !sensitivities.empty()){
+        Double_t maximumSensitivity = *std::max_element(sensitivities.begin(), sensitivities.end());
+        for (Int_t v = 0; (v < numberOfVoxels) && (v < Int_t(sensitivities.size())); ++v){
+            if (sensitivities[v] < sensitivityThreshold * maximumSensitivity){
+                isInside[v] = kFALSE;
+            }
+        }
+    }
+
+    std::vector<Int_t> voxels;
+    for (Int_t v = 0; v < numberOfVoxels; ++v){
+        if (isInside[v]){
+            voxels.push_back(v);
+        }
+    }
+
+    return voxels;
+}
@@ -0,0 +1,33 @@
+// roi.h
+// region of interest: the voxels of the image space to be reconstructed
+//
+// A voxel is inside if it meets all given criteria: its center lies in the box, its number is listed
+// and its sensitivity reaches the threshold (relative to the most sensitive voxel). Only the voxels inside
+// are loaded from the system matrix (see SystemMatrix::setVoxels) and listed in the image space
+// (see ImageSpace), all others stay at zero activity and are never projected, backprojected or proposed.
+
+#pragma once
+#include <array>
+#include <vector>
+#include <TROOT.h>
+
+// ##### REGION OF INTEREST #####
+class RegionOfInterest{
+public:
+    RegionOfInterest();
+
+    void setBox(const std::vector<Double_t> box){this->box = box;}
+    void setVoxels(const std::vector<Int_t> voxels){listOfVoxels = voxels;}
+    void setSensitivityThreshold(const Double_t threshold){sensitivityThreshold = threshold;}
+
+    Bool_t isUsed() const;
+    Bool_t isSensitivityNeeded() const {return sensitivityThreshold > 0;}
+    std::vector<Int_t> getVoxels(const std::vector<Double_t> volume,
+                                 const std::array<Int_t, 3> size,
+                                 const std::vector<Double_t>& sensitivities) const;
+
+private:
+    std::vector<Double_t> box;          // in mm, xMin, xMax, yMin, yMax, zMin, zMax as the volume, empty: no box
+    std::vector<Int_t> listOfVoxels;    // voxel numbers v, empty: no list
+    Double_t sensitivityThreshold;      // 0 = no threshold
+};
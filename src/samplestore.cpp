@@ -0,0 +1,369 @@
+// samplestore.cpp
+
+#include "samplestore.h"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+    const char magic[8] = { 'S', 'P', 'C', 'I', 'O', 'E', 'S', 'S' };
+    const UInt_t version = 1;
+
+    void putVarint(std::vector<UChar_t>& buffer, UInt_t value){
+        // 7 bits per byte, highest bit marks continuation
+
+        while (value >= 0x80){
+            buffer.push_back(UChar_t(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(UChar_t(value));
+    }
+
+    UInt_t getVarint(const std::vector<UChar_t>& buffer, size_t& position){
+        UInt_t value = 0;
+        for (Int_t shift = 0; position < buffer.size(); shift += 7){
+            UChar_t byte = buffer[position++];
+            value |= UInt_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)){
+                break;
+            }
+        }
+
+        return value;
+    }
+
+    UInt_t zigzag(const Int_t value){ return (UInt_t(value) << 1) ^ UInt_t(value >> 31); }
+    Int_t unzigzag(const UInt_t value){ return Int_t(value >> 1) ^ -Int_t(value & 1); }
+
+    template <typename T>
+    void writeValue(std::ostream& stream, const T value){
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    Bool_t readValue(std::istream& stream, T& value){
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return Bool_t(stream);
+    }
+}
+
+// ##### WRITER #####
+SampleStoreWriter::SampleStoreWriter(const std::string pathToStore, const Int_t numberOfVoxels, const UInt_t statesPerBlock,
+                                     const Long64_t resumeAtByte) :
+    pathToStore(pathToStore),
+    numberOfVoxels(numberOfVoxels),
+    statesPerBlock(statesPerBlock),
+    numberOfStates(0),
+    numberOfBytesWritten(0),
+    isClosed(kFALSE),
+    isFailed(kFALSE),
+    numberOfBlocksInFlight(0),
+    isFinished(kFALSE){
+    // open the store and start the background writer
+    // resumeAtByte >= 0: continue an existing store, dropping everything written after this position
+
+    if (resumeAtByte >= 0){
+        if (truncate(pathToStore.c_str(), resumeAtByte) != 0){
+            std::cout << "Sample store " << pathToStore << " could not be truncated.\n";
+        }
+
+        file.open(pathToStore, std::ios::binary | std::ios::app);
+        numberOfBytesWritten = resumeAtByte;
+
+    } else{
+        file.open(pathToStore, std::ios::binary | std::ios::trunc);
+
+        file.write(magic, sizeof(magic));
+        writeValue(file, version);
+        writeValue(file, numberOfVoxels);
+        writeValue(file, statesPerBlock);
+        numberOfBytesWritten = sizeof(magic) + 3 * sizeof(UInt_t);
+    }
+
+    if (!file){
+        std::cout << "Sample store " << pathToStore << " could not be opened.\n";
+        isFailed = kTRUE;
+    }
+
+    currentBlock.numberOfStates = 0;
+    writer = std::thread(&SampleStoreWriter::writeBlocks, this);
+}
+
+SampleStoreWriter::~SampleStoreWriter(){
+    close();
+}
+
+void SampleStoreWriter::push(const std::vector<Int_t>& countsInVoxel){
+    // delta-encode the state against the previous one
+
+    if (currentBlock.numberOfStates == 0){
+        // key frame
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            putVarint(currentBlock.raw, countsInVoxel[v]);
+        }
+
+    } else{
+        UInt_t numberOfChanges = 0;
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            if (countsInVoxel[v] != previousState[v]){
+                ++numberOfChanges;
+            }
+        }
+
+        putVarint(currentBlock.raw, numberOfChanges);
+
+        Int_t lastVoxel = 0;
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            if (countsInVoxel[v] != previousState[v]){
+                putVarint(currentBlock.raw, v - lastVoxel);
+                putVarint(currentBlock.raw, zigzag(countsInVoxel[v] - previousState[v]));
+                lastVoxel = v;
+            }
+        }
+    }
+
+    previousState = countsInVoxel;
+    ++currentBlock.numberOfStates;
+    ++numberOfStates;
+
+    if (currentBlock.numberOfStates == statesPerBlock){
+        flushBlock();
+    }
+}
+
+void SampleStoreWriter::flush(){
+    // write all states pushed so far and wait until they are on disk
+
+    if (currentBlock.numberOfStates != 0){
+        flushBlock();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    blockWritten.wait(lock, [this]{ return numberOfBlocksInFlight == 0; });
+}
+
+void SampleStoreWriter::close(){
+    // write the remaining states and wait for the background writer
+
+    if (isClosed){
+        return;
+    }
+
+    if (currentBlock.numberOfStates != 0){
+        flushBlock();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isFinished = kTRUE;
+    }
+    blockReady.notify_one();
+    writer.join();
+
+    file.close();
+    isClosed = kTRUE;
+}
+
+void SampleStoreWriter::flushBlock(){
+    // hand the current block over to the background writer
+
+    std::unique_lock<std::mutex> lock(mutex);
+    blockTaken.wait(lock, [this]{ return pendingBlocks.size() < maxPendingBlocks; });
+
+    ++numberOfBlocksInFlight;
+    pendingBlocks.push_back(Block());
+    pendingBlocks.back().numberOfStates = currentBlock.numberOfStates;
+    pendingBlocks.back().raw.swap(currentBlock.raw);
+    lock.unlock();
+    blockReady.notify_one();
+
+    currentBlock.numberOfStates = 0;
+    currentBlock.raw.clear();
+}
+
+void SampleStoreWriter::writeBlocks(){
+    // (BACKGROUND THREAD) compress and write the blocks
+
+    std::vector<UChar_t> compressed;
+    for (;;){
+        Block block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            blockReady.wait(lock, [this]{ return isFinished || !pendingBlocks.empty(); });
+
+            if (pendingBlocks.empty()){
+                return;  // finished and nothing left
+            }
+
+            block.numberOfStates = pendingBlocks.front().numberOfStates;
+            block.raw.swap(pendingBlocks.front().raw);
+            pendingBlocks.pop_front();
+        }
+        blockTaken.notify_one();
+
+        // after a failure the blocks are only dropped, so that flush() and close() still return
+        uLongf compressedSize = compressBound(block.raw.size());
+        compressed.resize(compressedSize);
+        if (!isFailed
+            && (compress2(compressed.data(), &compressedSize, block.raw.data(), block.raw.size(), Z_BEST_SPEED) != Z_OK)){
+            fail("could not be compressed");
+        }
+
+        if (!isFailed){
+            writeValue(file, block.numberOfStates);
+            writeValue(file, UInt_t(compressedSize));
+            writeValue(file, UInt_t(block.raw.size()));
+            file.write(reinterpret_cast<const char*>(compressed.data()), compressedSize);
+            file.flush();
+
+            if (!file.good()){
+                fail("could not be written");
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!isFailed){
+                numberOfBytesWritten += compressedSize + 3 * sizeof(UInt_t);
+            }
+            --numberOfBlocksInFlight;
+        }
+        blockWritten.notify_all();
+    }
+}
+
+void SampleStoreWriter::fail(const std::string reason){
+    // (BACKGROUND THREAD) stop writing and cut a partly written block off the end of the store
+
+    std::cout << "Block of sample store " << pathToStore << " " << reason << ", no further states are stored.\n";
+
+    file.close();
+    if (truncate(pathToStore.c_str(), numberOfBytesWritten) != 0){
+        std::cout << "Sample store " << pathToStore << " could not be truncated.\n";
+    }
+    isFailed = kTRUE;
+}
+
+// ##### READER #####
+SampleStoreReader::SampleStoreReader(const std::string pathToStore) :
+    isFileValid(kFALSE),
+    numberOfVoxels(0),
+    numberOfStates(0),
+    currentBlock(0),
+    statesLeftInBlock(0),
+    position(0),
+    file(pathToStore, std::ios::binary){
+    // open the store and build the block index
+
+    char header[sizeof(magic)];
+    UInt_t fileVersion, statesPerBlock;
+    file.read(header, sizeof(header));
+    if (!file || std::memcmp(header, magic, sizeof(magic)) != 0
+        || !readValue(file, fileVersion) || (fileVersion != version)
+        || !readValue(file, numberOfVoxels) || !readValue(file, statesPerBlock)){
+
+        std::cout << "Invalid sample store: " << pathToStore << "\n";
+        return;
+    }
+
+    UInt_t statesInBlock, compressedSize, rawSize;
+    for (;;){
+        std::streamoff offset = file.tellg();
+        if (!readValue(file, statesInBlock) || !readValue(file, compressedSize) || !readValue(file, rawSize)){
+            break;
+        }
+
+        blockOffsets.push_back(offset);
+        firstStateOfBlock.push_back(numberOfStates);
+        numberOfStates += statesInBlock;
+        file.seekg(compressedSize, std::ios::cur);
+    }
+
+    file.clear();
+    isFileValid = kTRUE;
+    seek(0);
+}
+
+Bool_t SampleStoreReader::next(std::vector<Int_t>& countsInVoxel){
+    // decode the next state, returns kFALSE at the end of the store
+
+    if (!isFileValid){
+        return kFALSE;
+    }
+
+    if (statesLeftInBlock == 0){
+        if (!readBlock(currentBlock + 1)){
+            return kFALSE;
+        }
+    }
+
+    if (position == 0){
+        // key frame
+        currentState.resize(numberOfVoxels);
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            currentState[v] = getVarint(raw, position);
+        }
+
+    } else{
+        UInt_t numberOfChanges = getVarint(raw, position);
+
+        Int_t voxel = 0;
+        for (UInt_t i = 0; i < numberOfChanges; ++i){
+            voxel += getVarint(raw, position);
+            currentState[voxel] += unzigzag(getVarint(raw, position));
+        }
+    }
+
+    --statesLeftInBlock;
+    countsInVoxel = currentState;
+    return kTRUE;
+}
+
+Bool_t SampleStoreReader::seek(const ULong64_t state){
+    // position the reader so that the next call of next() returns the given state
+
+    if (!isFileValid || (state >= numberOfStates)){
+        return kFALSE;
+    }
+
+    UInt_t block = std::upper_bound(firstStateOfBlock.begin(), firstStateOfBlock.end(), state)
+                   - firstStateOfBlock.begin() - 1;
+    readBlock(block);
+
+    std::vector<Int_t> skipped;
+    for (ULong64_t s = firstStateOfBlock[block]; s < state; ++s){
+        next(skipped);
+    }
+
+    return kTRUE;
+}
+
+Bool_t SampleStoreReader::readBlock(const UInt_t block){
+    // read and decompress one block
+
+    if (block >= blockOffsets.size()){
+        return kFALSE;
+    }
+
+    UInt_t statesInBlock, compressedSize, rawSize;
+    file.seekg(blockOffsets[block]);
+    readValue(file, statesInBlock);
+    readValue(file, compressedSize);
+    readValue(file, rawSize);
+
+    std::vector<UChar_t> compressed(compressedSize);
+    file.read(reinterpret_cast<char*>(compressed.data()), compressedSize);
+
+    uLongf size = rawSize;
+    raw.resize(rawSize);
+    if (uncompress(raw.data(), &size, compressed.data(), compressedSize) != Z_OK){
+        std::cout << "Corrupt block " << block << " in sample store.\n";
+        return kFALSE;
+    }
+
+    currentBlock = block;
+    statesLeftInBlock = statesInBlock;
+    position = 0;
+    return kTRUE;
+}
@@ -0,0 +1,108 @@
+// samplestore.h
+// out-of-core storage of OE equilibrium states
+//
+// Each state is delta-encoded against the previous one, because only a few voxels change per sweep.
+// States are grouped in blocks which start with a full state (key frame), are compressed with zlib
+// and written to disk by a background thread.
+//
+// file layout:
+//   header: "SPCIOESS", version, number of voxels, states per block
+//   (blocks are self-contained, so a store can be continued by appending blocks)
+//   blocks: number of states, compressed size, raw size, compressed payload
+//   payload: key frame (counts of all voxels as varints), then per state:
+//            number of changed voxels, pairs of (voxel gap, zigzag encoded count difference)
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <TROOT.h>
+
+// ##### WRITER #####
+class SampleStoreWriter{
+public:
+    SampleStoreWriter(const std::string pathToStore, const Int_t numberOfVoxels, const UInt_t statesPerBlock = 1000,
+                      const Long64_t resumeAtByte = -1);
+    ~SampleStoreWriter();
+
+    void push(const std::vector<Int_t>& countsInVoxel);
+    void flush();
+    void close();
+
+    ULong64_t getNumberOfStates() const { return numberOfStates; }
+    ULong64_t getNumberOfBytesWritten() const { return numberOfBytesWritten; }
+    Bool_t hasFailed() const { return isFailed; }  // nothing is written after a failure, the store ends with the last complete block
+
+private:
+    struct Block{
+        UInt_t numberOfStates;
+        std::vector<UChar_t> raw;
+    };
+
+    void flushBlock();
+    void writeBlocks();
+    void fail(const std::string reason);
+
+    std::string pathToStore;
+    Int_t numberOfVoxels;
+    UInt_t statesPerBlock;
+    ULong64_t numberOfStates;
+    ULong64_t numberOfBytesWritten;
+    Bool_t isClosed;
+    std::atomic<Bool_t> isFailed;
+
+    std::vector<Int_t> previousState;
+    Block currentBlock;
+
+    // blocks handed over to the background thread, bounded to limit the memory
+    std::deque<Block> pendingBlocks;
+    const UInt_t maxPendingBlocks = 4;
+    UInt_t numberOfBlocksInFlight;  // handed over but not yet written
+    Bool_t isFinished;
+
+    std::ofstream file;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable blockReady;
+    std::condition_variable blockTaken;
+    std::condition_variable blockWritten;
+};
+
+// ##### READER #####
+class SampleStoreReader{
+public:
+    SampleStoreReader(const std::string pathToStore);
+    ~SampleStoreReader(){}
+
+    Bool_t isValid() const { return isFileValid; }
+    Int_t getNumberOfVoxels() const { return numberOfVoxels; }
+    ULong64_t getNumberOfStates() const { return numberOfStates; }
+
+    Bool_t next(std::vector<Int_t>& countsInVoxel);
+    Bool_t seek(const ULong64_t state);
+
+private:
+    Bool_t readBlock(const UInt_t block);
+
+    Bool_t isFileValid;
+    Int_t numberOfVoxels;
+    ULong64_t numberOfStates;
+
+    // block index built when opening the file
+    std::vector<std::streamoff> blockOffsets;
+    std::vector<ULong64_t> firstStateOfBlock;
+
+    // currently decoded block
+    UInt_t currentBlock;
+    UInt_t statesLeftInBlock;
+    size_t position;
+    std::vector<UChar_t> raw;
+    std::vector<Int_t> currentState;
+
+    std::ifstream file;
+};
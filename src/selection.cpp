@@ -0,0 +1,82 @@
+// selection.cpp
+
+#include "selection.h"
+#include <fstream>
+#include <iostream>
+
+// ##### SELECTION #####
+Selection::Selection() : minimumEnergy(0), maximumEnergy(0){
+}
+
+void Selection::setDies(const std::vector<Int_t> dies){
+    // only pairs of the given dies are loaded, empty: all dies
+
+    isDieSelected.clear();
+    for (UInt_t i = 0; i < dies.size(); ++i){
+        if (dies[i] < 0){
+            continue;
+        }
+
+        if (dies[i] >= Int_t(isDieSelected.size())){
+            isDieSelected.resize(dies[i] + 1, kFALSE);
+        }
+        isDieSelected[dies[i]] = kTRUE;
+    }
+}
+
+Bool_t Selection::readPairMask(const TString pathToMask){
+    // read the selected pairs from a text file, one pair "d c" per line
+
+    std::ifstream file(pathToMask.Data());
+    if (!file.is_open()){
+        std::cout << "Pair mask " << pathToMask << " could not be read.\n";
+        return kFALSE;
+    }
+
+    std::vector<std::pair<Int_t, Int_t> > pairs;
+    Int_t d, c;
+    while (file >> d >> c){
+        pairs.push_back(std::make_pair(d, c));
+    }
+
+    setPairMask(pairs);
+    return kTRUE;
+}
+
+void Selection::setPairMask(const std::vector<std::pair<Int_t, Int_t> > pairs){
+    // only the given pairs (d, c) are loaded, empty: all pairs
+
+    pairMask.clear();
+    pairMask.insert(pairs.begin(), pairs.end());
+}
+
+Bool_t Selection::isPairSelected(const Int_t d, const Int_t c) const{
+    // both dies and the pair itself have to be selected
+
+    if (!isDieSelected.empty()){
+        if ((d >= Int_t(isDieSelected.size())) || (c >= Int_t(isDieSelected.size()))
+            || !isDieSelected[d] || !isDieSelected[c]){
+            return kFALSE;
+        }
+    }
+
+    return pairMask.empty() || (pairMask.count(std::make_pair(d, c)) != 0);
+}
+
+void Selection::getBinRange(const TH1* spectrum, Int_t& firstBin, Int_t& lastBin) const{
+    // bins of the spectrum with their centers in the energy window
+
+    const TAxis* axis = spectrum->GetXaxis();
+    firstBin = 1;
+    lastBin = axis->GetNbins();
+    if (maximumEnergy <= minimumEnergy){
+        return;
+    }
+
+    while ((firstBin <= lastBin) && (axis->GetBinCenter(firstBin) < minimumEnergy)){
+        ++firstBin;
+    }
+    while ((lastBin >= firstBin) && (axis->GetBinCenter(lastBin) >= maximumEnergy)){
+        --lastBin;
+    }
+}
@@ -0,0 +1,33 @@
+// selection.h
+// subset of the data to be loaded: dies, detector pairs and an energy window
+//
+// The selection is applied while the spectra are read (see Measurements and SystemMatrix),
+// spectra of excluded pairs are neither read nor allocated. Die indices stay the same,
+// the energy axis is cropped to the bins whose centers lie in the window.
+
+#pragma once
+#include <set>
+#include <vector>
+#include <utility>
+#include <TH1.h>
+#include <TString.h>
+
+// ##### SELECTION #####
+class Selection{
+public:
+    Selection();
+
+    void setDies(const std::vector<Int_t> dies);
+    Bool_t readPairMask(const TString pathToMask);
+    void setPairMask(const std::vector<std::pair<Int_t, Int_t> > pairs);
+    void setEnergyWindow(const Double_t minimum, const Double_t maximum){minimumEnergy = minimum; maximumEnergy = maximum;}
+
+    Bool_t isPairSelected(const Int_t d, const Int_t c) const;
+    void getBinRange(const TH1* spectrum, Int_t& firstBin, Int_t& lastBin) const;
+
+private:
+    std::vector<Bool_t> isDieSelected;              // of each die, empty: all dies
+    std::set<std::pair<Int_t, Int_t> > pairMask;    // selected pairs (d, c), empty: all pairs
+    Double_t minimumEnergy;                         // [minimum, maximum), maximum <= minimum: full range
+    Double_t maximumEnergy;
+};
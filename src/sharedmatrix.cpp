@@ -0,0 +1,256 @@
+// sharedmatrix.cpp
+
+#include "sharedmatrix.h"
+#include "largearray.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    const char magic[8] = { 'S', 'P', 'C', 'I', 'S', 'H', 'M', 'M' };
+    const UInt_t version = 2;
+    const size_t alignment = 64;     // cache line, the array starts on its own line
+    const Int_t maxAttempts = 3;
+
+    ULong64_t hashKey(const std::string& key){
+        // FNV-1a, the same in every process
+
+        ULong64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < key.size(); ++i){
+            hash ^= UChar_t(key[i]);
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    size_t align(const size_t numberOfBytes){
+        return (numberOfBytes + alignment - 1) / alignment * alignment;
+    }
+
+    Bool_t isProcessDead(const Int_t process){
+        return (kill(process, 0) != 0) && (errno == ESRCH);
+    }
+}
+
+// ##### SHARED SYSTEM MATRIX #####
+SharedSystemMatrix::SharedSystemMatrix(const std::string key, const Int_t numberOfVoxels, const Int_t numberOfElements) :
+    numberOfVoxels(numberOfVoxels),
+    numberOfElements(numberOfElements),
+    sizeOfSegment(align(sizeof(Header)) + align(numberOfVoxels * sizeof(Double_t))
+                  + size_t(numberOfVoxels) * numberOfElements * sizeof(Float_t)),
+    isCreator(kFALSE),
+    slot(-1){
+    // create the segment of this key or attach to it
+
+    ULong64_t hash = hashKey(key);
+    char nameOfSegment[64];
+    std::snprintf(nameOfSegment, sizeof(nameOfSegment), "/spci_v%u_%016llx", version, (unsigned long long)hash);
+    name = nameOfSegment;
+
+    for (Int_t attempt = 0; attempt < maxAttempts; ++attempt){
+        if (create(hash)){
+            return;
+        }
+
+        // 1: attached, 0: segment was removed meanwhile, -1: not usable
+        Int_t result = attach(hash);
+        if (result != 0){
+            break;
+        }
+    }
+
+    if (!header){
+        std::cout << "\nShared memory " << name << " not available, the system matrix is loaded privately.\n";
+    }
+}
+
+SharedSystemMatrix::~SharedSystemMatrix(){
+    // detach, the last process removes the segment
+
+    if (header){
+        releaseDeadProcesses();
+        if (slot >= 0){
+            header->processes[slot].store(0);
+        }
+        release();
+        unmap();
+    }
+}
+
+void SharedSystemMatrix::publish(){
+    // the array is filled, waiting processes may attach
+
+    header->state.store(1, std::memory_order_release);
+    std::cout << "\nSystem matrix published in shared memory " << name << " ("
+              << sizeOfSegment / (1024.0 * 1024.0) << " MB)\n";
+}
+
+Bool_t SharedSystemMatrix::create(const ULong64_t key){
+    // create and size a new segment, fails if it exists already
+
+    Int_t fileDescriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fileDescriptor < 0){
+        return kFALSE;
+    }
+
+    fchmod(fileDescriptor, 0660);  // other users of the group may attach, independent of the umask
+    if ((ftruncate(fileDescriptor, sizeOfSegment) != 0) || !map(fileDescriptor)){
+        close(fileDescriptor);
+        shm_unlink(name.c_str());
+        return kFALSE;
+    }
+    close(fileDescriptor);
+    LargeArrays::placePages(segment, sizeOfSegment);
+
+    // ftruncate filled the segment with zeros
+    std::memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->numberOfVoxels = numberOfVoxels;
+    header->numberOfElements = numberOfElements;
+    header->publisher = getpid();
+    header->key = key;
+    header->state.store(0);
+    header->references.store(1);
+    header->processes[0].store(getpid());
+    slot = 0;
+
+    isCreator = kTRUE;
+    return kTRUE;
+}
+
+Int_t SharedSystemMatrix::attach(const ULong64_t key){
+    // map an existing segment once it is published and take a reference
+
+    Int_t fileDescriptor = shm_open(name.c_str(), O_RDWR, 0);
+    if (fileDescriptor < 0){
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    // the publisher may not have sized the segment yet
+    struct stat status;
+    status.st_size = 0;
+    for (Int_t wait = 0; (fstat(fileDescriptor, &status) == 0) && (status.st_size == 0) && (wait < 1000); ++wait){
+        usleep(10000);
+    }
+
+    if ((size_t(status.st_size) != sizeOfSegment) || !map(fileDescriptor)){
+        close(fileDescriptor);
+        return -1;
+    }
+    close(fileDescriptor);
+
+    Bool_t isWaitingReported = kFALSE;
+    for (Int_t wait = 0; header->state.load(std::memory_order_acquire) != 1; ++wait){
+        // removed by its publisher (loading failed) or by another process
+        if (header->references.load() == 0){
+            unmap();
+            return 0;
+        }
+
+        // the publisher died before publishing: remove the segment, it will be created anew
+        Int_t publisher = header->publisher;
+        if (((publisher > 0) && isProcessDead(publisher)) || ((publisher == 0) && (wait > 100))){
+            Int_t expected = 1;
+            if (header->references.compare_exchange_strong(expected, 0)){
+                shm_unlink(name.c_str());
+            }
+            unmap();
+            return 0;
+        }
+
+        if (!isWaitingReported){
+            std::cout << "\nWaiting for process " << publisher << " to publish the system matrix in " << name << " ...\n";
+            isWaitingReported = kTRUE;
+        }
+        usleep(100000);
+    }
+
+    if ((std::memcmp(header->magic, magic, sizeof(magic)) != 0) || (header->version != version)
+        || (header->numberOfVoxels != numberOfVoxels) || (header->numberOfElements != numberOfElements)
+        || (header->key != key)){
+        std::cout << "\nShared memory " << name << " holds another system matrix.\n";
+        unmap();
+        return -1;
+    }
+
+    // references of crashed processes would keep the segment forever
+    releaseDeadProcesses();
+
+    // no new references once the last one is gone
+    Int_t references = header->references.load();
+    do{
+        if (references == 0){
+            unmap();
+            return 0;
+        }
+    } while (!header->references.compare_exchange_weak(references, references + 1));
+
+    // a free entry for the process id, otherwise the reference could not be released after a crash
+    Int_t process = getpid();
+    for (Int_t i = 0; (i < maxSharingProcesses) && (slot < 0); ++i){
+        Int_t expected = 0;
+        if (header->processes[i].compare_exchange_strong(expected, process)){
+            slot = i;
+        }
+    }
+
+    if (slot < 0){
+        std::cout << "\nShared memory " << name << " is used by " << maxSharingProcesses << " processes already.\n";
+        release();
+        unmap();
+        return -1;
+    }
+
+    std::cout << "\nSystem matrix attached from shared memory " << name << " (" << references + 1 << " processes)\n";
+    return 1;
+}
+
+Bool_t SharedSystemMatrix::map(const Int_t fileDescriptor){
+    segment = mmap(nullptr, sizeOfSegment, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    if (segment == MAP_FAILED){
+        segment = nullptr;
+        return kFALSE;
+    }
+
+    header = static_cast<Header*>(segment);
+    sensitivities = reinterpret_cast<Double_t*>(static_cast<char*>(segment) + align(sizeof(Header)));
+    array = reinterpret_cast<Float_t*>(static_cast<char*>(segment) + align(sizeof(Header))
+                                       + align(numberOfVoxels * sizeof(Double_t)));
+    return kTRUE;
+}
+
+void SharedSystemMatrix::releaseDeadProcesses(){
+    // release the references of attached processes that no longer exist
+
+    for (Int_t i = 0; i < maxSharingProcesses; ++i){
+        Int_t process = header->processes[i].load();
+        if ((process > 0) && isProcessDead(process) && header->processes[i].compare_exchange_strong(process, 0)){
+            std::cout << "\nReference of the crashed process " << process << " to " << name << " released.\n";
+            release();
+        }
+    }
+}
+
+void SharedSystemMatrix::release(){
+    if (header->references.fetch_sub(1) == 1){
+        shm_unlink(name.c_str());
+    }
+}
+
+void SharedSystemMatrix::unmap(){
+    if (segment){
+        munmap(segment, sizeOfSegment);
+    }
+
+    segment = nullptr;
+    header = nullptr;
+    sensitivities = nullptr;
+    array = nullptr;
+}
@@ -0,0 +1,71 @@
+// sharedmatrix.h
+// system matrix array in POSIX shared memory, shared by all processes using the same system matrix
+//
+// The segment name is derived from a key describing the prepared array (file, its modification time and
+// size, detectors, energy window, pairs and voxels), so a changed system matrix file or another selection
+// never attaches to an old array. The first process creates the segment and fills it (publisher), later
+// processes wait until it is published and map it read-only without loading anything. Every attached
+// process holds a reference and enters its process id in the header, the last one to detach removes the
+// segment. References of crashed processes are released by the next process attaching or detaching, and a
+// segment whose publisher died before publishing is removed by the next process and created anew.
+//
+// segment layout:
+//   header:        "SPCISHMM", version, number of voxels, number of elements, publisher, key, state, references,
+//                  process ids of the attached processes
+//   sensitivities: Double_t of each voxel
+//   array:         Float_t, voxel after voxel, see SystemMatrix::getP_dcb
+
+#pragma once
+#include <atomic>
+#include <string>
+#include <TROOT.h>
+
+// processes attached at the same time, further ones load the system matrix privately
+const Int_t maxSharingProcesses = 64;
+
+// ##### SHARED SYSTEM MATRIX #####
+class SharedSystemMatrix{
+public:
+    SharedSystemMatrix(const std::string key, const Int_t numberOfVoxels, const Int_t numberOfElements);
+    ~SharedSystemMatrix();
+
+    Bool_t isAttached() const {return header != nullptr;}  // kFALSE: use a private array
+    Bool_t isPublisher() const {return isCreator;}          // kTRUE: the array has to be filled and published
+
+    Float_t* getArray() const {return array;}
+    Double_t* getSensitivities() const {return sensitivities;}
+    void publish();
+
+    std::string name;
+
+private:
+    struct Header{
+        char magic[8];
+        UInt_t version;
+        Int_t numberOfVoxels;
+        Int_t numberOfElements;
+        Int_t publisher;                 // process id
+        ULong64_t key;
+        std::atomic<Int_t> state;        // 0 = being filled, 1 = published
+        std::atomic<Int_t> references;   // 0 = being removed, no new references
+        std::atomic<Int_t> processes[maxSharingProcesses];  // process ids, 0 = free
+    };
+
+    Bool_t create(const ULong64_t key);
+    Int_t attach(const ULong64_t key);
+    Bool_t map(const Int_t fileDescriptor);
+    void unmap();
+    void releaseDeadProcesses();
+    void release();                      // the last reference removes the segment
+
+    Int_t numberOfVoxels;
+    Int_t numberOfElements;
+    size_t sizeOfSegment;
+    Bool_t isCreator;
+    Int_t slot;                          // in Header::processes, -1 = none
+
+    void* segment = nullptr;
+    Header* header = nullptr;
+    Double_t* sensitivities = nullptr;
+    Float_t* array = nullptr;
+};
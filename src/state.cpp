@@ -4,68 +4,99 @@
 #include <random>
 #include <algorithm>
 #include "random.h"
+#include "utilities.h"
+
+namespace {
+    ULong64_t splitmix64(ULong64_t& x){
+        // next output of a splitmix64 generator with the state x
+
+        ULong64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    pcg createGeneratorOfSweep(const ULong64_t seed, const ULong64_t sweep){
+        // state and stream both hashed from (seed, sweep), pcg streams differing only in the increment are correlated
+
+        ULong64_t hashOfSweep = sweep;
+        ULong64_t x = seed ^ splitmix64(hashOfSweep);
+        ULong64_t s0 = splitmix64(x);
+        ULong64_t s1 = splitmix64(x);
+        return pcg(s0, s1);
+    }
+}
 
 // ##### STATE CHARACTERIZATION #####
-State::State(const TH3F *N_dcb){
-    // fill the events- and bin-vector in pseudo-list-mode format
+State::State(const TH3F *N_dcb) : isOriginCompact(kTRUE), numberOfSweeps(0){
+    // fill the elements-vector in pseudo-list-mode format
+
+    // generate random seed
+    std::random_device randomDevice;
+    seed = ULong64_t(randomDevice()) << 32 | ULong64_t(randomDevice());
 
     Int_t detD = N_dcb->GetNbinsX();
     Int_t detC = N_dcb->GetNbinsY();
     Int_t nBins = N_dcb->GetNbinsZ();
 
-    Int_t numberOfEvents = 1;
+    // count the events first to allocate the arrays only once
+    ULong64_t numberOfEvents = 0;
     for (Int_t d = 1; d <= detD; ++d){
         for (Int_t c = 1; c <= detC; ++c){
             for (Int_t b = 1; b <= nBins; ++b){
+                numberOfEvents += ULong64_t(N_dcb->GetBinContent(d, c, b));
+            }
+        }
+    }
+    elements.reserve(numberOfEvents);
 
-                std::array<Int_t, 3> dcb = { d, c, b };
-                Int_t numberOfEventsInBin = Int_t(N_dcb->GetBinContent(d, c, b));
-                for (Int_t n = 0; n < numberOfEventsInBin; ++n){
+    for (Int_t d = 1; d <= detD; ++d){
+        for (Int_t c = 1; c <= detC; ++c){
+            for (Int_t b = 1; b <= nBins; ++b){
 
-                    events.push_back(numberOfEvents);
-                    bin.push_back(dcb);
-                    ++numberOfEvents;
-                }
+                UInt_t element = Utilities::getElementIndex(d - 1, c - 1, b - 1, detC, nBins);
+                Int_t numberOfEventsInBin = Int_t(N_dcb->GetBinContent(d, c, b));
+                elements.insert(elements.end(), numberOfEventsInBin, element);
             }
         }
     }
 }
 
+State::State(const std::vector<UInt_t>& elementsOfEvents) :
+    elements(elementsOfEvents), isOriginCompact(kTRUE), numberOfSweeps(0){
+    // take the measurement elements of list-mode events
+
+    // generate random seed
+    std::random_device randomDevice;
+    seed = ULong64_t(randomDevice()) << 32 | ULong64_t(randomDevice());
+
+    // same (d, c, b) order as for the spectra, see inheritOrigins
+    std::sort(elements.begin(), elements.end());
+}
+
 std::vector<Int_t> State::generateRandomOrigins(const Int_t numberOfVoxels,
-                                                const std::vector<std::vector<std::vector<std::vector<Double_t> > > > systemMatrix){
+                                                const std::vector<std::vector<Float_t> >& systemMatrix){
     // generate random origins for each event
     // function is used to generate inital state s_0 for OE algorithm
 
-    // fill countsInVoxel-vector
-    for (Int_t v = 0; v < numberOfVoxels; ++v){
-        countsInVoxel.push_back(0);
-    }
-
-    // generate random seed
-    std::random_device seed;
+    allocateOrigins(numberOfVoxels);
+    UInt_t numberOfEvents = getNumberOfEvents();
 
-    // pcg random number engine
-    pcg generate(seed);
+    // pcg random number engine, one stream per sweep
+    pcg generate = createGeneratorOfSweep(seed, numberOfSweeps++);
 
     // uniform distribution
     std::uniform_real_distribution<Double_t> uniDisVox(0, numberOfVoxels);
 
-    // accelerate by drawing random numbers in advance
-    std::vector<Int_t> randomOrigins;
-    for (UInt_t n = 0; n < events.size(); ++n){
-        Int_t origin = Int_t(uniDisVox(generate));
-        randomOrigins.push_back(origin);
-    }
-
-    for (UInt_t n = 0; n < events.size(); ++n){
+    for (UInt_t n = 0; n < numberOfEvents; ++n){
         // draw random origin
 
-        Int_t origin = randomOrigins[n];
+        UInt_t element = elements[n];
+        Int_t origin = Int_t(uniDisVox(generate));
         while (true){
             // system matrix element must be > 0, so origins lie randomly distributed on the cone
 
-            std::array<Int_t, 3> b = bin[n];
-            Double_t probability = systemMatrix.at(origin).at(b[0] - 1).at(b[1] - 1).at(b[2] - 1);
+            Double_t probability = systemMatrix[origin][element];
 
             if (probability > 0){
                 break;
@@ -74,27 +105,58 @@ std::vector<Int_t> State::generateRandomOrigins(const Int_t numberOfVoxels,
             origin = Int_t(uniDisVox(generate));
         }
 
-        origins.push_back(origin);
+        setOrigin(n, origin);
+        ++countsInVoxel[origin];
+    }
+
+    return countsInVoxel;
+}
+
+std::vector<Int_t> State::inheritOrigins(const State& rebinnedState,
+                                         const std::vector<std::vector<Float_t> >& systemMatrix){
+    // take over the origins of a state of the same events in rebinned spectra
+    // both states list the events in (d, c, b) order, so event n is the same event in both of them
+    // origins which are impossible at this energy resolution are drawn again
+
+    Int_t numberOfVoxels = rebinnedState.countsInVoxel.size();
+    if (rebinnedState.getNumberOfEvents() != getNumberOfEvents()){
+        return generateRandomOrigins(numberOfVoxels, systemMatrix);
+    }
+
+    allocateOrigins(numberOfVoxels);
+    UInt_t numberOfEvents = getNumberOfEvents();
+
+    // pcg random number engine, one stream per sweep
+    pcg generate = createGeneratorOfSweep(seed, numberOfSweeps++);
+
+    // uniform distribution
+    std::uniform_real_distribution<Double_t> uniDisVox(0, numberOfVoxels);
+
+    for (UInt_t n = 0; n < numberOfEvents; ++n){
+        UInt_t element = elements[n];
+        Int_t origin = rebinnedState.getOrigin(n);
+        while (!(systemMatrix[origin][element] > 0)){
+            origin = Int_t(uniDisVox(generate));
+        }
+
+        setOrigin(n, origin);
         ++countsInVoxel[origin];
     }
 
     return countsInVoxel;
 }
 
-std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<std::vector<std::vector<Double_t> > > > systemMatrix,
-                                        const std::vector<Double_t> sensitivities,
+std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                        const std::vector<Double_t>& sensitivities,
                                         Double_t& relTransitions){
     // generate new state for the Marcov Chain
 
     // ##### PREPARATION #####
-    // generate random seed
-    std::random_device seed;
-
-    // pcg random number engine
-    pcg generate(seed);
+    // pcg random number engine, one stream per sweep
+    pcg generate = createGeneratorOfSweep(seed, numberOfSweeps++);
 
     // uniform distribution for events
-    UInt_t numberOfEvents = events.size();
+    UInt_t numberOfEvents = getNumberOfEvents();
     std::uniform_real_distribution<Double_t> uniDisEv(0, numberOfEvents);
 
     // uniform distribution for voxels
@@ -104,34 +166,33 @@ std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<std::vecto
     // uniform distribution for transition of state
     std::uniform_real_distribution<Double_t> uniDisTrans(0, 1);
 
-    // ##### GENERATE RANDOM NUMBERS #####
-    // accelerate by drawing random numbers in advance
-    std::vector<Int_t> randomEvents;
-    std::vector<Int_t> randomOrigins;
-    std::vector<Double_t> transitionChances;
-    for (UInt_t n = 0; n < numberOfEvents; ++n){
-        Int_t randomEvent = Int_t(uniDisEv(generate));
-        randomEvents.push_back(randomEvent);
-
-        Int_t randomOrigin = Int_t(uniDisVox(generate));
-        randomOrigins.push_back(randomOrigin);
-
-        Double_t transitionChance = uniDisTrans(generate);
-        transitionChances.push_back(transitionChance);
-    }
+    std::vector<UInt_t> randomEvents(randomBlockSize);
+    std::vector<UInt_t> randomOrigins(randomBlockSize);
+    std::vector<Double_t> transitionChances(randomBlockSize);
 
     // ##### NEXT STATE #####
     Double_t successfulTransitions = 0;
     for (UInt_t n = 0; n < numberOfEvents; ++n){
 
+        // ##### GENERATE RANDOM NUMBERS #####
+        // accelerate by drawing random numbers in advance, block by block to bound the memory
+        UInt_t r = n % randomBlockSize;
+        if (r == 0){
+            for (UInt_t i = 0; i < randomBlockSize; ++i){
+                randomEvents[i] = UInt_t(uniDisEv(generate));
+                randomOrigins[i] = UInt_t(uniDisVox(generate));
+                transitionChances[i] = uniDisTrans(generate);
+            }
+        }
+
         // randomly select event n
-        Int_t randomEvent = randomEvents[n];
+        UInt_t randomEvent = randomEvents[r];
 
         // origin v of random event n
-        Int_t originFrom = origins[randomEvent];
+        UInt_t originFrom = getOrigin(randomEvent);
 
         // randomly select new origin v' for event n
-        Int_t originTo = randomOrigins[n];
+        UInt_t originTo = randomOrigins[r];
 
         if (originTo == originFrom){
             // if the origins are the same, continue the loop
@@ -139,13 +200,13 @@ std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<std::vecto
         }
 
         // calculate transition probability
-        std::array<Int_t, 3> b = bin[randomEvent];
+        UInt_t element = elements[randomEvent];
 
-        Double_t p_dcbvFrom = systemMatrix[originFrom][b[0] - 1][b[1] - 1][b[2] - 1];
+        Double_t p_dcbvFrom = systemMatrix[originFrom][element];
         Double_t C_svFrom = countsInVoxel[originFrom];
         Double_t sensitivityFrom = sensitivities[originFrom];
 
-        Double_t p_dcbvTo = systemMatrix[originTo][b[0] - 1][b[1] - 1][b[2] - 1];
+        Double_t p_dcbvTo = systemMatrix[originTo][element];
         Double_t C_svTo = countsInVoxel[originTo];
         Double_t sensitivityTo = sensitivities[originTo];
 
@@ -164,13 +225,13 @@ std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<std::vecto
         //                  * std::pow((C_svTo + 1) / C_svTo, C_svTo);
 
         // draw random chance of transition
-        Double_t chance = transitionChances[n];
+        Double_t chance = transitionChances[r];
 
         // move origin to new origin if successful
         Double_t transitionProbability = std::min(1.0, ratio);
         if (chance <= transitionProbability){
 
-            origins[randomEvent] = originTo;
+            setOrigin(randomEvent, originTo);
             --countsInVoxel[originFrom];
             ++countsInVoxel[originTo];
             ++successfulTransitions;
@@ -180,3 +241,147 @@ std::vector<Int_t> State::MCMCNextState(const std::vector<std::vector<std::vecto
     relTransitions = successfulTransitions / numberOfEvents;
     return countsInVoxel;
 }
+
+std::vector<Int_t> State::GibbsNextState(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                         const std::vector<Double_t>& sensitivities,
+                                         Double_t& relTransitions){
+    // generate new state for the Markov Chain by redrawing every origin from its full conditional
+    // P(v | rest) ~ p_dcbv * (C_sv + prior) / s_v, with C_sv not counting the event itself
+
+    // ##### PREPARATION #####
+    // pcg random number engine, one stream per sweep
+    pcg generate = createGeneratorOfSweep(seed, numberOfSweeps++);
+
+    // uniform distribution for drawing from the sum tree
+    std::uniform_real_distribution<Double_t> uniDis(0, 1);
+
+    UInt_t numberOfEvents = getNumberOfEvents();
+    Int_t numberOfVoxels = countsInVoxel.size();
+
+    // support of the current measurement element (d/c/b): voxels with p_dcbv > 0
+    std::vector<Int_t> supportVoxels;
+    std::vector<Double_t> supportFactors;   // p_dcbv / s_v
+    std::vector<Double_t> supportWeights;
+    std::vector<Int_t> positionInSupport(numberOfVoxels, -1);
+    SumTree tree;
+
+    // ##### NEXT STATE #####
+    // events are stored grouped by d/c/b, so one sum tree is built per element
+    // and updated incrementally while its events are redrawn
+    Double_t successfulTransitions = 0;
+    UInt_t n = 0;
+    while (n < numberOfEvents){
+        UInt_t element = elements[n];
+
+        for (UInt_t s = 0; s < supportVoxels.size(); ++s){
+            positionInSupport[supportVoxels[s]] = -1;
+        }
+        supportVoxels.clear();
+        supportFactors.clear();
+        supportWeights.clear();
+
+        for (Int_t v = 0; v < numberOfVoxels; ++v){
+            Double_t p_dcbv = systemMatrix[v][element];
+            if (p_dcbv > 0){
+                Double_t factor = p_dcbv / sensitivities[v];
+
+                positionInSupport[v] = supportVoxels.size();
+                supportVoxels.push_back(v);
+                supportFactors.push_back(factor);
+                supportWeights.push_back(factor * (countsInVoxel[v] + priorCounts));
+            }
+        }
+        tree.build(supportWeights);
+
+        for (; (n < numberOfEvents) && (elements[n] == element); ++n){
+            // remove event n from its origin
+            Int_t originFrom = getOrigin(n);
+            Int_t positionFrom = positionInSupport[originFrom];
+
+            --countsInVoxel[originFrom];
+            tree.set(positionFrom, supportFactors[positionFrom] * (countsInVoxel[originFrom] + priorCounts));
+
+            // draw the new origin from the full conditional
+            Int_t positionTo = tree.find(uniDis(generate) * tree.total());
+            Int_t originTo = supportVoxels[positionTo];
+
+            setOrigin(n, originTo);
+            ++countsInVoxel[originTo];
+            tree.set(positionTo, supportFactors[positionTo] * (countsInVoxel[originTo] + priorCounts));
+
+            if (originTo != originFrom){
+                ++successfulTransitions;
+            }
+        }
+    }
+
+    relTransitions = successfulTransitions / numberOfEvents;
+    return countsInVoxel;
+}
+
+void State::allocateOrigins(const Int_t numberOfVoxels){
+    // empty countsInVoxel-vector and origins of the width given by the number of voxels
+
+    countsInVoxel.assign(numberOfVoxels, 0);
+
+    UInt_t numberOfEvents = getNumberOfEvents();
+    isOriginCompact = (numberOfVoxels <= 65536);
+    if (isOriginCompact){
+        origins16.assign(numberOfEvents, 0);
+        origins32.clear();
+    } else{
+        origins32.assign(numberOfEvents, 0);
+        origins16.clear();
+    }
+}
+
+void State::write(std::ostream& stream) const{
+    // write origins, counts and random number stream position in binary format
+
+    UInt_t numberOfEvents = getNumberOfEvents();
+    UInt_t numberOfVoxels = countsInVoxel.size();
+
+    stream.write((const char*)&seed, sizeof(seed));
+    stream.write((const char*)&numberOfSweeps, sizeof(numberOfSweeps));
+    stream.write((const char*)&numberOfEvents, sizeof(numberOfEvents));
+    stream.write((const char*)&numberOfVoxels, sizeof(numberOfVoxels));
+    stream.write((const char*)&isOriginCompact, sizeof(isOriginCompact));
+
+    if (isOriginCompact){
+        stream.write((const char*)origins16.data(), numberOfEvents * sizeof(UShort_t));
+    } else{
+        stream.write((const char*)origins32.data(), numberOfEvents * sizeof(UInt_t));
+    }
+    stream.write((const char*)countsInVoxel.data(), numberOfVoxels * sizeof(Int_t));
+}
+
+Bool_t State::read(std::istream& stream){
+    // restore a state written by State::write, the events must be the same
+
+    UInt_t numberOfEvents, numberOfVoxels;
+    stream.read((char*)&seed, sizeof(seed));
+    stream.read((char*)&numberOfSweeps, sizeof(numberOfSweeps));
+    stream.read((char*)&numberOfEvents, sizeof(numberOfEvents));
+    stream.read((char*)&numberOfVoxels, sizeof(numberOfVoxels));
+    stream.read((char*)&isOriginCompact, sizeof(isOriginCompact));
+
+    if (!stream || (numberOfEvents != getNumberOfEvents())){
+        std::cout << "Checkpoint does not match the measurements.\n";
+        return kFALSE;
+    }
+
+    if (isOriginCompact){
+        origins16.resize(numberOfEvents);
+        origins32.clear();
+        stream.read((char*)origins16.data(), numberOfEvents * sizeof(UShort_t));
+    } else{
+        origins32.resize(numberOfEvents);
+        origins16.clear();
+        stream.read((char*)origins32.data(), numberOfEvents * sizeof(UInt_t));
+    }
+
+    countsInVoxel.resize(numberOfVoxels);
+    stream.read((char*)countsInVoxel.data(), numberOfVoxels * sizeof(Int_t));
+
+    return Bool_t(stream);
+}
@@ -3,24 +3,63 @@
 #pragma once
 #include <array>
 #include <vector>
+#include <iostream>
 #include <TH3.h>
 
+#include "sumtree.h"
+
+// pseudo-counts added to C_sv in the full conditional of the Gibbs sampler
+// 0.5 corresponds to Jeffrey's prior, 1.0 to the flat prior
+const Double_t priorCounts = 0.5;
+
+// number of random numbers drawn in advance per block of events
+const UInt_t randomBlockSize = 65536;
+
 // ##### STATE CHARACTERIZATION #####
+// events n = 0 ... N - 1 are only identified by their position in the arrays (structure of arrays)
+// origins are stored with 16 bit if the number of voxels allows it, otherwise with 32 bit
 class State{
 public:
     State(const TH3F* N_dcb);
+    State(const std::vector<UInt_t>& elementsOfEvents);  // list-mode
     ~State(){}
 
     std::vector<Int_t> generateRandomOrigins(const Int_t numberOfVoxels,
-                                             const std::vector<std::vector<std::vector<std::vector<Double_t> > > > systemMatrix);
-    std::vector<Int_t> MCMCNextState(const std::vector<std::vector<std::vector<std::vector<Double_t> > > > systemMatrix,
-                                     const std::vector<Double_t> sensitivities,
+                                             const std::vector<std::vector<Float_t> >& systemMatrix);
+    std::vector<Int_t> inheritOrigins(const State& rebinnedState,
+                                      const std::vector<std::vector<Float_t> >& systemMatrix);
+    std::vector<Int_t> MCMCNextState(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                     const std::vector<Double_t>& sensitivities,
                                      Double_t& relTransitions);
+    std::vector<Int_t> GibbsNextState(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                      const std::vector<Double_t>& sensitivities,
+                                      Double_t& relTransitions);
+
+    void write(std::ostream& stream) const;
+    Bool_t read(std::istream& stream);
+
+    UInt_t getNumberOfEvents() const { return elements.size(); }
+    UInt_t getOrigin(const UInt_t n) const { return isOriginCompact ? origins16[n] : origins32[n]; }
+    void setOrigin(const UInt_t n, const UInt_t v){
+        if (isOriginCompact){
+            origins16[n] = UShort_t(v);
+        } else{
+            origins32[n] = v;
+        }
+    }
 
     // ##### MEMBERS #####
-    std::vector<Int_t> events;                  // events n from 1 ... N
-    std::vector<Int_t> origins;                 // origins (=voxels) v of event n
-    std::vector<std::array<Int_t, 3>> bin;      // detector element/bin (d/c/b) of event n
+    std::vector<UInt_t> elements;               // measurement element (d/c/b) of event n, see Utilities::getElementIndex
+    std::vector<UShort_t> origins16;            // origins (=voxels) v of event n, if number of voxels <= 65536
+    std::vector<UInt_t> origins32;              // origins (=voxels) v of event n, otherwise
+    Bool_t isOriginCompact;
 
     std::vector<Int_t> countsInVoxel;           // counts C_sv in voxel v
+
+    // every sweep draws from its own pcg generator hashed from (seed, sweep), so a chain can be continued exactly
+    ULong64_t seed;
+    ULong64_t numberOfSweeps;
+
+private:
+    void allocateOrigins(const Int_t numberOfVoxels);
 };
@@ -0,0 +1,71 @@
+// sumtree.cpp
+
+#include "sumtree.h"
+
+// ##### SUM TREE #####
+void SumTree::build(const std::vector<Double_t>& weights){
+    // build the tree in O(n) from the given weights
+
+    numberOfLeaves = weights.size();
+    leaves = weights;
+    tree.assign(numberOfLeaves + 1, 0.0);
+
+    for (Int_t i = 1; i <= numberOfLeaves; ++i){
+        tree[i] += leaves[i - 1];
+
+        Int_t parent = i + (i & -i);
+        if (parent <= numberOfLeaves){
+            tree[parent] += tree[i];
+        }
+    }
+
+    highestPowerOfTwo = 1;
+    while (2 * highestPowerOfTwo <= numberOfLeaves){
+        highestPowerOfTwo *= 2;
+    }
+}
+
+void SumTree::set(const Int_t leaf, const Double_t weight){
+    // change the weight of one leaf in O(log n)
+
+    Double_t delta = weight - leaves[leaf];
+    leaves[leaf] = weight;
+
+    for (Int_t i = leaf + 1; i <= numberOfLeaves; i += i & -i){
+        tree[i] += delta;
+    }
+}
+
+Double_t SumTree::total() const{
+    // sum of all weights
+
+    Double_t sum = 0.0;
+    for (Int_t i = numberOfLeaves; i > 0; i -= i & -i){
+        sum += tree[i];
+    }
+
+    return sum;
+}
+
+Int_t SumTree::find(Double_t target) const{
+    // find the leaf i with sum(0 ... i - 1) <= target < sum(0 ... i) in O(log n)
+
+    Int_t position = 0;
+    for (Int_t step = highestPowerOfTwo; step > 0; step /= 2){
+        Int_t next = position + step;
+        if ((next <= numberOfLeaves) && (tree[next] <= target)){
+            position = next;
+            target -= tree[next];
+        }
+    }
+
+    // rounding may push the target beyond the last leaf or onto an empty leaf
+    if (position >= numberOfLeaves){
+        position = numberOfLeaves - 1;
+    }
+    while ((position > 0) && (leaves[position] <= 0)){
+        --position;
+    }
+
+    return position;
+}
@@ -0,0 +1,28 @@
+// sumtree.h
+// Fenwick tree (binary indexed tree) over non-negative weights
+
+#pragma once
+#include <vector>
+#include <TROOT.h>
+
+// ##### SUM TREE #####
+class SumTree{
+public:
+    SumTree() : numberOfLeaves(0), highestPowerOfTwo(0){}
+    ~SumTree(){}
+
+    void build(const std::vector<Double_t>& weights);
+    void set(const Int_t leaf, const Double_t weight);
+    Int_t find(Double_t target) const;
+
+    Double_t total() const;
+    Double_t weight(const Int_t leaf) const { return leaves[leaf]; }
+    Int_t size() const { return numberOfLeaves; }
+
+private:
+    Int_t numberOfLeaves;
+    Int_t highestPowerOfTwo;
+
+    std::vector<Double_t> leaves;   // weight of leaf i
+    std::vector<Double_t> tree;     // partial sums, 1-based
+};
@@ -0,0 +1,364 @@
+// sweep.cpp
+
+#include "sweep.h"
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <TFile.h>
+#include <TBenchmark.h>
+
+#include "batchmlem.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+// ##### SWEEP RECONSTRUCTION #####
+ReconstructionSweepMLEM::ReconstructionSweepMLEM(const TString pathToMeasurements,
+                                                 const TString pathToProjections,
+                                                 const std::vector<Double_t> volume,
+                                                 const Selection& selection,
+                                                 const RegionOfInterest& regionOfInterest) :
+    isSavingImages(kFALSE){
+    // prepare data for the sweep using ML-EM
+
+    TBenchmark b;
+
+    // prepare the measurement data
+    b.Start("N_dcb");
+    Measurements* measurementData = new Measurements(pathToMeasurements, selection);
+    measurementData->createN_dcb();
+    measurementData->fillN_dcb(kFALSE);
+    N_dcb = measurementData->getN_dcbArray();
+    b.Stop("N_dcb");
+
+    // prepare the image & system matrix
+    b.Start("p_dcb");
+    systemMatrixData = new SystemMatrix(pathToProjections, selection);
+
+    isCalculationValid = Utilities::checkForSameNumberOfBins(measurementData->numberOfBins,
+                                                             systemMatrixData->numberOfBins)
+                         && systemMatrixData->setRegionOfInterest(regionOfInterest, volume);
+
+    if (isCalculationValid){
+        systemMatrixData->createSystemMatrixArray(measurementData->numberOfDetectors);
+    }
+    b.Stop("p_dcb");
+    delete measurementData;
+
+    b.Start("A_v");
+    image = new ImageSpace(volume, systemMatrixData->size, systemMatrixData->voxels);
+    b.Stop("A_v");
+
+    std::cout << "\nN_dcb Creation Time:\t" << b.GetRealTime("N_dcb") << " s\n";
+    std::cout << "\np_dcb Creation Time:\t" << b.GetRealTime("p_dcb") << " s\n";
+    std::cout << "\nA_v Creation Time:\t" << b.GetRealTime("A_v") << " s\n";
+}
+
+ReconstructionSweepMLEM::~ReconstructionSweepMLEM(){
+    delete image;
+    delete systemMatrixData;
+}
+
+Bool_t ReconstructionSweepMLEM::setPhantom(const TString pathToPhantom){
+    // known activity distribution "A_v", sampled at the voxel centers of the image
+
+    TFile* file = new TFile(pathToPhantom, "READ");
+    TH3F* phantomA_v = file->IsOpen() ? (TH3F*)file->Get("A_v") : nullptr;
+    if (!phantomA_v){
+        std::cout << "No phantom A_v found in " << pathToPhantom << "\n";
+        delete file;
+        return kFALSE;
+    }
+
+    phantom.assign(image->numberOfVoxels, 0.0);
+    for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+        std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+
+        Double_t x = image->A_v->GetXaxis()->GetBinCenter(coordinate[0]);
+        Double_t y = image->A_v->GetYaxis()->GetBinCenter(coordinate[1]);
+        Double_t z = image->A_v->GetZaxis()->GetBinCenter(coordinate[2]);
+        phantom[v] = phantomA_v->GetBinContent(phantomA_v->FindBin(x, y, z));
+    }
+
+    file->Close();
+    delete file;
+    return kTRUE;
+}
+
+void ReconstructionSweepMLEM::start(const std::vector<Double_t> accelerators,
+                                    const std::vector<Int_t> iterations,
+                                    const std::vector<Int_t> subsets,
+                                    const std::vector<Double_t> tolerances){
+    // reconstruct all settings of the grid in parallel
+
+    if (!isCalculationValid || accelerators.empty() || iterations.empty() || subsets.empty() || tolerances.empty()){
+        return;
+    }
+
+    TBenchmark b;
+
+    requestedIterations = iterations;
+    std::sort(requestedIterations.begin(), requestedIterations.end());
+    requestedIterations.erase(std::unique(requestedIterations.begin(), requestedIterations.end()),
+                              requestedIterations.end());
+
+    settings.clear();
+    results.clear();
+    for (UInt_t s = 0; s < subsets.size(); ++s){
+        for (UInt_t a = 0; a < accelerators.size(); ++a){
+            for (UInt_t t = 0; t < tolerances.size(); ++t){
+                Setting setting;
+                setting.accelerator = accelerators[a];
+                setting.numberOfSubsets = std::max(1, subsets[s]);
+                setting.tolerance = tolerances[t];
+                settings.push_back(setting);
+            }
+        }
+    }
+
+    b.Start("sweep");
+    {
+        ThreadPool pool;
+
+        // settings with the same number of subsets share a batch, batches are split to keep all threads busy
+        Int_t numberOfThreads = pool.getNumberOfThreads();
+        Int_t settingsPerBatch = std::max<Int_t>(1, (settings.size() + numberOfThreads - 1) / numberOfThreads);
+
+        UInt_t first = 0;
+        while (first < settings.size()){
+            std::vector<Int_t> settingsOfBatch;
+            for (UInt_t i = first; (i < settings.size()) && (Int_t(settingsOfBatch.size()) < settingsPerBatch)
+                 && (settings[i].numberOfSubsets == settings[first].numberOfSubsets); ++i){
+                settingsOfBatch.push_back(i);
+            }
+            first += settingsOfBatch.size();
+
+            pool.enqueue(std::bind(&ReconstructionSweepMLEM::reconstructSettings, this, settingsOfBatch));
+        }
+
+        pool.wait();
+    }
+    b.Stop("sweep");
+
+    std::sort(results.begin(), results.end(), [](const Result& r1, const Result& r2){
+        return (r1.setting < r2.setting) || ((r1.setting == r2.setting) && (r1.iterations < r2.iterations));
+    });
+
+    // Inform user
+    std::cout << "\nSweep done. Settings: " << settings.size()
+              << ", Steps: " << requestedIterations.back() << "\n";
+    std::cout << "\nCalculation Time:\t" << b.GetRealTime("sweep") << " seconds\n";
+
+    saveResults("MLEM_Sweep.csv", "MLEM_Sweep.root");
+}
+
+void ReconstructionSweepMLEM::reconstructSettings(const std::vector<Int_t> settingsOfBatch){
+    // (WORKER THREAD) reconstruct the settings as one batch and record the requested iterations
+
+    Int_t K = settingsOfBatch.size();
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    BatchMLEM batch(systemMatrixData, std::vector<std::vector<Double_t> >(K, N_dcb));
+    batch.setNumberOfSubsets(settings[settingsOfBatch[0]].numberOfSubsets);
+    for (Int_t k = 0; k < K; ++k){
+        batch.setAccelerator(k, settings[settingsOfBatch[k]].accelerator);
+    }
+
+    // the setup is shared by all jobs of the batch, stopped jobs no longer take a share
+    Double_t setupTime = std::chrono::duration<Double_t>(std::chrono::steady_clock::now() - startTime).count();
+    std::vector<Double_t> timeOfJob(K, setupTime / K);
+
+    std::vector<Int_t> stoppedAt(K, 0);
+    std::vector<Double_t> previousLogLike;
+    std::vector<Result> resultsOfBatch;
+
+    UInt_t nextRequest = 0;
+    for (Int_t n = 1; nextRequest < requestedIterations.size(); ++n){
+        std::chrono::steady_clock::time_point startOfIteration = std::chrono::steady_clock::now();
+        std::vector<Int_t> activeJobs;
+        for (Int_t k = 0; k < K; ++k){
+            if (stoppedAt[k] == 0){
+                activeJobs.push_back(k);
+            }
+        }
+
+        batch.iterate();
+
+        // stop criterion
+        std::vector<Double_t> logLike = batch.calculateLogLike();
+        Int_t numberOfActiveJobs = 0;
+        for (Int_t k = 0; k < K; ++k){
+            Double_t tolerance = settings[settingsOfBatch[k]].tolerance;
+            if ((stoppedAt[k] == 0) && (tolerance > 0) && !previousLogLike.empty()
+                && (previousLogLike[k] - logLike[k] < tolerance * std::abs(previousLogLike[k]))){
+
+                stoppedAt[k] = n;
+                batch.setActive(k, kFALSE);
+            }
+
+            if (stoppedAt[k] == 0){
+                ++numberOfActiveJobs;
+            }
+        }
+        previousLogLike = logLike;
+
+        Double_t timeOfIteration = std::chrono::duration<Double_t>(std::chrono::steady_clock::now() - startOfIteration).count();
+        for (UInt_t i = 0; i < activeJobs.size(); ++i){
+            timeOfJob[activeJobs[i]] += timeOfIteration / activeJobs.size();
+        }
+
+        if ((n != requestedIterations[nextRequest]) && (numberOfActiveJobs != 0)){
+            continue;
+        }
+
+        // record the current images, which stay the same for all remaining requests once every job has stopped
+        std::vector<Double_t> chiSquare = batch.calculateChiSquare();
+
+        UInt_t lastRequest = (numberOfActiveJobs != 0) ? nextRequest + 1 : requestedIterations.size();
+        for (; nextRequest < lastRequest; ++nextRequest){
+            for (Int_t k = 0; k < K; ++k){
+                Result result;
+                result.setting = settingsOfBatch[k];
+                result.iterations = requestedIterations[nextRequest];
+                result.stoppedAt = stoppedAt[k];
+                result.jobsInBatch = K;
+                result.time = timeOfJob[k];
+                result.logLike = logLike[k];
+                result.chiSquare = chiSquare[k];
+                result.nrmse = 0.0;
+                result.correlation = 0.0;
+
+                if (isSavingImages || !phantom.empty()){
+                    batch.getImage(k, result.image);
+                    calculateImageQuality(result.image, result.nrmse, result.correlation);
+
+                    if (!isSavingImages){
+                        result.image.clear();
+                    }
+                }
+
+                resultsOfBatch.push_back(result);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    results.insert(results.end(), resultsOfBatch.begin(), resultsOfBatch.end());
+}
+
+void ReconstructionSweepMLEM::calculateImageQuality(const std::vector<Double_t>& activities,
+                                                    Double_t& nrmse, Double_t& correlation) const{
+    // normalized root mean square error and correlation coefficient against the phantom
+
+    if (phantom.empty()){
+        return;
+    }
+
+    Double_t sumOfActivities = 0.0;
+    Double_t sumOfPhantom = 0.0;
+    for (UInt_t v = 0; v < phantom.size(); ++v){
+        sumOfActivities += activities[v];
+        sumOfPhantom += phantom[v];
+    }
+
+    if ((sumOfActivities <= 0) || (sumOfPhantom <= 0)){
+        return;
+    }
+
+    Double_t meanOfActivities = 1.0 / phantom.size();
+    Double_t meanOfPhantom = 1.0 / phantom.size();
+    Double_t squaredError = 0.0, squaredPhantom = 0.0;
+    Double_t covariance = 0.0, varianceOfActivities = 0.0, varianceOfPhantom = 0.0;
+    for (UInt_t v = 0; v < phantom.size(); ++v){
+        Double_t x = activities[v] / sumOfActivities;
+        Double_t y = phantom[v] / sumOfPhantom;
+
+        squaredError += (x - y) * (x - y);
+        squaredPhantom += y * y;
+
+        covariance += (x - meanOfActivities) * (y - meanOfPhantom);
+        varianceOfActivities += (x - meanOfActivities) * (x - meanOfActivities);
+        varianceOfPhantom += (y - meanOfPhantom) * (y - meanOfPhantom);
+    }
+
+    nrmse = std::sqrt(squaredError / squaredPhantom);
+    if ((varianceOfActivities > 0) && (varianceOfPhantom > 0)){
+        correlation = covariance / std::sqrt(varianceOfActivities * varianceOfPhantom);
+    }
+}
+
+void ReconstructionSweepMLEM::saveResults(const TString pathToTable, const TString pathToImages){
+    // write the table of all settings and iterations, and the images if requested
+
+    std::ofstream table(pathToTable.Data());
+    table << "accelerator,subsets,tolerance,iterations,stoppedAt,jobsInBatch,time_s,negLogLike,chiSquare";
+    if (!phantom.empty()){
+        table << ",nrmse,correlation";
+    }
+    table << "\n";
+
+    std::cout << "\n" << std::setw(8) << "acc" << std::setw(8) << "subsets" << std::setw(10) << "tol"
+              << std::setw(8) << "iter" << std::setw(8) << "stop" << std::setw(12) << "time [s]"
+              << std::setw(16) << "-log L" << std::setw(16) << "chi^2";
+    if (!phantom.empty()){
+        std::cout << std::setw(12) << "nrmse" << std::setw(12) << "corr";
+    }
+    std::cout << "\n";
+
+    for (UInt_t i = 0; i < results.size(); ++i){
+        const Result& result = results[i];
+        const Setting& setting = settings[result.setting];
+
+        table << setting.accelerator << "," << setting.numberOfSubsets << "," << setting.tolerance << ","
+              << result.iterations << "," << result.stoppedAt << "," << result.jobsInBatch << ","
+              << result.time << "," << std::setprecision(12) << result.logLike << "," << result.chiSquare
+              << std::setprecision(6);
+        if (!phantom.empty()){
+            table << "," << result.nrmse << "," << result.correlation;
+        }
+        table << "\n";
+
+        std::cout << std::setw(8) << setting.accelerator << std::setw(8) << setting.numberOfSubsets
+                  << std::setw(10) << setting.tolerance << std::setw(8) << result.iterations
+                  << std::setw(8) << result.stoppedAt << std::setw(12) << result.time
+                  << std::setw(16) << result.logLike << std::setw(16) << result.chiSquare;
+        if (!phantom.empty()){
+            std::cout << std::setw(12) << result.nrmse << std::setw(12) << result.correlation;
+        }
+        std::cout << "\n";
+    }
+
+    table.close();
+    std::cout << "\nSweep table written to " << pathToTable << "\n";
+
+    if (!isSavingImages){
+        return;
+    }
+
+    TFile* file = new TFile(pathToImages, "RECREATE");
+    file->cd();
+
+    for (UInt_t i = 0; i < results.size(); ++i){
+        const Result& result = results[i];
+        const Setting& setting = settings[result.setting];
+
+        image->A_v->Reset();
+        for (Int_t v = 0; v < image->numberOfVoxels; ++v){
+            std::array<Int_t, 3> coordinate = image->imageIndices.at(v);
+            image->A_v->SetBinContent(coordinate[0], coordinate[1], coordinate[2], result.image[v]);
+        }
+
+        TString name, title;
+        name.Form("A_v_%i_%i", result.setting, result.iterations);
+        title.Form("accelerator %g, subsets %i, tolerance %g, iterations %i",
+                   setting.accelerator, setting.numberOfSubsets, setting.tolerance, result.iterations);
+        image->A_v->SetTitle(title);
+        image->A_v->Write(name);
+    }
+
+    file->Close();
+    delete file;
+
+    std::cout << "\nImages written to " << pathToImages << "\n";
+}
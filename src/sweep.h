@@ -0,0 +1,74 @@
+// sweep.h
+// grid search over the ML-EM settings with one loaded system matrix and measurement
+//
+// Every combination of (accelerator, number of subsets, stop tolerance) is one setting.
+// Settings with the same number of subsets are reconstructed together as batches (see batchmlem.h)
+// on a thread pool, each batch running up to the largest requested number of iterations.
+// Results are taken only at the requested iteration counts.
+
+#pragma once
+#include <vector>
+#include <mutex>
+#include <TH3.h>
+
+#include "imagespace.h"
+#include "systemmatrix.h"
+#include "measurements.h"
+
+// ##### SWEEP RECONSTRUCTION #####
+class ReconstructionSweepMLEM{
+public:
+    ReconstructionSweepMLEM(const TString pathToMeasurements,
+                            const TString pathToProjections,
+                            const std::vector<Double_t> volume,
+                            const Selection& selection = Selection(),
+                            const RegionOfInterest& regionOfInterest = RegionOfInterest());
+    ~ReconstructionSweepMLEM();
+
+    Bool_t setPhantom(const TString pathToPhantom);
+    void setSaveImages(const Bool_t s){isSavingImages = s;}
+
+    void start(const std::vector<Double_t> accelerators,
+               const std::vector<Int_t> iterations,
+               const std::vector<Int_t> subsets,
+               const std::vector<Double_t> tolerances);
+
+private:
+    struct Setting{
+        Double_t accelerator;
+        Int_t numberOfSubsets;
+        Double_t tolerance;     // stop if -log L decreases less than this fraction, 0 = never
+    };
+
+    struct Result{
+        Int_t setting;
+        Int_t iterations;
+        Int_t stoppedAt;        // iteration the stop criterion was met, 0 = not met
+        Int_t jobsInBatch;
+        Double_t time;          // share of the wall time of the batch, in s: every iteration split among its active jobs
+        Double_t logLike;
+        Double_t chiSquare;
+        Double_t nrmse;         // image quality against the phantom, both normalized to a sum of 1
+        Double_t correlation;
+        std::vector<Double_t> image;
+    };
+
+    void reconstructSettings(const std::vector<Int_t> settingsOfBatch);
+    void calculateImageQuality(const std::vector<Double_t>& activities, Double_t& nrmse, Double_t& correlation) const;
+    void saveResults(const TString pathToTable, const TString pathToImages);
+
+    // ##### MEMBERS #####
+    Bool_t isCalculationValid;
+    Bool_t isSavingImages;
+
+    std::vector<Setting> settings;
+    std::vector<Int_t> requestedIterations;    // sorted
+    std::vector<Result> results;
+    std::mutex resultsMutex;
+
+    std::vector<Double_t> N_dcb;
+    std::vector<Double_t> phantom;             // empty if no phantom is known
+
+    SystemMatrix* systemMatrixData = nullptr;
+    ImageSpace* image = nullptr;
+};
@@ -1,11 +1,19 @@
 // systemmatrix.cpp
 
 #include "systemmatrix.h"
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <sys/stat.h>
 #include "utilities.h"
 
+Bool_t SystemMatrix::isArrayShared = kFALSE;
+
 // ##### SYSTEM MATRIX #####
-SystemMatrix::SystemMatrix(const TString pathToProjections) : numberOfBins(0){
-    // open the projections *.root file
+SystemMatrix::SystemMatrix(const TString pathToProjections, const Selection& selection) :
+    numberOfBins(0), numberOfDetectors(0), numberOfElements(0), numberOfVoxels(0), minimumEnergy(0), maximumEnergy(0),
+    selection(selection), firstBin(1){
+    // open the projections *.root file, only the selected spectra will be read
 
     systemMatrixFile = new TFile(pathToProjections, "READ");
     nextVoxel = new TIter(systemMatrixFile->GetListOfKeys());
@@ -18,11 +26,10 @@ SystemMatrix::SystemMatrix(const TString pathToProjections) : numberOfBins(0){
 }
 
 SystemMatrix::~SystemMatrix(){
-    // p_dcbvPrime->Clear();
     // systemMatrix->Delete();
 
-    delete p_dcbvPrime;
     delete systemMatrix;
+    delete sharedArray;
     delete keyS_dcVoxel;
     delete keyVoxel;
     delete nextVoxel;
@@ -30,24 +37,18 @@ SystemMatrix::~SystemMatrix(){
 }
 
 void SystemMatrix::createSystemMatrix(const Int_t nDet){
-    // (OE MODE) create 4d vector containing the probabilities for each voxel = system matrix
+    // (OE MODE) create 2d vector containing the probabilities for each voxel = system matrix
 
     // iterate through all voxels v
+    Int_t voxel = 0;
     nextVoxel->Reset();
     while ((keyVoxel = (TKey*)nextVoxel->Next())){
-        std::vector<std::vector<std::vector<Double_t> > > p_dcb;
-
-        for (Int_t d = 0; d < nDet; ++d){
-            std::vector<std::vector<Double_t> > p_cb;
-
-            for (Int_t c = 0; c < nDet; ++c){
-                std::vector<Double_t> p_b;
-                p_cb.push_back(p_b);
-            }
-
-            p_dcb.push_back(p_cb);
+        if (!isVoxelLoaded(voxel++)){
+            continue;
         }
 
+        std::vector<Float_t> p_dcb(nDet * nDet * numberOfBins, 0.0);
+
         Double_t sensitivity = 0;
         TString nameOfVoxel = keyVoxel->GetName();
         TDirectory* dirOfVoxel = (TDirectory*)systemMatrixFile->Get(nameOfVoxel);
@@ -56,17 +57,21 @@ void SystemMatrix::createSystemMatrix(const Int_t nDet){
             // iterate through all spectra in voxel v
 
             TString nameOfS_dc = keyS_dcVoxel->GetName();
+            Int_t detectorD;
+            Int_t detectorC;
+            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
+
             TH1F* S_dc = (TH1F*)dirOfVoxel->Get(nameOfS_dc);
 
             // Divide counts by numbers of EMISSIONS (usually unkown) in the voxel to maintain absolute counts
             S_dc->Scale(1.0 / 5000000);  // Tonis Simulation 20181212_5x5mm2.root with 441 positions, solid angle correction not considered
 
-            Int_t detectorD;
-            Int_t detectorC;
-            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
             for (Int_t bin = 1; bin <= numberOfBins; ++bin){
-                Double_t binContent = S_dc->GetBinContent(bin);
-                p_dcb.at(detectorD).at(detectorC).push_back(binContent);
+                Double_t binContent = S_dc->GetBinContent(firstBin + bin - 1);
+                p_dcb.at(Utilities::getElementIndex(detectorD, detectorC, bin - 1, nDet, numberOfBins)) = binContent;
 
                 sensitivity += binContent;
             }
@@ -86,8 +91,13 @@ void SystemMatrix::createSystemMatrix(const Bool_t normalized, const TH3F *N_dcb
     systemMatrix = new TList();
 
     // iterate through all voxels v
+    Int_t voxel = 0;
     nextVoxel->Reset();
     while ((keyVoxel = (TKey*)nextVoxel->Next())){
+        if (!isVoxelLoaded(voxel++)){
+            continue;
+        }
+
         TString nameOfVoxel = keyVoxel->GetName();
 
         TString description;
@@ -106,6 +116,13 @@ void SystemMatrix::createSystemMatrix(const Bool_t normalized, const TH3F *N_dcb
             // iterate through all spectra in voxel v
 
             TString nameOfS_dc = keyS_dcVoxel->GetName();
+            Int_t detectorD;
+            Int_t detectorC;
+            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
+
             TH1F* S_dc = (TH1F*)dirOfVoxel->Get(nameOfS_dc);
 
             // Divide counts by numbers of EMISSIONS (usually unkown) in the voxel to maintain absolute counts
@@ -115,17 +132,14 @@ void SystemMatrix::createSystemMatrix(const Bool_t normalized, const TH3F *N_dcb
                 // faster converge because distant detectors, which have more precise position information, get more weight
                 // only working for MLEM
 
-                S_dc->Scale(1.0 / S_dc->Integral());
+                S_dc->Scale(1.0 / S_dc->Integral(firstBin, firstBin + numberOfBins - 1));
             }
 
-            Int_t detectorD;
-            Int_t detectorC;
-            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
             for (Int_t bin = 1; bin <= numberOfBins; ++bin){
 
                 Double_t N_dcbBinContent = N_dcb->GetBinContent(detectorD + 1, detectorC + 1, bin);
                 if (N_dcbBinContent != 0){
-                    p_dcb->SetBinContent(detectorD + 1, detectorC + 1, bin, S_dc->GetBinContent(bin));
+                    p_dcb->SetBinContent(detectorD + 1, detectorC + 1, bin, S_dc->GetBinContent(firstBin + bin - 1));
                 }
             }
 
@@ -138,31 +152,248 @@ void SystemMatrix::createSystemMatrix(const Bool_t normalized, const TH3F *N_dcb
     }
 }
 
-void SystemMatrix::createP_dcbvPrime(const TH3F *N_dcb){
-    // Multiply p_dcbv * N_dcb once to reduce computation time during iterations
+void SystemMatrix::createSystemMatrixArray(const Int_t nDet){
+    // (BATCHED ML-EM MODE) create one array containing the probabilities for each voxel = system matrix
+
+    numberOfDetectors = nDet;
+    numberOfElements = nDet * nDet * numberOfBins;
+    numberOfVoxels = voxels.empty() ? systemMatrixFile->GetListOfKeys()->GetSize() : voxels.size();
+
+    // with sharing, only the first process loads the array, all others attach to it
+    if (isArrayShared){
+        sharedArray = new SharedSystemMatrix(getArrayKey(), numberOfVoxels, numberOfElements);
+        if (!sharedArray->isAttached()){
+            delete sharedArray;
+            sharedArray = nullptr;
+
+        } else if (!sharedArray->isPublisher()){
+            p_dcbvArray = sharedArray->getArray();
+            sensitivities.assign(sharedArray->getSensitivities(), sharedArray->getSensitivities() + numberOfVoxels);
+            return;
+        }
+    }
+
+    Float_t* array;
+    if (sharedArray){
+        array = sharedArray->getArray();  // zeros already
+    } else{
+        systemMatrixArray.assign(size_t(numberOfVoxels) * numberOfElements, 0);
+        array = systemMatrixArray.data();
+    }
+    p_dcbvArray = array;
+
+    // iterate through all voxels v
+    Int_t v = 0;
+    Int_t voxel = 0;
+    nextVoxel->Reset();
+    while ((keyVoxel = (TKey*)nextVoxel->Next())){
+        if (!isVoxelLoaded(voxel++)){
+            continue;
+        }
+
+        Float_t* p_dcb = &array[size_t(v) * numberOfElements];
+
+        Double_t sensitivity = 0;
+        TString nameOfVoxel = keyVoxel->GetName();
+        TDirectory* dirOfVoxel = (TDirectory*)systemMatrixFile->Get(nameOfVoxel);
+        TIter nextS_dc(dirOfVoxel->GetListOfKeys());
+        while ((keyS_dcVoxel = (TKey*)nextS_dc())){
+            // iterate through all spectra in voxel v
+
+            TString nameOfS_dc = keyS_dcVoxel->GetName();
+            Int_t detectorD;
+            Int_t detectorC;
+            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
+
+            TH1F* S_dc = (TH1F*)dirOfVoxel->Get(nameOfS_dc);
+
+            // Divide counts by numbers of EMISSIONS (usually unkown) in the voxel to maintain absolute counts
+            S_dc->Scale(1.0 / 5000000);  // Tonis Simulation 20181212_5x5mm2.root with 441 positions, solid angle correction not considered
+
+            if ((detectorD < nDet) && (detectorC < nDet)){
+                for (Int_t bin = 1; bin <= numberOfBins; ++bin){
+                    Double_t binContent = S_dc->GetBinContent(firstBin + bin - 1);
+                    p_dcb[Utilities::getElementIndex(detectorD, detectorC, bin - 1, nDet, numberOfBins)] = binContent;
+
+                    sensitivity += binContent;
+                }
+            }
+
+            delete S_dc;
+        }
+
+        delete dirOfVoxel;
+        sensitivities.push_back(sensitivity);
+        ++v;
+    }
+
+    LargeArrays::report(array, size_t(numberOfVoxels) * numberOfElements * sizeof(Float_t), "System matrix");
+
+    if (sharedArray){
+        std::copy(sensitivities.begin(), sensitivities.end(), sharedArray->getSensitivities());
+        sharedArray->publish();
+    }
+}
+
+void SystemMatrix::createSystemMatrixRows(const Int_t nDet, const std::vector<UInt_t>& elements,
+                                          const std::function<void(const std::vector<Float_t>&)> receiver){
+    // (OUT-OF-CORE MODE) read the probabilities voxel by voxel, restricted to the given measurement elements
+    // (see Utilities::getElementIndex); every row is handed to the receiver and not kept
+
+    numberOfDetectors = nDet;
+    numberOfElements = nDet * nDet * numberOfBins;
+    numberOfVoxels = voxels.empty() ? systemMatrixFile->GetListOfKeys()->GetSize() : voxels.size();
+
+    std::vector<Int_t> positionOfElement(numberOfElements, -1);
+    for (UInt_t m = 0; m < elements.size(); ++m){
+        positionOfElement[elements[m]] = m;
+    }
+
+    std::vector<Float_t> p_m(elements.size());
+
+    // iterate through all voxels v
+    Int_t voxel = 0;
+    nextVoxel->Reset();
+    while ((keyVoxel = (TKey*)nextVoxel->Next())){
+        if (!isVoxelLoaded(voxel++)){
+            continue;
+        }
+
+        std::fill(p_m.begin(), p_m.end(), 0);
+
+        TString nameOfVoxel = keyVoxel->GetName();
+        TDirectory* dirOfVoxel = (TDirectory*)systemMatrixFile->Get(nameOfVoxel);
+        TIter nextS_dc(dirOfVoxel->GetListOfKeys());
+        while ((keyS_dcVoxel = (TKey*)nextS_dc())){
+            // iterate through all spectra in voxel v
+
+            TString nameOfS_dc = keyS_dcVoxel->GetName();
+            Int_t detectorD;
+            Int_t detectorC;
+            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC) || (detectorD >= nDet) || (detectorC >= nDet)){
+                continue;
+            }
+
+            TH1F* S_dc = (TH1F*)dirOfVoxel->Get(nameOfS_dc);
+
+            // Divide counts by numbers of EMISSIONS (usually unkown) in the voxel to maintain absolute counts
+            S_dc->Scale(1.0 / 5000000);  // Tonis Simulation 20181212_5x5mm2.root with 441 positions, solid angle correction not considered
+
+            for (Int_t bin = 1; bin <= numberOfBins; ++bin){
+                Int_t m = positionOfElement[Utilities::getElementIndex(detectorD, detectorC, bin - 1, nDet, numberOfBins)];
+                if (m >= 0){
+                    p_m[m] = S_dc->GetBinContent(firstBin + bin - 1);
+                }
+            }
+
+            delete S_dc;
+        }
+
+        delete dirOfVoxel;
+        receiver(p_m);
+    }
+}
+
+Bool_t SystemMatrix::setRegionOfInterest(const RegionOfInterest& regionOfInterest, const std::vector<Double_t> volume){
+    // load only the voxels inside the region of interest, call before creating the system matrix
+    // returns kFALSE if no voxel is inside
 
-    p_dcbvPrime = new TList();
+    if (!regionOfInterest.isUsed()){
+        return kTRUE;
+    }
+
+    Int_t numberOfVoxelsInFile = systemMatrixFile->GetListOfKeys()->GetSize();
+    voxels = regionOfInterest.getVoxels(volume, size,
+                                        regionOfInterest.isSensitivityNeeded() ? readSensitivities() : std::vector<Double_t>());
+
+    isVoxelSelected.assign(numberOfVoxelsInFile, kFALSE);
+    for (UInt_t i = 0; i < voxels.size(); ++i){
+        if (voxels[i] < numberOfVoxelsInFile){
+            isVoxelSelected[voxels[i]] = kTRUE;
+        }
+    }
+
+    std::cout << "\nRegion of interest:\t" << voxels.size() << " of " << numberOfVoxelsInFile << " voxels\n";
+    return !voxels.empty();
+}
+
+std::string SystemMatrix::getArrayKey() const{
+    // everything the array depends on: the file (path, modification time and size), detectors,
+    // energy window, selected pairs and loaded voxels
+
+    std::ostringstream key;
+
+    struct stat status;
+    char* path = realpath(systemMatrixFile->GetName(), nullptr);
+    key << (path ? path : systemMatrixFile->GetName());
+    if (stat(path ? path : systemMatrixFile->GetName(), &status) == 0){
+        key << "|" << status.st_mtime << "|" << status.st_size;
+    }
+    std::free(path);
+
+    key << "|" << numberOfDetectors << "|" << firstBin << "|" << numberOfBins << "|";
+    for (Int_t d = 0; d < numberOfDetectors; ++d){
+        for (Int_t c = 0; c < numberOfDetectors; ++c){
+            key << (selection.isPairSelected(d, c) ? "1" : "0");
+        }
+    }
+
+    key << "|";
+    for (UInt_t i = 0; i < voxels.size(); ++i){
+        key << voxels[i] << ",";
+    }
+
+    return key.str();
+}
 
-    TIter next(systemMatrix);
-    TH3F* p_dcb;
-    while ((p_dcb = (TH3F*)next())){
+std::vector<Double_t> SystemMatrix::readSensitivities(){
+    // sum of the selected spectra of every voxel, without keeping the spectra
 
-        TString name;
-        name.Form("%s_prime", p_dcb->GetName());
+    std::vector<Double_t> sensitivitiesOfVoxels;
 
-        TH3F* p_dcbPrime = (TH3F*)p_dcb->Clone(name);
-        p_dcbPrime->Multiply(N_dcb);
+    nextVoxel->Reset();
+    while ((keyVoxel = (TKey*)nextVoxel->Next())){
+        Double_t sensitivity = 0;
+        TString nameOfVoxel = keyVoxel->GetName();
+        TDirectory* dirOfVoxel = (TDirectory*)systemMatrixFile->Get(nameOfVoxel);
+        TIter nextS_dc(dirOfVoxel->GetListOfKeys());
+        while ((keyS_dcVoxel = (TKey*)nextS_dc())){
+            TString nameOfS_dc = keyS_dcVoxel->GetName();
+            Int_t detectorD;
+            Int_t detectorC;
+            Utilities::getDetectorIndices(nameOfS_dc(3, 4), detectorD, detectorC);
+            if (!selection.isPairSelected(detectorD, detectorC)){
+                continue;
+            }
 
-        p_dcbvPrime->AddLast(p_dcbPrime);
+            TH1F* S_dc = (TH1F*)dirOfVoxel->Get(nameOfS_dc);
+            sensitivity += S_dc->Integral(firstBin, firstBin + numberOfBins - 1) / 5000000;
+            delete S_dc;
+        }
+
+        delete dirOfVoxel;
+        sensitivitiesOfVoxels.push_back(sensitivity);
     }
+
+    return sensitivitiesOfVoxels;
 }
 
 void SystemMatrix::getNumbers(){
-    // get number of bins
+    // get number of bins and the energy range
 
     TString nameOfLastVoxel = systemMatrixFile->GetListOfKeys()->Last()->GetName();
     TDirectory* dirOfLastVoxel = (TDirectory*)systemMatrixFile->Get(nameOfLastVoxel);
     TString nameOfLastS_dc = dirOfLastVoxel->GetListOfKeys()->Last()->GetName();
-    numberOfBins = ((TH1F*)dirOfLastVoxel->Get(nameOfLastS_dc))->GetNbinsX();
+    TH1F* lastS_dc = (TH1F*)dirOfLastVoxel->Get(nameOfLastS_dc);
+    Int_t lastBin;
+    selection.getBinRange(lastS_dc, firstBin, lastBin);
+    numberOfBins = lastBin - firstBin + 1;
+    minimumEnergy = lastS_dc->GetXaxis()->GetBinLowEdge(firstBin);
+    maximumEnergy = lastS_dc->GetXaxis()->GetBinUpEdge(lastBin);
+    delete lastS_dc;
     delete dirOfLastVoxel;
 }
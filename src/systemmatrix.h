@@ -4,29 +4,64 @@
 #include <TH3.h>
 #include <TKey.h>
 #include <TFile.h>
+#include <functional>
+
+#include "selection.h"
+#include "roi.h"
+#include "sharedmatrix.h"
+#include "largearray.h"
 
 // ##### SYSTEM MATRIX #####
 class SystemMatrix{
 public:
-    SystemMatrix(const TString pathToProjections);
+    SystemMatrix(const TString pathToProjections, const Selection& selection = Selection());
     ~SystemMatrix();
 
     void createSystemMatrix(const Int_t nDet);  // OE
     void createSystemMatrix(const Bool_t normalized, const TH3F* N_dcb, const Int_t nDet);  // MLEM
-    void createP_dcbvPrime(const TH3F* N_dcb);
+    void createSystemMatrixArray(const Int_t nDet);  // batched MLEM
+    void createSystemMatrixRows(const Int_t nDet, const std::vector<UInt_t>& elements,
+                                const std::function<void(const std::vector<Float_t>&)> receiver);  // out-of-core MLEM
+
+    Bool_t setRegionOfInterest(const RegionOfInterest& regionOfInterest, const std::vector<Double_t> volume);
 
     Int_t numberOfBins;
+    Int_t numberOfDetectors;
+    Int_t numberOfElements;    // nDet * nDet * numberOfBins
+    Int_t numberOfVoxels;
     std::array<Int_t, 3> size;
+    std::vector<Int_t> voxels;  // numbers of the loaded voxels (region of interest), empty: all voxels
+
+    // energy range of the spectra (in the energy window), needed to bin list-mode events
+    Double_t minimumEnergy;
+    Double_t maximumEnergy;
 
     TList* systemMatrix = nullptr;
-    TList* p_dcbvPrime = nullptr;  // systemMatrix x N_dcb
     std::vector<Double_t> sensitivities;
 
-    // vector mode for system matrix: 1) voxel 2) d 3) c 4) bin
-    std::vector<std::vector<std::vector<std::vector<Double_t> > > > systemMatrixVector;
+    // vector mode for system matrix: 1) voxel 2) measurement element (d/c/b), see Utilities::getElementIndex
+    std::vector<std::vector<Float_t> > systemMatrixVector;
+
+    // array mode for system matrix: one contiguous array, voxel after voxel, see Utilities::getElementIndex
+    // (private or in shared memory, see setArraySharing)
+    LargeFloatArray systemMatrixArray;
+    const Float_t* getP_dcb(const Int_t v) const { return p_dcbvArray + size_t(v) * numberOfElements; }
+
+    static void setArraySharing(const Bool_t isShared){isArrayShared = isShared;}
 
 private:
     void getNumbers();
+    std::vector<Double_t> readSensitivities();
+    Bool_t isVoxelLoaded(const Int_t v) const {return isVoxelSelected.empty() || isVoxelSelected[v];}
+    std::string getArrayKey() const;
+
+    Selection selection;
+    Int_t firstBin;            // first bin of the spectra in the energy window
+    std::vector<Bool_t> isVoxelSelected;
+
+    static Bool_t isArrayShared;
+    const Float_t* p_dcbvArray = nullptr;
+    SharedSystemMatrix* sharedArray = nullptr;
 
     TFile* systemMatrixFile = nullptr;
     TIter* nextVoxel = nullptr;
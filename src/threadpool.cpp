@@ -0,0 +1,79 @@
+// threadpool.cpp
+
+#include "threadpool.h"
+#include <algorithm>
+
+// ##### THREAD POOL #####
+ThreadPool::ThreadPool(const UInt_t numberOfThreads) : numberOfRunningTasks(0), isStopping(kFALSE){
+    // start the worker threads
+
+    UInt_t n = numberOfThreads;
+    if (n == 0){
+        n = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (UInt_t t = 0; t < n; ++t){
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    // finish all queued tasks, then stop the workers
+
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = kTRUE;
+    }
+    taskReady.notify_all();
+
+    for (UInt_t t = 0; t < workers.size(); ++t){
+        workers[t].join();
+    }
+}
+
+void ThreadPool::enqueue(const std::function<void()> task){
+    // add a task to the queue
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait(){
+    // block until the queue is empty and no task is running
+
+    std::unique_lock<std::mutex> lock(mutex);
+    allTasksDone.wait(lock, [this]{ return tasks.empty() && (numberOfRunningTasks == 0); });
+}
+
+void ThreadPool::work(){
+    // (WORKER THREAD) process tasks until the pool is stopped
+
+    for (;;){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskReady.wait(lock, [this]{ return isStopping || !tasks.empty(); });
+
+            if (tasks.empty()){
+                return;  // stopping and nothing left
+            }
+
+            task = tasks.front();
+            tasks.pop_front();
+            ++numberOfRunningTasks;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --numberOfRunningTasks;
+        }
+        allTasksDone.notify_all();
+    }
+}
@@ -0,0 +1,35 @@
+// threadpool.h
+// fixed number of worker threads processing a queue of tasks
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <TROOT.h>
+
+// ##### THREAD POOL #####
+class ThreadPool{
+public:
+    ThreadPool(const UInt_t numberOfThreads = 0);  // 0: one thread per hardware thread
+    ~ThreadPool();
+
+    void enqueue(const std::function<void()> task);
+    void wait();
+
+    UInt_t getNumberOfThreads() const { return workers.size(); }
+
+private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    UInt_t numberOfRunningTasks;
+    Bool_t isStopping;
+
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable allTasksDone;
+};
@@ -1,6 +1,8 @@
 // user_prompts.h
 
 #pragma once
+#include <vector>
+#include <sstream>
 #include <boost/lexical_cast.hpp>
 #include <TFile.h>
 #include <TString.h>
@@ -87,3 +89,77 @@ double promptParameter(std::string promptString, double lowerLimit, double upper
 
     return choice;
 }
+
+std::vector<double> promptList(std::string promptString, double lowerLimit, double upperLimit){
+    // prompt user for a comma separated list of parameters (e.g. 1,1.5,1.9)
+
+    std::string input;
+    std::vector<double> choices;
+
+    for (;;){
+       std::cout << promptString;
+       std::cin >> input;  // get user input
+
+       choices.clear();
+       std::stringstream stream(input);
+       std::string item;
+
+       try{
+           while (std::getline(stream, item, ',')){
+               double choice = boost::lexical_cast<double>(item);
+
+               if ((choice < lowerLimit) || (choice >= upperLimit)){
+                   choices.clear();
+                   break;
+               }
+
+               choices.push_back(choice);
+           }
+
+           if (!choices.empty()){
+               break;  // success
+           }
+
+       } catch(const boost::bad_lexical_cast &e){
+           std::cerr << e.what() << "\n";  // print error message
+       }
+    }
+
+    return choices;
+}
+
+std::vector<TString> promptSeries(std::string promptString, int numberOfFiles){
+    // prompt user for a numbered series of .root files (e.g. frame_%i.root, numbers starting at 0)
+
+    TString input;
+    std::vector<TString> paths;
+
+    if (numberOfFiles <= 0){
+       std::cout << "The number of files has to be positive.\n";
+       return paths;  // empty, no file would ever be accepted
+    }
+
+    for (;;){
+       std::cout << promptString;
+       std::cin >> input;  // get user input
+
+       paths.clear();
+       for (int i = 0; i < numberOfFiles; ++i){
+           TString path;
+           path.Form(input.Data(), i);
+
+           if (!checkPath(path)){
+               paths.clear();
+               break;
+           }
+
+           paths.push_back(path);
+       }
+
+       if (!paths.empty()){
+           break;  // success
+       }
+    }
+
+    return paths;
+}
@@ -1,6 +1,7 @@
 // utilities.cpp
 
 #include "utilities.h"
+#include <TH3.h>
 
 Bool_t Utilities::checkForSameNumberOfBins(const Int_t NbinsMeasurements, const Int_t NbinsSystemMatrix){
     // image reconstruction is not possible unless the number of bins are identical
@@ -43,3 +44,68 @@ void Utilities::getImageSpaceIndices(const TString titleOfVoxel, Int_t &x, Int_t
     y = location[1];
     z = location[2];
 }
+
+UInt_t Utilities::getElementIndex(const Int_t d, const Int_t c, const Int_t b, const Int_t nDet, const Int_t nBins){
+    // linear index of the measurement element (d, c, b), all indices starting at 0
+
+    return (UInt_t(d) * nDet + c) * nBins + b;
+}
+
+Bool_t Utilities::isRebinningPossible(const Int_t nBins, const Int_t factor){
+    // energy bins can only be merged in groups of equal size
+
+    if ((factor > 1) && (nBins % factor == 0)){
+        return kTRUE;
+    } else {
+        std::cout << "Rebinning factor " << factor << " does not divide " << nBins << " bins, skipped\n";
+        return kFALSE;
+    }
+}
+
+TH3F* Utilities::rebinEnergy(const TH3F* histogram, const Int_t factor, const TString name){
+    // merge groups of factor neighbouring energy bins (z axis) of a N_dcb-like histogram
+
+    Int_t nDetD = histogram->GetNbinsX();
+    Int_t nDetC = histogram->GetNbinsY();
+    Int_t nBins = histogram->GetNbinsZ() / factor;
+
+    TH3F* rebinned = new TH3F(name, histogram->GetTitle(),
+                              nDetD, 0, nDetD,
+                              nDetC, 0, nDetC,
+                              nBins, 0, nBins);
+
+    for (Int_t d = 1; d <= nDetD; ++d){
+        for (Int_t c = 1; c <= nDetC; ++c){
+            for (Int_t bin = 1; bin <= nBins * factor; ++bin){
+
+                Double_t binContent = histogram->GetBinContent(d, c, bin);
+                if (binContent != 0){
+                    Int_t rebinnedBin = (bin - 1) / factor + 1;
+                    rebinned->SetBinContent(d, c, rebinnedBin, rebinned->GetBinContent(d, c, rebinnedBin) + binContent);
+                }
+            }
+        }
+    }
+
+    return rebinned;
+}
+
+std::vector<std::vector<Float_t> > Utilities::rebinEnergy(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                                          const Int_t nBins, const Int_t factor){
+    // merge groups of factor neighbouring energy bins of the (OE) system matrix, see getElementIndex
+
+    Int_t rebinnedBins = nBins / factor;
+
+    std::vector<std::vector<Float_t> > rebinned(systemMatrix.size());
+    for (UInt_t v = 0; v < systemMatrix.size(); ++v){
+        rebinned[v].assign(systemMatrix[v].size() / factor, 0.0);
+
+        for (UInt_t element = 0; element < systemMatrix[v].size(); ++element){
+            UInt_t pair = element / nBins;
+            Int_t bin = element % nBins;
+            rebinned[v][pair * rebinnedBins + bin / factor] += systemMatrix[v][element];
+        }
+    }
+
+    return rebinned;
+}
@@ -6,10 +6,19 @@
 
 // #pragma once
 #include <iostream>
+#include <vector>
 #include <TROOT.h>
 
+class TH3F;
+
 namespace Utilities {
     Bool_t checkForSameNumberOfBins(const Int_t NbinsMeasurements, const Int_t NbinsSystemMatrix);
     void getDetectorIndices(const TString nameOfSpectrum, Int_t& d, Int_t& c);
     void getImageSpaceIndices(const TString titleOfVoxel, Int_t &x, Int_t &y, Int_t &z);
+    UInt_t getElementIndex(const Int_t d, const Int_t c, const Int_t b, const Int_t nDet, const Int_t nBins);
+
+    Bool_t isRebinningPossible(const Int_t nBins, const Int_t factor);
+    TH3F* rebinEnergy(const TH3F* histogram, const Int_t factor, const TString name);
+    std::vector<std::vector<Float_t> > rebinEnergy(const std::vector<std::vector<Float_t> >& systemMatrix,
+                                                   const Int_t nBins, const Int_t factor);
 }